@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+"""End-to-end throughput of the wifipicprog client and the firmware.
+
+Starts the host build of the firmware (oldfirmware/host, ``wpp-host``) with
+a simulated target for each device, puts a shaped link in front of it to
+model WiFi, and times what a user would do through the real client:
+detect, full read, write, verify, erase, small partial updates and
+programming images with a varying share of blank words.
+
+The host build runs with real-time pacing (``wpp-host -r``), so the ICSP
+delays take as long as on hardware and the numbers are comparable to a
+programmer on the bench.  ``--virtual`` leaves them out to time the
+protocol and the firmware code alone.
+
+Prints a JSON document with the samples, p50, p99 and words/s of every
+operation.
+"""
+
+import argparse
+import json
+import os
+import random
+import socket
+import subprocess
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+HOST_DIR = os.path.join(ROOT, 'oldfirmware', 'host')
+sys.path.insert(0, ROOT)
+
+from wifipicprog.exceptions import ProgrammerError  # noqa: E402
+from wifipicprog.protocol import WifiProgrammer  # noqa: E402
+from wifipicprog.shaping import ShapedLink  # noqa: E402
+
+
+BLANK = 0x3FFF
+PARTIAL_WORDS = 8
+PARTIAL_BYTES = 16
+
+
+class Device:
+    def __init__(self, line):
+        fields = line.split()
+        self.name = fields[0]
+        self.id = int(fields[1])
+        self.program_size = int(fields[2])
+        self.data_start = int(fields[5], 16)
+        self.data_size = int(fields[6])
+
+
+def percentile(samples, p):
+    """Nearest-rank percentile."""
+    ordered = sorted(samples)
+    rank = max(int(-(-p * len(ordered) // 100)), 1)
+    return ordered[rank - 1]
+
+
+def image(size, blank_ratio, rng):
+    """Random program words, with runs of blank words making up about
+    blank_ratio of the image, as code and tables leave them."""
+    words = [rng.randrange(BLANK) for _ in range(size)]
+    blank = int(size * blank_ratio)
+    while blank > 0:
+        run = min(rng.randrange(1, 65), blank)
+        start = rng.randrange(size - run + 1)
+        blank -= sum(1 for w in words[start:start + run] if w != BLANK)
+        words[start:start + run] = [BLANK] * run
+    return words
+
+
+def runs(words):
+    """(address, words) runs of non-blank words, what a client sends."""
+    result = []
+    start = None
+    for address, word in enumerate(words + [BLANK]):
+        if word != BLANK and start is None:
+            start = address
+        elif word == BLANK and start is not None:
+            result.append((start, words[start:address]))
+            start = None
+    return result
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(('127.0.0.1', 0))
+        return s.getsockname()[1]
+
+
+def wait_port(port, process, timeout=5):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if process.poll() is not None:
+            raise RuntimeError('wpp-host exited')
+        try:
+            socket.create_connection(('127.0.0.1', port)).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    raise RuntimeError('wpp-host did not start')
+
+
+class Bench:
+    def __init__(self, programmer, device, rng):
+        self.programmer = programmer
+        self.device = device
+        self.rng = rng
+        self.results = {}
+
+    def time(self, name, words, action, repeat, setup=None):
+        samples = []
+        try:
+            for _ in range(repeat):
+                if setup:
+                    setup()
+                start = time.perf_counter()
+                action()
+                samples.append(time.perf_counter() - start)
+        except (ProgrammerError, RuntimeError) as e:
+            # Recorded, not fatal: the other operations still tell a lot.
+            self.results[name] = {'samples_s': samples, 'words': words,
+                                  'error': str(e)}
+            return
+        p50 = percentile(samples, 50)
+        self.results[name] = {
+            'samples_s': samples,
+            'words': words,
+            'p50_s': p50,
+            'p99_s': percentile(samples, 99),
+            'words_per_s': words / p50 if words and p50 else None,
+        }
+
+    def run(self, repeat, small_repeat, blank_ratios):
+        p = self.programmer
+        size = self.device.program_size
+        data = self.device.data_start
+        full = image(size, 0, self.rng)
+
+        def detect():
+            response = p.get_device_info()
+            if not response.ok:
+                raise RuntimeError(f'detect failed: {response}')
+
+        def read():
+            words = p.read(0, size - 1)
+            if len(words) != size:
+                raise RuntimeError(f'read {len(words)} of {size} words')
+            return words
+
+        def cold():
+            # The programmer answers reads from its shadow of the chip
+            # until the target is powered off.
+            p.power_off()
+            detect()
+
+        def verify():
+            if read() != full:
+                raise RuntimeError('verify failed')
+
+        def partial():
+            address = self.rng.randrange(size - PARTIAL_WORDS)
+            p.write_binary(address, image(PARTIAL_WORDS, 0, self.rng))
+
+        def partial_data():
+            address = data + self.rng.randrange(
+                self.device.data_size - PARTIAL_BYTES)
+            p.write_data(address, bytes(
+                self.rng.randrange(256) for _ in range(PARTIAL_BYTES)))
+
+        self.time('detect', 0, detect, small_repeat)
+        self.time('write', size, lambda: p.write_binary(0, full), repeat)
+        self.time('read', size, read, repeat, cold)
+        self.time('read_cached', size, read, repeat)
+        self.time('verify', size, verify, repeat, cold)
+        # There is no ERASE command; a client blanks program memory by
+        # writing it over.
+        self.time('erase', size, lambda: p.write_binary(0, [BLANK] * size),
+                  repeat)
+        self.time('partial', PARTIAL_WORDS, partial, small_repeat)
+        self.time('partial_data', PARTIAL_BYTES, partial_data, small_repeat)
+
+        for ratio in blank_ratios:
+            words = image(size, ratio, self.rng)
+            pieces = runs(words)
+            sent = sum(len(w) for _, w in pieces)
+
+            def program():
+                for address, chunk in pieces:
+                    p.write_binary(address, chunk)
+
+            name = f'program_blank_{ratio:g}'
+            self.time(name, sent, program, repeat)
+            self.results[name]['image_words'] = size
+
+        return self.results
+
+
+def bench_device(args, device, rng):
+    sp_port = free_port()
+    webadmin_port = free_port()
+    command = [os.path.join(HOST_DIR, 'wpp-host'), '-d', device.name,
+               '-p', str(sp_port), '-w', str(webadmin_port)]
+    if not args.virtual:
+        command.append('-r')
+    process = subprocess.Popen(command, stderr=subprocess.DEVNULL)
+    try:
+        wait_port(sp_port, process)
+        link = ShapedLink(('127.0.0.1', sp_port), args.rtt / 1000,
+                          args.bandwidth * 1000 / 8)
+        with link, WifiProgrammer('127.0.0.1', link.port,
+                                  args.compress) as programmer:
+            return Bench(programmer, device, rng).run(
+                args.repeat, args.small_repeat, args.blank_ratios)
+    finally:
+        process.terminate()
+        process.wait()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('-d', '--devices', nargs='+',
+                        help='devices to run, all with an ID by default')
+    parser.add_argument('-n', '--repeat', type=int, default=3,
+                        help='runs of whole-memory operations')
+    parser.add_argument('--small-repeat', type=int, default=20,
+                        help='runs of detect and partial updates')
+    parser.add_argument('--rtt', type=float, default=5,
+                        help='round trip time to model, in ms')
+    parser.add_argument('--bandwidth', type=float, default=10000,
+                        help='link bandwidth in kbit/s, 0 for unlimited')
+    parser.add_argument('--blank-ratios', type=float, nargs='+',
+                        default=[0, 0.5, 0.9],
+                        help='share of blank words in programmed images')
+    parser.add_argument('--compress', action='store_true',
+                        help='compress requests and responses')
+    parser.add_argument('--virtual', action='store_true',
+                        help='skip ICSP delays, time the code alone')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('-o', '--output', help='write JSON here, not stdout')
+    args = parser.parse_args()
+
+    subprocess.run(['make', '-s', '-C', HOST_DIR, 'wpp-host'], check=True)
+    listing = subprocess.run(
+        [os.path.join(HOST_DIR, 'wpp-host'), '-l'], check=True,
+        capture_output=True, text=True).stdout
+    devices = [Device(line) for line in listing.splitlines()]
+    if args.devices:
+        devices = [d for d in devices if d.name in args.devices]
+    else:
+        # Without an ID there is nothing to detect.
+        devices = [d for d in devices if d.id >= 0]
+
+    rng = random.Random(args.seed)
+    results = {
+        'config': {
+            'rtt_ms': args.rtt,
+            'bandwidth_kbps': args.bandwidth,
+            'repeat': args.repeat,
+            'small_repeat': args.small_repeat,
+            'compress': args.compress,
+            'realtime': not args.virtual,
+            'seed': args.seed,
+        },
+        'devices': {},
+    }
+    for device in devices:
+        print(f'{device.name}...', file=sys.stderr)
+        results['devices'][device.name] = bench_device(args, device, rng)
+
+    text = json.dumps(results, indent=2)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+    else:
+        print(text)
+
+
+if __name__ == '__main__':
+    main()
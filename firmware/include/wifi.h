@@ -17,15 +17,25 @@
 
 #define WIFI_SOFTAP_CHANNEL		7
 
+// RTC memory block of the fast connect cache, the first one for users.
+#define WIFI_RTC_BLOCK			64
+#define WIFI_CACHE_VALID		0x01
+
 
 typedef void (*WifiCallback)(uint8_t);
 
+/*
+ * Kept in RTC memory over a reset: the last lease, and the AP and channel
+ * it came from, for the station config with the given hash.
+ */
 struct dhcp_client_info {
 	ip_addr_t ip_addr;
 	ip_addr_t netmask;
 	ip_addr_t gw;
 	uint8 flag;
-	uint8 pad[3];
+	uint8 channel;
+	uint8 bssid[6];
+	uint32 config;
 };
 
 
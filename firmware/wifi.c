@@ -11,49 +11,166 @@
 #include <os_type.h>
 
 
-static ETSTimer WiFiLinker;
+static ETSTimer fallback_timer;
 static uint8_t wifiStatus = STATION_IDLE;
-static uint8_t lastWifiStatus = STATION_IDLE;
 WifiCallback wifiCb = NULL;
 
+// Connecting with the cache: pinned to its AP, with its lease.
+static bool fast = false;
+static struct dhcp_client_info cache;
 
-static void ICACHE_FLASH_ATTR wifi_check_ip(void *arg) {
-	struct ip_info ipConfig;
+// Station config from the params, before the fast connect pins it.
+static struct station_config station_params;
 
-	os_timer_disarm(&WiFiLinker);
-	wifi_get_ip_info(STATION_IF, &ipConfig);
-	wifiStatus = wifi_station_get_connect_status();
-	if (wifiStatus == STATION_GOT_IP && ipConfig.ip.addr != 0) {
-		os_timer_setfn(&WiFiLinker, (os_timer_func_t *)wifi_check_ip, NULL);
-		os_timer_arm(&WiFiLinker, 3000, 0);
+
+static void ICACHE_FLASH_ATTR
+wifi_set_status(uint8_t status) {
+	if (status == wifiStatus) {
+		return;
 	}
-	else
-	{
-		if(wifi_station_get_connect_status() == STATION_WRONG_PASSWORD) {
-			os_printf("STATION_WRONG_PASSWORD\r\n");
-			wifi_station_connect();
+	wifiStatus = status;
+	if(wifiCb) {
+		wifiCb(wifiStatus);
+	}
+}
+
+
+// FNV-1a of the SSID and password, the cache is for these only.
+static uint32_t ICACHE_FLASH_ATTR
+wifi_config_hash(const struct station_config *config) {
+	uint32_t hash = 2166136261UL;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(config->ssid); i++) {
+		hash = (hash ^ config->ssid[i]) * 16777619UL;
+	}
+	for (i = 0; i < sizeof(config->password); i++) {
+		hash = (hash ^ config->password[i]) * 16777619UL;
+	}
+	return hash;
+}
+
+
+/*
+ * Connect straight to the AP of the last connection, on its channel, and
+ * take up its lease again: no scan, no DHCP.  Returns false without a
+ * cache for the given station config.
+ */
+static bool ICACHE_FLASH_ATTR
+wifi_fast_connect(struct station_config *station) {
+	struct ip_info info;
+
+	system_rtc_mem_read(WIFI_RTC_BLOCK, &cache, sizeof(cache));
+	if (cache.flag != WIFI_CACHE_VALID || 
+			cache.config != wifi_config_hash(station)) {
+		return false;
+	}
+	if (wifi_station_dhcpc_status() == DHCP_STARTED) {
+		wifi_station_dhcpc_stop();
+	}
+	info.ip = cache.ip_addr;
+	info.netmask = cache.netmask;
+	info.gw = cache.gw;
+	if (!wifi_set_ip_info(STATION_IF, &info)) {
+		os_printf("set default ip wrong\n");
+		wifi_station_dhcpc_start();
+		return false;
+	}
+	station->bssid_set = 1;
+	os_memcpy(station->bssid, cache.bssid, sizeof(station->bssid));
+	wifi_set_channel(cache.channel);
+	os_printf("WIFI_FAST_CONNECT: " MACSTR " channel: %d ip: " IPSTR "\r\n",
+			MAC2STR(cache.bssid), cache.channel, IP2STR(&cache.ip_addr));
+	return true;
+}
+
+
+// Back to scanning and DHCP, out of the event handler.
+static void ICACHE_FLASH_ATTR
+wifi_fallback(void *arg) {
+	struct station_config station = station_params;
+
+	station.bssid_set = 0;
+	wifi_station_set_config_current(&station);
+	wifi_station_dhcpc_start();
+	wifi_station_connect();
+}
+
+
+static void ICACHE_FLASH_ATTR
+wifi_got_ip(const Event_StaMode_Got_IP_t *got_ip) {
+	struct station_config station;
+
+	os_printf("WIFI_READY: %d ms after boot\r\n", system_get_time() / 1000);
+	// The AP came with the CONNECTED event, the lease is this one.
+	wifi_station_get_config(&station);
+	cache.ip_addr = got_ip->ip;
+	cache.netmask = got_ip->mask;
+	cache.gw = got_ip->gw;
+	cache.flag = WIFI_CACHE_VALID;
+	cache.config = wifi_config_hash(&station);
+	system_rtc_mem_write(WIFI_RTC_BLOCK, &cache, sizeof(cache));
+	wifi_set_status(STATION_GOT_IP);
+}
+
+
+static void ICACHE_FLASH_ATTR
+wifi_disconnected(uint8_t reason) {
+	if (fast) {
+		// The cached AP or lease did not do, or the link dropped: the next
+		// connection may well be to another AP.
+		if (wifiStatus != STATION_GOT_IP) {
+			os_printf("WIFI_FAST_CONNECT failed: %d\r\n", reason);
+			os_memset(&cache, 0, sizeof(cache));
+			system_rtc_mem_write(WIFI_RTC_BLOCK, &cache, sizeof(cache));
 		}
-		else if(wifi_station_get_connect_status() == STATION_NO_AP_FOUND) {
+		fast = false;
+		os_timer_disarm(&fallback_timer);
+		os_timer_arm(&fallback_timer, 0, 0);
+	}
+
+	// The SDK reconnects by itself, see wifi_station_set_reconnect_policy().
+	switch (reason) {
+		case REASON_NO_AP_FOUND:
 			os_printf("STATION_NO_AP_FOUND\r\n");
-			wifi_station_connect();
-		}
-		else if(wifi_station_get_connect_status() == STATION_CONNECT_FAIL) {
-			os_printf("STATION_CONNECT_FAIL\r\n");
-			wifi_station_connect();
-		}
-		//else {
-		//	os_printf("STATION_IDLE\r\n");
-		//}
+			wifi_set_status(STATION_NO_AP_FOUND);
+			break;
+
+		case REASON_AUTH_FAIL:
+		case REASON_4WAY_HANDSHAKE_TIMEOUT:
+		case REASON_HANDSHAKE_TIMEOUT:
+			os_printf("STATION_WRONG_PASSWORD\r\n");
+			wifi_set_status(STATION_WRONG_PASSWORD);
+			break;
 
-		os_timer_setfn(&WiFiLinker, (os_timer_func_t *)wifi_check_ip, NULL);
-		os_timer_arm(&WiFiLinker, 500, 0);
+		default:
+			os_printf("STATION_CONNECT_FAIL\r\n");
+			wifi_set_status(STATION_CONNECT_FAIL);
+			break;
 	}
-	
-	if(wifiStatus != lastWifiStatus){
-		lastWifiStatus = wifiStatus;
-		if(wifiCb) {
-			wifiCb(wifiStatus);
-		}
+}
+
+
+static void ICACHE_FLASH_ATTR
+wifi_event(System_Event_t *event) {
+	switch (event->event) {
+		case EVENT_STAMODE_CONNECTED:
+			os_memcpy(cache.bssid, event->event_info.connected.bssid, 
+					sizeof(cache.bssid));
+			cache.channel = event->event_info.connected.channel;
+			break;
+
+		case EVENT_STAMODE_GOT_IP:
+			wifi_got_ip(&event->event_info.got_ip);
+			break;
+
+		case EVENT_STAMODE_DISCONNECTED:
+			wifi_disconnected(event->event_info.disconnected.reason);
+			break;
+
+		case EVENT_STAMODE_DHCP_TIMEOUT:
+			os_printf("STATION_DHCP_TIMEOUT\r\n");
+			break;
 	}
 }
 
@@ -62,25 +179,6 @@ static void ICACHE_FLASH_ATTR
 wifi_init_softap(const char *ssid, const char *psk) {
 	uint8_t mac[6];
 
-	/***add by tzx for saving ip_info to avoid dhcp_client start****/
-    struct dhcp_client_info dhcp_info;
-    struct ip_info sta_info;
-    system_rtc_mem_read(64, &dhcp_info, sizeof(struct dhcp_client_info));
-	if(dhcp_info.flag == 0x01 ) {
-		if (true == wifi_station_dhcpc_status()) {
-			wifi_station_dhcpc_stop();
-		}
-		sta_info.ip = dhcp_info.ip_addr;
-		sta_info.gw = dhcp_info.gw;
-		sta_info.netmask = dhcp_info.netmask;
-		if ( true != wifi_set_ip_info(STATION_IF, &sta_info)) {
-			os_printf("set default ip wrong\n");
-		}
-	}
-    os_memset(&dhcp_info, 0, sizeof(struct dhcp_client_info));
-    system_rtc_mem_write(64, &dhcp_info, sizeof(struct rst_info));
-
-
 	// Get the device mac address
 	bool ok = wifi_get_macaddr(SOFTAP_IF, &mac[0]);
 	if (!ok) {
@@ -166,12 +264,16 @@ void ICACHE_FLASH_ATTR wifi_start(uint8_t opmode, Params *params,
 
 	os_sprintf(stationConf.ssid, "%s", params->station_ssid);
 	os_sprintf(stationConf.password, "%s", params->station_psk);
+	station_params = stationConf;
 
-	wifi_station_set_config_current(&stationConf);
+	os_timer_disarm(&fallback_timer);
+	os_timer_setfn(&fallback_timer, (os_timer_func_t *)wifi_fallback, NULL);
 
-	os_timer_disarm(&WiFiLinker);
-	os_timer_setfn(&WiFiLinker, (os_timer_func_t *)wifi_check_ip, NULL);
-	os_timer_arm(&WiFiLinker, 1000, 0);
+	// Events tell the state as it changes, nothing is polled.
+	wifi_set_event_handler_cb(wifi_event);
+	wifi_station_set_reconnect_policy(true);
+	fast = wifi_fast_connect(&stationConf);
+	wifi_station_set_config_current(&stationConf);
 
 	wifi_station_set_auto_connect(TRUE);
 	wifi_station_connect();
@@ -38,7 +38,6 @@ void wifi_connect_cb(uint8_t status) {
 
 void user_init(void) {
     uart_init(BIT_RATE_115200, BIT_RATE_115200);
-    os_delay_us(60000);
 	bool ok = params_load(&params);
 	if (!ok) {
 		os_printf("Cannot load Params, Trying to reset them.\r\n");
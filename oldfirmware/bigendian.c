@@ -26,3 +26,16 @@ uint32_t bigendian_deserialize_uint32(const unsigned char *buffer) {
 }
 
 
+ICACHE_FLASH_ATTR
+unsigned char * bigendian_serialize_uint16(unsigned char *buffer, 
+		uint16_t value) {
+  buffer[0] = value >> 8;
+  buffer[1] = value;
+  return buffer + 2;
+}
+
+
+ICACHE_FLASH_ATTR
+uint16_t bigendian_deserialize_uint16(const unsigned char *buffer) {
+	return (buffer[0] << 8) | buffer[1];
+}
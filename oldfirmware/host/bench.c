@@ -0,0 +1,189 @@
+/* 
+ * Microbenchmarks of the firmware hot paths, built for the host.
+ *
+ *   wpp-bench [iterations]
+ *
+ * parser      ECHO requests pipelined through a socketpair, parsed and
+ *             answered by sp_tcpserver
+ * bigendian   uint32 serialize and deserialize
+ * codec       sp_codec encode and decode of a program image
+ * icsp        DETECT on an empty socket; wall time per word read, and
+ *             the virtual time os_delay_us adds for the same word
+ */
+
+#include "host.h"
+
+#include "sp.h"
+#include "sp_tcpserver.h"
+#include "sp_codec.h"
+#include "bigendian.h"
+#include "pic.h"
+#include "pool.h"
+#include "log.h"
+#include "stats.h"
+
+#include <osapi.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define BENCH_ECHO_BODY		16
+#define BENCH_PIPELINE		32
+#define BENCH_IMAGE_SIZE	1024
+
+
+static uint64_t
+_now_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+static void
+_report(const char *name, const char *unit, uint64_t ns, uint64_t count) {
+	printf("%-12s %10.1f ns/%s  (%llu in %.3f ms)\n", name, 
+			(double)ns / count, unit, (unsigned long long)count, ns / 1e6);
+}
+
+
+static void
+bench_parser(uint32_t iterations) {
+	char request[5 + BENCH_ECHO_BODY];
+	char response[4096];
+	uint32_t expected = iterations * (5 + BENCH_ECHO_BODY);
+	uint32_t received = 0;
+	uint32_t sent = 0;
+	uint64_t start;
+	ssize_t length;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 ||
+			host_espconn_attach(SP_TCPSERVER_PORT, fds[0]) == NULL) {
+		perror("parser");
+		return;
+	}
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	request[0] = SP_CMD_ECHO;
+	bigendian_serialize_uint32(request + 1, BENCH_ECHO_BODY);
+	os_memset(request + 5, 'x', BENCH_ECHO_BODY);
+
+	start = _now_ns();
+	while (received < expected) {
+		// Keep a window of requests in flight, as a pipelining client does.
+		while (sent < iterations && 
+				sent * sizeof(request) - received < 
+				BENCH_PIPELINE * sizeof(request)) {
+			if (write(fds[1], request, sizeof(request)) != sizeof(request)) {
+				break;
+			}
+			sent++;
+		}
+		host_loop_once(10);
+		while ((length = read(fds[1], response, sizeof(response))) > 0) {
+			received += length;
+		}
+		if (length == 0) {
+			fprintf(stderr, "parser: connection closed\n");
+			break;
+		}
+	}
+	_report("parser", "request", _now_ns() - start, iterations);
+	close(fds[1]);
+	host_loop_once(0);
+}
+
+
+static void
+bench_bigendian(uint32_t iterations) {
+	unsigned char buffer[4];
+	volatile uint32_t sum = 0;
+	uint64_t start = _now_ns();
+	uint32_t i;
+
+	for (i = 0; i < iterations; i++) {
+		bigendian_serialize_uint32(buffer, i);
+		sum += bigendian_deserialize_uint32(buffer);
+	}
+	_report("bigendian", "pair", _now_ns() - start, iterations);
+}
+
+
+static void
+bench_codec(uint32_t iterations) {
+	static unsigned char image[BENCH_IMAGE_SIZE];
+	static unsigned char encoded[sp_codec_bound(BENCH_IMAGE_SIZE)];
+	static unsigned char decoded[BENCH_IMAGE_SIZE];
+	SPDecoder decoder;
+	uint32_t encoded_length = 0;
+	uint16_t produced;
+	uint64_t start;
+	uint32_t i;
+
+	// A program image: some code, then erased words as hex files leave it.
+	for (i = 0; i < BENCH_IMAGE_SIZE; i += 2) {
+		image[i] = i < BENCH_IMAGE_SIZE / 4 ? (i * 7) >> 3 : 0x3F;
+		image[i + 1] = i < BENCH_IMAGE_SIZE / 4 ? i * 13 : 0xFF;
+	}
+
+	start = _now_ns();
+	for (i = 0; i < iterations; i++) {
+		encoded_length = sp_codec_encode(image, BENCH_IMAGE_SIZE, encoded);
+	}
+	_report("encode", "KiB", _now_ns() - start, iterations);
+
+	start = _now_ns();
+	for (i = 0; i < iterations; i++) {
+		sp_codec_decoder_init(&decoder);
+		sp_codec_decode(&decoder, encoded, encoded_length, decoded, 
+				sizeof(decoded), &produced);
+	}
+	_report("decode", "KiB", _now_ns() - start, iterations);
+	if (produced != BENCH_IMAGE_SIZE || 
+			os_memcmp(image, decoded, BENCH_IMAGE_SIZE)) {
+		fprintf(stderr, "codec: round trip failed\n");
+	}
+}
+
+
+static void
+bench_icsp(uint32_t iterations) {
+	SPPacket req = {{SP_CMD_DETECT, 0, false, false, 0}, NULL};
+	uint32_t words = stats_counter(STATS_WORDS_READ);
+	uint64_t delay = host_delay_ns();
+	uint64_t start = _now_ns();
+	uint32_t i;
+
+	for (i = 0; i < iterations; i++) {
+		pic_command_detect_device(&req);
+	}
+	words = stats_counter(STATS_WORDS_READ) - words;
+	_report("icsp", "word", _now_ns() - start, words);
+	printf("%-12s %10.1f us/word virtual\n", "", 
+			(host_delay_ns() - delay) / 1000.0 / words);
+}
+
+
+int
+main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+
+	log_initialize();
+	stats_initialize();
+	pool_initialize();
+	sp_initialize();
+	sp_start();
+
+	bench_parser(iterations / 10);
+	bench_bigendian(iterations * 10);
+	bench_codec(iterations / 100);
+	bench_icsp(iterations / 1000 + 1);
+
+	sp_shutdown();
+	return 0;
+}
@@ -0,0 +1,531 @@
+/* 
+ * Host shim: espconn on POSIX sockets.
+ *
+ * Every espconn gets a non-blocking socket.  Like the SDK, each accepted
+ * client is a new espconn that inherits the listener's callbacks, a send
+ * must wait for the sent callback of the one before, and the sent and
+ * disconnect callbacks never run from inside the call that caused them.
+ */
+
+#include "host.h"
+
+#include <c_types.h>
+#include <espconn.h>
+#include <mem.h>
+#include <osapi.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+// Largest segment handed to a receive callback, as lwIP does.
+#define HOST_ESPCONN_MSS		1460
+
+#define HOST_ESPCONN_MAX_CLIENTS	5
+#define HOST_ESPCONN_PORT_MAPS	4
+
+
+typedef struct HostSocket {
+	struct HostSocket *next;
+	struct espconn *conn;
+	int fd;
+	bool listening;
+	struct HostSocket *listener;
+	struct HostSocket *active;
+	uint8_t max_clients;
+	uint8_t clients;
+	bool hold;
+	char *out;
+	uint16_t out_length;
+	uint16_t out_written;
+	bool sent_pending;
+	bool closing;
+	// Close without calling back, as espconn_abort and espconn_delete do.
+	bool quiet;
+} HostSocket;
+
+
+static HostSocket *sockets;
+
+static struct {
+	uint16_t from;
+	uint16_t to;
+} port_maps[HOST_ESPCONN_PORT_MAPS];
+
+
+void
+host_espconn_map_port(uint16_t from, uint16_t to) {
+	int i;
+	for (i = 0; i < HOST_ESPCONN_PORT_MAPS; i++) {
+		if (!port_maps[i].from || port_maps[i].from == from) {
+			port_maps[i].from = from;
+			port_maps[i].to = to;
+			return;
+		}
+	}
+}
+
+
+static uint16_t
+_mapped_port(uint16_t port) {
+	int i;
+	for (i = 0; i < HOST_ESPCONN_PORT_MAPS; i++) {
+		if (port_maps[i].from == port) {
+			return port_maps[i].to;
+		}
+	}
+	return port;
+}
+
+
+static HostSocket *
+_find(struct espconn *conn) {
+	HostSocket *s;
+	for (s = sockets; s != NULL; s = s->next) {
+		if (s->conn == conn) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+
+static HostSocket *
+_find_fd(int fd) {
+	HostSocket *s;
+	for (s = sockets; s != NULL; s = s->next) {
+		if (s->fd == fd) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+
+static HostSocket *
+_find_listener(uint16_t port) {
+	HostSocket *s;
+	for (s = sockets; s != NULL; s = s->next) {
+		if (s->listening && !s->closing &&
+				s->conn->proto.tcp->local_port == port) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+
+static void
+_close(HostSocket *s, bool quiet) {
+	if (s->closing) {
+		return;
+	}
+	s->closing = true;
+	s->quiet = quiet;
+	if (s->listener != NULL) {
+		s->listener->clients--;
+		if (s->listener->active == s) {
+			s->listener->active = NULL;
+		}
+	}
+}
+
+
+// Turn a connected socket into a client of a listener.
+static struct espconn *
+_add_client(HostSocket *listener, int fd) {
+	HostSocket *s;
+	struct espconn *conn;
+	struct sockaddr_in address;
+	socklen_t length = sizeof(address);
+	int one = 1;
+
+	if (listener->clients >= listener->max_clients) {
+		close(fd);
+		return NULL;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	conn = (struct espconn*) os_zalloc(sizeof(struct espconn));
+	*conn = *listener->conn;
+	conn->state = ESPCONN_CONNECT;
+	conn->proto.tcp = (esp_tcp*) os_zalloc(sizeof(esp_tcp));
+	*conn->proto.tcp = *listener->conn->proto.tcp;
+	if (getpeername(fd, (struct sockaddr*)&address, &length) == 0 &&
+			address.sin_family == AF_INET) {
+		os_memcpy(conn->proto.tcp->remote_ip, &address.sin_addr, 4);
+		conn->proto.tcp->remote_port = ntohs(address.sin_port);
+	}
+	else {
+		// A socketpair, give each one a distinct remote end.
+		conn->proto.tcp->remote_ip[0] = 127;
+		conn->proto.tcp->remote_ip[3] = 1;
+		conn->proto.tcp->remote_port = fd;
+	}
+
+	s = (HostSocket*) os_zalloc(sizeof(HostSocket));
+	s->conn = conn;
+	s->fd = fd;
+	s->listener = listener;
+	s->next = sockets;
+	sockets = s;
+	listener->clients++;
+	listener->active = s;
+
+	if (conn->proto.tcp->connect_callback != NULL) {
+		conn->proto.tcp->connect_callback(conn);
+	}
+	return conn;
+}
+
+
+struct espconn *
+host_espconn_attach(uint16_t port, int fd) {
+	HostSocket *listener = _find_listener(port);
+	if (listener == NULL) {
+		close(fd);
+		return NULL;
+	}
+	return _add_client(listener, fd);
+}
+
+
+sint8
+espconn_accept(struct espconn *conn) {
+	HostSocket *s;
+	struct sockaddr_in address;
+	int fd;
+	int one = 1;
+
+	if (_find(conn) != NULL) {
+		return ESPCONN_ISCONN;
+	}
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return ESPCONN_MEM;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	os_memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(_mapped_port(conn->proto.tcp->local_port));
+	if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+			listen(fd, 8) < 0) {
+		perror("espconn_accept");
+		close(fd);
+		return ESPCONN_IF;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	s = (HostSocket*) os_zalloc(sizeof(HostSocket));
+	s->conn = conn;
+	s->fd = fd;
+	s->listening = true;
+	s->max_clients = HOST_ESPCONN_MAX_CLIENTS;
+	s->next = sockets;
+	sockets = s;
+	conn->state = ESPCONN_LISTEN;
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_tcp_set_max_con_allow(struct espconn *conn, uint8 num) {
+	HostSocket *s = _find(conn);
+	if (s == NULL || !s->listening) {
+		return ESPCONN_ARG;
+	}
+	s->max_clients = num;
+	return ESPCONN_OK;
+}
+
+
+static void
+_write(HostSocket *s) {
+	ssize_t written;
+	while (s->out_written < s->out_length) {
+		written = send(s->fd, s->out + s->out_written, 
+				s->out_length - s->out_written, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				_close(s, false);
+			}
+			return;
+		}
+		s->out_written += written;
+	}
+	os_free(s->out);
+	s->out = NULL;
+	s->out_length = s->out_written = 0;
+	s->sent_pending = true;
+}
+
+
+sint8
+espconn_sent(struct espconn *conn, uint8 *data, uint16 length) {
+	HostSocket *s = _find(conn);
+	if (s != NULL && s->listening) {
+		// The SDK sends through the listener to the last active client.
+		s = s->active;
+	}
+	if (s == NULL || s->closing) {
+		return ESPCONN_ARG;
+	}
+	if (s->out != NULL || s->sent_pending) {
+		return ESPCONN_MAXNUM;
+	}
+	host_pace();
+	s->out = os_malloc(length ? length : 1);
+	os_memcpy(s->out, data, length);
+	s->out_length = length;
+	s->out_written = 0;
+	_write(s);
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_disconnect(struct espconn *conn) {
+	HostSocket *s = _find(conn);
+	if (s == NULL || s->listening) {
+		return ESPCONN_ARG;
+	}
+	_close(s, false);
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_abort(struct espconn *conn) {
+	HostSocket *s = _find(conn);
+	HostSocket *client;
+	if (s == NULL) {
+		return ESPCONN_ARG;
+	}
+	if (s->listening) {
+		for (client = sockets; client != NULL; client = client->next) {
+			if (client->listener == s) {
+				_close(client, true);
+			}
+		}
+		return ESPCONN_OK;
+	}
+	_close(s, true);
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_delete(struct espconn *conn) {
+	HostSocket *s = _find(conn);
+	if (s == NULL) {
+		return ESPCONN_ARG;
+	}
+	espconn_abort(conn);
+	_close(s, true);
+	conn->state = ESPCONN_CLOSE;
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_regist_connectcb(struct espconn *conn, espconn_connect_callback cb) {
+	conn->proto.tcp->connect_callback = cb;
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_regist_recvcb(struct espconn *conn, espconn_recv_callback cb) {
+	conn->recv_callback = cb;
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_regist_sentcb(struct espconn *conn, espconn_sent_callback cb) {
+	conn->sent_callback = cb;
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_regist_reconcb(struct espconn *conn, espconn_reconnect_callback cb) {
+	conn->proto.tcp->reconnect_callback = cb;
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_regist_disconcb(struct espconn *conn, espconn_connect_callback cb) {
+	conn->proto.tcp->disconnect_callback = cb;
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_recv_hold(struct espconn *conn) {
+	HostSocket *s = _find(conn);
+	if (s == NULL) {
+		return ESPCONN_ARG;
+	}
+	s->hold = true;
+	return ESPCONN_OK;
+}
+
+
+sint8
+espconn_recv_unhold(struct espconn *conn) {
+	HostSocket *s = _find(conn);
+	if (s == NULL) {
+		return ESPCONN_ARG;
+	}
+	s->hold = false;
+	return ESPCONN_OK;
+}
+
+
+// No multicast DNS on the host, clients connect to localhost directly.
+void
+espconn_mdns_init(struct mdns_info *info) {
+}
+
+
+void
+espconn_mdns_close(void) {
+}
+
+
+int
+host_espconn_poll_fds(struct pollfd *fds, int max) {
+	HostSocket *s;
+	int count = 0;
+
+	for (s = sockets; s != NULL && count < max; s = s->next) {
+		if (s->closing) {
+			continue;
+		}
+		fds[count].fd = s->fd;
+		fds[count].events = 0;
+		fds[count].revents = 0;
+		if (!s->hold) {
+			fds[count].events |= POLLIN;
+		}
+		if (s->out != NULL) {
+			fds[count].events |= POLLOUT;
+		}
+		count++;
+	}
+	return count;
+}
+
+
+bool
+host_espconn_pending() {
+	HostSocket *s;
+	for (s = sockets; s != NULL; s = s->next) {
+		if (s->sent_pending || s->closing) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static void
+_readable(HostSocket *s) {
+	char buffer[HOST_ESPCONN_MSS];
+	ssize_t length;
+	int fd;
+
+	if (s->listening) {
+		fd = accept(s->fd, NULL, NULL);
+		if (fd >= 0) {
+			_add_client(s, fd);
+		}
+		return;
+	}
+	length = recv(s->fd, buffer, sizeof(buffer), 0);
+	if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return;
+	}
+	if (length <= 0) {
+		_close(s, false);
+		return;
+	}
+	if (s->listener != NULL) {
+		s->listener->active = s;
+	}
+	if (s->conn->recv_callback != NULL) {
+		s->conn->recv_callback(s->conn, buffer, length);
+	}
+}
+
+
+// Run the deferred callbacks, then free the sockets that were closed.
+static void
+_deferred() {
+	HostSocket **link;
+	HostSocket *s;
+
+	for (s = sockets; s != NULL; s = s->next) {
+		if (s->sent_pending && !s->closing) {
+			s->sent_pending = false;
+			if (s->conn->sent_callback != NULL) {
+				s->conn->sent_callback(s->conn);
+			}
+		}
+	}
+
+	link = &sockets;
+	while (*link != NULL) {
+		s = *link;
+		if (!s->closing) {
+			link = &s->next;
+			continue;
+		}
+		*link = s->next;
+		close(s->fd);
+		if (!s->listening) {
+			if (!s->quiet && s->conn->proto.tcp->disconnect_callback != NULL) {
+				s->conn->proto.tcp->disconnect_callback(s->conn);
+			}
+			os_free(s->conn->proto.tcp);
+			os_free(s->conn);
+		}
+		os_free(s->out);
+		os_free(s);
+		// The callback may have closed others, start over.
+		link = &sockets;
+	}
+}
+
+
+void
+host_espconn_service(struct pollfd *fds, int count) {
+	HostSocket *s;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!fds[i].revents) {
+			continue;
+		}
+		s = _find_fd(fds[i].fd);
+		if (s == NULL || s->closing) {
+			continue;
+		}
+		if (fds[i].revents & POLLOUT) {
+			_write(s);
+		}
+		if (fds[i].revents & (POLLIN | POLLHUP | POLLERR) && !s->hold) {
+			_readable(s);
+		}
+	}
+	_deferred();
+}
@@ -0,0 +1,322 @@
+/* 
+ * Host shim: virtual clock, OS timers, tasks and the event loop.
+ *
+ * The clock is the real time since start plus all os_delay_us calls, so
+ * timers still fire while the loop waits on sockets, and ICSP delays
+ * advance it without costing wall time.  In real time mode the delays are
+ * slept off instead, a millisecond at a time and before any send, so the
+ * programmer answers as late as the hardware would.  Each loop iteration
+ * runs the posted tasks, then the due timers, then polls the sockets until
+ * the next timer is due.
+ */
+
+#include "host.h"
+
+#include <c_types.h>
+#include <os_type.h>
+#include <osapi.h>
+#include <user_interface.h>
+
+#include <poll.h>
+#include <time.h>
+
+
+#define HOST_MAX_FDS		32
+
+// Delays owed in real time mode are slept off once this large.
+#define HOST_PACE_NS		1000000
+
+
+static uint64_t start_ns;
+static uint64_t delay_ns;
+static bool realtime;
+// Delay not slept off yet, negative after oversleeping.
+static int64_t debt_ns;
+static bool stopped;
+
+static ETSTimer *timers;
+
+static struct {
+	os_task_t task;
+	os_event_t *queue;
+	uint8_t length;
+	uint8_t head;
+	uint8_t count;
+} tasks[USER_TASK_PRIO_MAX];
+
+
+static uint64_t
+_monotonic_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+uint64_t
+host_time_ns() {
+	if (!start_ns) {
+		start_ns = _monotonic_ns();
+	}
+	return _monotonic_ns() - start_ns + (realtime ? debt_ns : delay_ns);
+}
+
+
+void
+host_set_realtime(bool enabled) {
+	host_time_ns();
+	realtime = enabled;
+	debt_ns = 0;
+}
+
+
+void
+host_pace() {
+	struct timespec pause;
+	uint64_t start;
+
+	if (!realtime || debt_ns <= 0) {
+		return;
+	}
+	pause.tv_sec = debt_ns / 1000000000;
+	pause.tv_nsec = debt_ns % 1000000000;
+	start = _monotonic_ns();
+	nanosleep(&pause, NULL);
+	debt_ns -= _monotonic_ns() - start;
+}
+
+
+uint64_t
+host_delay_ns() {
+	return delay_ns;
+}
+
+
+void
+host_delay_us(uint32_t us) {
+	delay_ns += (uint64_t)us * 1000;
+	if (realtime) {
+		debt_ns += (uint64_t)us * 1000;
+		if (debt_ns >= HOST_PACE_NS) {
+			host_pace();
+		}
+	}
+}
+
+
+uint32_t
+host_ccount() {
+	return host_time_ns() * HOST_CPU_MHZ / 1000;
+}
+
+
+uint32
+system_get_time(void) {
+	return host_time_ns() / 1000;
+}
+
+
+uint8
+system_get_cpu_freq(void) {
+	return HOST_CPU_MHZ;
+}
+
+
+// Timers, kept in a list sorted by expiry.
+
+static void
+_unlink(ETSTimer *timer) {
+	ETSTimer **link;
+	for (link = &timers; *link != NULL; link = &(*link)->timer_next) {
+		if (*link == timer) {
+			*link = timer->timer_next;
+			break;
+		}
+	}
+	timer->timer_armed = false;
+}
+
+
+static void
+_insert(ETSTimer *timer) {
+	ETSTimer **link = &timers;
+	while (*link != NULL && (*link)->timer_expire <= timer->timer_expire) {
+		link = &(*link)->timer_next;
+	}
+	timer->timer_next = *link;
+	*link = timer;
+	timer->timer_armed = true;
+}
+
+
+void
+os_timer_setfn(os_timer_t *timer, os_timer_func_t *function, void *arg) {
+	if (timer->timer_armed) {
+		_unlink(timer);
+	}
+	timer->timer_func = function;
+	timer->timer_arg = arg;
+}
+
+
+void
+os_timer_arm(os_timer_t *timer, uint32_t milliseconds, bool repeat) {
+	if (timer->timer_armed) {
+		_unlink(timer);
+	}
+	timer->timer_period = repeat ? milliseconds : 0;
+	timer->timer_expire = host_time_ns() + (uint64_t)milliseconds * 1000000;
+	_insert(timer);
+}
+
+
+void
+os_timer_disarm(os_timer_t *timer) {
+	if (timer->timer_armed) {
+		_unlink(timer);
+	}
+}
+
+
+int64_t
+host_timers_next() {
+	uint64_t now;
+	if (timers == NULL) {
+		return -1;
+	}
+	now = host_time_ns();
+	return timers->timer_expire > now ? timers->timer_expire - now : 0;
+}
+
+
+void
+host_timers_run() {
+	uint64_t now = host_time_ns();
+	ETSTimer *timer;
+
+	while (timers != NULL && timers->timer_expire <= now) {
+		timer = timers;
+		_unlink(timer);
+		if (timer->timer_period) {
+			timer->timer_expire += (uint64_t)timer->timer_period * 1000000;
+			_insert(timer);
+		}
+		if (timer->timer_func != NULL) {
+			timer->timer_func(timer->timer_arg);
+		}
+	}
+}
+
+
+// Tasks, the highest priority runs first.
+
+bool
+system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen) {
+	if (prio >= USER_TASK_PRIO_MAX || qlen == 0) {
+		return false;
+	}
+	tasks[prio].task = task;
+	tasks[prio].queue = queue;
+	tasks[prio].length = qlen;
+	tasks[prio].head = 0;
+	tasks[prio].count = 0;
+	return true;
+}
+
+
+bool
+system_os_post(uint8 prio, ETSSignal sig, ETSParam par) {
+	os_event_t *event;
+	if (prio >= USER_TASK_PRIO_MAX || tasks[prio].task == NULL ||
+			tasks[prio].count == tasks[prio].length) {
+		return false;
+	}
+	event = &tasks[prio].queue[(tasks[prio].head + tasks[prio].count) % 
+		tasks[prio].length];
+	event->sig = sig;
+	event->par = par;
+	tasks[prio].count++;
+	return true;
+}
+
+
+// Run one posted event, returns false if none was pending.
+bool
+host_tasks_run() {
+	os_event_t event;
+	int prio;
+
+	for (prio = USER_TASK_PRIO_MAX - 1; prio >= 0; prio--) {
+		if (!tasks[prio].count) {
+			continue;
+		}
+		event = tasks[prio].queue[tasks[prio].head];
+		tasks[prio].head = (tasks[prio].head + 1) % tasks[prio].length;
+		tasks[prio].count--;
+		tasks[prio].task(&event);
+		return true;
+	}
+	return false;
+}
+
+
+static bool
+_tasks_pending() {
+	int prio;
+	for (prio = 0; prio < USER_TASK_PRIO_MAX; prio++) {
+		if (tasks[prio].count) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+bool
+host_loop_once(int timeout_ms) {
+	struct pollfd fds[HOST_MAX_FDS];
+	int64_t next;
+	int count;
+	int uart_count;
+	int wait = timeout_ms;
+
+	host_tasks_run();
+	host_timers_run();
+
+	host_pace();
+	count = host_espconn_poll_fds(fds, HOST_MAX_FDS);
+	uart_count = host_uart_poll_fds(fds + count, HOST_MAX_FDS - count);
+	count += uart_count;
+	if (_tasks_pending() || host_espconn_pending() || host_uart_pending()) {
+		wait = 0;
+	}
+	else {
+		next = host_timers_next();
+		if (next >= 0 && (wait < 0 || next / 1000000 < wait)) {
+			wait = next / 1000000;
+		}
+	}
+	if (!count && wait < 0) {
+		return false;
+	}
+	if (poll(fds, count, wait) > 0 || host_espconn_pending() ||
+			host_uart_pending()) {
+		host_espconn_service(fds, count - uart_count);
+		host_uart_service(fds + count - uart_count, uart_count);
+	}
+	return true;
+}
+
+
+void
+host_loop_run() {
+	stopped = false;
+	while (!stopped && host_loop_once(-1)) {
+	}
+}
+
+
+void
+host_loop_stop() {
+	stopped = true;
+}
@@ -0,0 +1,135 @@
+/* 
+ * Host build of the programmer: serves SP and webadmin on localhost.
+ *
+ *   wpp-host [-p sp_port] [-w webadmin_port] [-d device] [-c file.vcd] 
+ *            [-r] [-l] [-u]
+ *
+ * -d puts a blank device of devices[] in the socket, see pic_sim.h;
+ * without it DETECT finds nothing.  -c records the ICSP pins into a VCD
+ * file.  -r sleeps the ICSP delays off, so clients see the hardware's
+ * timing.  -l lists the devices with their memory layout.  -u serves SP
+ * on UART0 as well, on a pty whose path is printed.  Protocol,
+ * pools, log, stats and trace all behave as on the ESP8266.
+ */
+
+#include "host.h"
+#include "pic_sim.h"
+
+#include "sp.h"
+#include "sp_tcpserver.h"
+#include "pic_devices.h"
+#include "webadmin.h"
+#include "pool.h"
+#include "log.h"
+#include "stats.h"
+
+#include <driver/uart.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+// Keep webadmin off the privileged port.
+#define HOST_WEBADMIN_PORT	8080
+
+
+static void
+_stop(int signal) {
+	host_loop_stop();
+}
+
+
+// One line per device: name, ID, program words, then start and size of
+// the config and data memories.
+static void
+_list_devices() {
+	const struct deviceInfo *device;
+	for (device = devices; device->name != NULL; device++) {
+		printf("%s %d %u 0x%04X %u 0x%04X %u\n", device->name, 
+				device->deviceId, device->programSize, device->configStart,
+				device->configSize, device->dataStart, device->dataSize);
+	}
+}
+
+
+int
+main(int argc, char **argv) {
+	int sp_port = SP_TCPSERVER_PORT;
+	int webadmin_port = HOST_WEBADMIN_PORT;
+	const char *capture = NULL;
+	const char *pty = NULL;
+	int option;
+
+	while ((option = getopt(argc, argv, "p:w:d:c:rlu")) != -1) {
+		switch (option) {
+			case 'p':
+				sp_port = atoi(optarg);
+				break;
+
+			case 'w':
+				webadmin_port = atoi(optarg);
+				break;
+
+			case 'd':
+				if (!pic_sim_attach(optarg)) {
+					fprintf(stderr, "Unknown device: %s\n", optarg);
+					return 2;
+				}
+				break;
+
+			case 'c':
+				capture = optarg;
+				break;
+
+			case 'r':
+				host_set_realtime(true);
+				break;
+
+			case 'l':
+				_list_devices();
+				return 0;
+
+			case 'u':
+				pty = host_uart_open_pty(BIT_RATE_921600);
+				if (pty == NULL) {
+					return 1;
+				}
+				break;
+
+			default:
+				fprintf(stderr, "usage: %s [-p sp_port] [-w webadmin_port] "
+						"[-d device] [-c file.vcd] [-r] [-l] [-u]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (capture != NULL && !host_vcd_open(capture)) {
+		return 1;
+	}
+	host_espconn_map_port(SP_TCPSERVER_PORT, sp_port);
+	host_espconn_map_port(WA_HTTPSERVER_PORT, webadmin_port);
+	signal(SIGINT, _stop);
+	signal(SIGTERM, _stop);
+
+	// Same order as user_init(), the station is connected from the start.
+	log_initialize();
+	stats_initialize();
+	pool_initialize();
+	sp_initialize();
+	webadmin_initialize();
+	sp_start();
+	fprintf(stderr, "Serving SP on 127.0.0.1:%d, webadmin on 127.0.0.1:%d\n",
+			sp_port, webadmin_port);
+	if (pty != NULL) {
+		fprintf(stderr, "Serving SP on %s at %d baud\n", pty,
+				host_uart_baud());
+	}
+
+	host_loop_run();
+
+	sp_shutdown();
+	webadmin_shutdown();
+	host_vcd_close();
+	return 0;
+}
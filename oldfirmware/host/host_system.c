@@ -0,0 +1,170 @@
+/* 
+ * Host shim: system, WiFi, GPIO and register stubs.
+ *
+ * The station is always connected to 127.0.0.1, and the UART FIFO writes
+ * to stderr so the log drains as it would on the console.
+ */
+
+#include "host.h"
+
+#include <c_types.h>
+#include <osapi.h>
+#include <user_interface.h>
+#include <driver/uart_register.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+
+
+#define HOST_FREE_HEAP		40000
+
+
+static const HostPinModel *model;
+static uint8_t opmode = STATION_MODE;
+
+
+uint32
+system_get_free_heap_size(void) {
+	return HOST_FREE_HEAP;
+}
+
+
+void
+system_soft_wdt_feed(void) {
+}
+
+
+void
+system_restart(void) {
+	host_loop_stop();
+}
+
+
+void
+system_set_os_print(uint8 onoff) {
+}
+
+
+int
+ets_vsnprintf(char *str, size_t size, const char *format, va_list arg) {
+	return vsnprintf(str, size, format, arg);
+}
+
+
+bool
+wifi_set_opmode_current(uint8 mode) {
+	opmode = mode;
+	return true;
+}
+
+
+uint8
+wifi_get_opmode(void) {
+	return opmode;
+}
+
+
+uint8
+wifi_softap_get_station_num(void) {
+	return 0;
+}
+
+
+bool
+wifi_set_broadcast_if(uint8 interface) {
+	return true;
+}
+
+
+uint8
+wifi_station_get_connect_status(void) {
+	return STATION_GOT_IP;
+}
+
+
+bool
+wifi_station_connect(void) {
+	return true;
+}
+
+
+bool
+wifi_station_get_config(struct station_config *config) {
+	os_memset(config, 0, sizeof(*config));
+	os_strcpy((char*)config->ssid, "host");
+	return true;
+}
+
+
+bool
+wifi_station_set_config(struct station_config *config) {
+	return true;
+}
+
+
+sint8
+wifi_station_get_rssi(void) {
+	return -50;
+}
+
+
+bool
+wifi_get_ip_info(uint8 if_index, struct ip_info *info) {
+	IP4_ADDR(&info->ip, 127, 0, 0, 1);
+	IP4_ADDR(&info->netmask, 255, 0, 0, 0);
+	IP4_ADDR(&info->gw, 127, 0, 0, 1);
+	return true;
+}
+
+
+void
+host_gpio_set_model(const HostPinModel *pins) {
+	model = pins;
+}
+
+
+void
+host_gpio_set(uint8_t pin, uint8_t level) {
+	host_vcd_pin(pin, level ? '1' : '0');
+	if (model != NULL && model->set != NULL) {
+		model->set(pin, level);
+	}
+}
+
+
+uint8_t
+host_gpio_get(uint8_t pin) {
+	uint8_t level = 1;
+	if (model != NULL && model->get != NULL) {
+		level = model->get(pin);
+	}
+	host_vcd_pin(pin, level ? '1' : '0');
+	return level;
+}
+
+
+void
+host_gpio_input(uint8_t pin) {
+	host_vcd_pin(pin, 'z');
+	if (model != NULL && model->input != NULL) {
+		model->input(pin);
+	}
+}
+
+
+// Only UART0 is modelled, other registers read zero.
+uint32_t
+host_read_reg(uint32_t addr) {
+	if (addr >= REG_UART_BASE(UART0) && addr < REG_UART_BASE(UART1)) {
+		return host_uart_read_reg(addr);
+	}
+	return 0;
+}
+
+
+void
+host_write_reg(uint32_t addr, uint32_t value) {
+	if (addr >= REG_UART_BASE(UART0) && addr < REG_UART_BASE(UART1)) {
+		host_uart_write_reg(addr, value);
+	}
+}
@@ -0,0 +1,253 @@
+/*
+ * Host shim: UART0 registers, on stderr or a pseudo terminal.
+ *
+ * Until a pty is open and a handler attached, bytes written to the FIFO
+ * go to stderr, which is where the log ends up.  Then the pty's master
+ * side plays the wire: the RX FIFO is filled from it, at most 128 bytes
+ * and only while there is room, which holds the client off like RTS does,
+ * and the TX FIFO is flushed to it once full or when the loop comes round.
+ * Interrupts are levels computed from the FIFOs; the loop calls the
+ * attached handler while an enabled one is raised.
+ */
+
+// posix_openpt() and cfmakeraw()
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include "host.h"
+
+#include <c_types.h>
+#include <ets_sys.h>
+#include <driver/uart_register.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+#define HOST_UART_FIFO_SIZE		128
+
+
+static int master = -1;
+static int slave = -1;
+static uint32_t baud;
+
+static unsigned char rx_fifo[HOST_UART_FIFO_SIZE];
+static uint8_t rx_head;
+static uint8_t rx_count;
+
+static unsigned char tx_fifo[HOST_UART_FIFO_SIZE];
+static uint8_t tx_count;
+
+static uint32_t int_ena;
+static uint32_t clkdiv;
+static uint32_t conf0;
+static uint32_t conf1;
+
+static void (*handler)(void*);
+static void *handler_arg;
+static bool intr_enabled;
+
+
+static void
+_flush() {
+	uint8_t written = 0;
+	ssize_t n;
+
+	while (written < tx_count) {
+		n = write(master, tx_fifo + written, tx_count - written);
+		if (n <= 0) {
+			break;
+		}
+		written += n;
+	}
+	tx_count = 0;
+}
+
+
+// Input arrives in bursts, so the line counts as idle as soon as the
+// FIFO holds anything and the time-out interrupt is on.
+static uint32_t
+_raw() {
+	uint32_t raw = 0;
+	uint8_t full = (conf1 >> UART_RXFIFO_FULL_THRHD_S) &
+		UART_RXFIFO_FULL_THRHD;
+	uint8_t empty = (conf1 >> UART_TXFIFO_EMPTY_THRHD_S) &
+		UART_TXFIFO_EMPTY_THRHD;
+
+	if (rx_count && rx_count >= full) {
+		raw |= UART_RXFIFO_FULL_INT_ST;
+	}
+	if (rx_count && (conf1 & UART_RX_TOUT_EN)) {
+		raw |= UART_RXFIFO_TOUT_INT_ST;
+	}
+	if (tx_count < empty || !tx_count) {
+		raw |= UART_TXFIFO_EMPTY_INT_ST;
+	}
+	return raw;
+}
+
+
+const char *
+host_uart_open_pty(uint32_t baud_rate) {
+	struct termios tio;
+	const char *path;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) || unlockpt(master) ||
+			(path = ptsname(master)) == NULL) {
+		perror("pty");
+		return NULL;
+	}
+	// Kept open, so the master does not hang up between clients, and raw,
+	// so nothing is echoed before a client sets the line up.
+	slave = open(path, O_RDWR | O_NOCTTY);
+	if (slave < 0 || tcgetattr(slave, &tio)) {
+		perror(path);
+		return NULL;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+	baud = baud_rate;
+	return path;
+}
+
+
+uint32_t
+host_uart_baud() {
+	return baud;
+}
+
+
+void
+host_uart_attach(void (*function)(void*), void *arg) {
+	handler = function;
+	handler_arg = arg;
+}
+
+
+void
+host_uart_intr(bool enabled) {
+	intr_enabled = enabled;
+}
+
+
+bool
+host_uart_pending() {
+	return handler != NULL && intr_enabled && (_raw() & int_ena);
+}
+
+
+int
+host_uart_poll_fds(struct pollfd *fds, int max) {
+	if (master < 0) {
+		return 0;
+	}
+	_flush();
+	if (rx_count == HOST_UART_FIFO_SIZE || max < 1) {
+		return 0;
+	}
+	fds[0].fd = master;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	return 1;
+}
+
+
+void
+host_uart_service(struct pollfd *fds, int count) {
+	unsigned char buffer[HOST_UART_FIFO_SIZE];
+	ssize_t n;
+	int i;
+
+	if (count && (fds[0].revents & POLLIN)) {
+		n = read(master, buffer, HOST_UART_FIFO_SIZE - rx_count);
+		for (i = 0; i < n; i++) {
+			rx_fifo[(rx_head + rx_count++) % HOST_UART_FIFO_SIZE] = buffer[i];
+		}
+	}
+	if (host_uart_pending()) {
+		handler(handler_arg);
+	}
+}
+
+
+uint32_t
+host_uart_read_reg(uint32_t addr) {
+	uint8_t byte;
+
+	switch (addr - REG_UART_BASE(UART0)) {
+		case 0x0:
+			if (!rx_count) {
+				return 0;
+			}
+			byte = rx_fifo[rx_head];
+			rx_head = (rx_head + 1) % HOST_UART_FIFO_SIZE;
+			rx_count--;
+			return byte;
+
+		case 0x4:
+			return _raw();
+
+		case 0x8:
+			return _raw() & int_ena;
+
+		case 0xC:
+			return int_ena;
+
+		case 0x14:
+			return clkdiv;
+
+		case 0x1C:
+			return (rx_count << UART_RXFIFO_CNT_S) |
+				(tx_count << UART_TXFIFO_CNT_S);
+
+		case 0x20:
+			return conf0;
+
+		case 0x24:
+			return conf1;
+	}
+	return 0;
+}
+
+
+void
+host_uart_write_reg(uint32_t addr, uint32_t value) {
+	switch (addr - REG_UART_BASE(UART0)) {
+		case 0x0:
+			if (master < 0 || handler == NULL) {
+				fputc(value & 0xff, stderr);
+				break;
+			}
+			tx_fifo[tx_count++] = value & 0xff;
+			if (tx_count == HOST_UART_FIFO_SIZE) {
+				_flush();
+			}
+			break;
+
+		case 0xC:
+			int_ena = value;
+			break;
+
+		case 0x14:
+			clkdiv = value;
+			break;
+
+		case 0x20:
+			if (value & UART_RXFIFO_RST) {
+				rx_count = 0;
+			}
+			if (value & UART_TXFIFO_RST) {
+				tx_count = 0;
+			}
+			conf0 = value;
+			break;
+
+		case 0x24:
+			conf1 = value;
+			break;
+	}
+}
@@ -0,0 +1,101 @@
+/* 
+ * Host shim: capture of the ICSP pins into a VCD file, for GTKWave or
+ * `wifipicprog vcd`.
+ *
+ * Timestamps are the virtual delay time, so a capture only shows the
+ * os_delay_us waits; the GPIO writes themselves take no time.  DATA reads
+ * z once released, and then the level the target drove when sampled.
+ */
+
+#include "host.h"
+
+#include "pic_io.h"
+
+#include <stdio.h>
+#include <time.h>
+
+
+#define HOST_VCD_PINS		4
+
+
+static FILE *vcd;
+static uint64_t last_time;
+
+static const struct {
+	uint8_t pin;
+	const char *name;
+	char id;
+} pins[HOST_VCD_PINS] = {
+	{CLOCK_NUM, "clock", '!'},
+	{DATA_NUM, "data", '"'},
+	// The pin level; VPP is applied while it is low.
+	{MCLR_NUM, "mclr", '#'},
+	{VDD_NUM, "vdd", '$'},
+};
+
+static char levels[HOST_VCD_PINS];
+
+
+bool
+host_vcd_open(const char *path) {
+	time_t now = time(NULL);
+	int i;
+
+	host_vcd_close();
+	vcd = fopen(path, "w");
+	if (vcd == NULL) {
+		perror(path);
+		return false;
+	}
+	fprintf(vcd, "$date %s$end\n", ctime(&now));
+	fprintf(vcd, "$version wifi-pic-programmer host build $end\n");
+	fprintf(vcd, "$timescale 1ns $end\n");
+	fprintf(vcd, "$scope module icsp $end\n");
+	for (i = 0; i < HOST_VCD_PINS; i++) {
+		fprintf(vcd, "$var wire 1 %c %s $end\n", pins[i].id, pins[i].name);
+	}
+	fprintf(vcd, "$upscope $end\n$enddefinitions $end\n");
+	last_time = host_delay_ns();
+	fprintf(vcd, "#%llu\n$dumpvars\n", (unsigned long long)last_time);
+	for (i = 0; i < HOST_VCD_PINS; i++) {
+		levels[i] = 'x';
+		fprintf(vcd, "x%c\n", pins[i].id);
+	}
+	fprintf(vcd, "$end\n");
+	return true;
+}
+
+
+void
+host_vcd_close() {
+	if (vcd == NULL) {
+		return;
+	}
+	fprintf(vcd, "#%llu\n", (unsigned long long)host_delay_ns());
+	fclose(vcd);
+	vcd = NULL;
+}
+
+
+// Record a pin at the current time: '0', '1' or 'z'.
+void
+host_vcd_pin(uint8_t pin, char level) {
+	uint64_t now;
+	int i;
+
+	if (vcd == NULL) {
+		return;
+	}
+	for (i = 0; i < HOST_VCD_PINS && pins[i].pin != pin; i++) {
+	}
+	if (i == HOST_VCD_PINS || levels[i] == level) {
+		return;
+	}
+	levels[i] = level;
+	now = host_delay_ns();
+	if (now != last_time) {
+		fprintf(vcd, "#%llu\n", (unsigned long long)now);
+		last_time = now;
+	}
+	fprintf(vcd, "%c%c\n", level, pins[i].id);
+}
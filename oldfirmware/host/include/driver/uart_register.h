@@ -0,0 +1,50 @@
+/* Host shim: UART registers, see host_uart.c */
+
+#ifndef _UART_REGISTER_H_
+#define _UART_REGISTER_H_
+
+#include "eagle_soc.h"
+
+#define UART0				0
+#define UART1				1
+
+#define REG_UART_BASE(i)	(0x60000000 + (i) * 0xf00)
+#define UART_FIFO(i)		(REG_UART_BASE(i) + 0x0)
+#define UART_INT_RAW(i)		(REG_UART_BASE(i) + 0x4)
+#define UART_INT_ST(i)		(REG_UART_BASE(i) + 0x8)
+#define UART_INT_ENA(i)		(REG_UART_BASE(i) + 0xC)
+#define UART_INT_CLR(i)		(REG_UART_BASE(i) + 0x10)
+#define UART_CLKDIV(i)		(REG_UART_BASE(i) + 0x14)
+#define UART_STATUS(i)		(REG_UART_BASE(i) + 0x1C)
+#define UART_CONF0(i)		(REG_UART_BASE(i) + 0x20)
+#define UART_CONF1(i)		(REG_UART_BASE(i) + 0x24)
+
+#define UART_RXFIFO_CNT		0x000000FF
+#define UART_RXFIFO_CNT_S	0
+#define UART_TXFIFO_CNT		0x000000FF
+#define UART_TXFIFO_CNT_S	16
+
+#define UART_CLKDIV_CNT		0x000FFFFF
+
+#define UART_RXFIFO_FULL_INT_ENA	BIT0
+#define UART_RXFIFO_FULL_INT_ST		BIT0
+#define UART_TXFIFO_EMPTY_INT_ENA	BIT1
+#define UART_TXFIFO_EMPTY_INT_ST	BIT1
+#define UART_RXFIFO_TOUT_INT_ENA	BIT8
+#define UART_RXFIFO_TOUT_INT_ST		BIT8
+
+#define UART_RXFIFO_RST		BIT17
+#define UART_TXFIFO_RST		BIT18
+
+#define UART_RX_TOUT_EN				BIT31
+#define UART_RX_TOUT_THRHD			0x0000007F
+#define UART_RX_TOUT_THRHD_S		24
+#define UART_RX_FLOW_EN				BIT23
+#define UART_RX_FLOW_THRHD			0x0000007F
+#define UART_RX_FLOW_THRHD_S		16
+#define UART_TXFIFO_EMPTY_THRHD		0x0000007F
+#define UART_TXFIFO_EMPTY_THRHD_S	8
+#define UART_RXFIFO_FULL_THRHD		0x0000007F
+#define UART_RXFIFO_FULL_THRHD_S	0
+
+#endif
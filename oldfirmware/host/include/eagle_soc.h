@@ -0,0 +1,47 @@
+/* Host shim: pin muxing and peripheral registers */
+
+#ifndef _EAGLE_SOC_H_
+#define _EAGLE_SOC_H_
+
+#include "c_types.h"
+
+#define BIT31		0x80000000
+#define BIT23		0x00800000
+#define BIT18		0x00040000
+#define BIT17		0x00020000
+#define BIT8		0x00000100
+#define BIT1		0x00000002
+#define BIT0		0x00000001
+
+#define PERIPHS_IO_MUX_GPIO0_U	0
+#define PERIPHS_IO_MUX_GPIO4_U	4
+#define PERIPHS_IO_MUX_GPIO5_U	5
+#define PERIPHS_IO_MUX_MTCK_U	13
+#define PERIPHS_IO_MUX_MTMS_U	14
+#define PERIPHS_IO_MUX_MTDO_U	15
+
+#define FUNC_GPIO0			0
+#define FUNC_GPIO4			0
+#define FUNC_GPIO5			0
+#define FUNC_GPIO13			3
+#define FUNC_GPIO14			3
+#define FUNC_U0RTS			4
+
+#define APB_CLK_FREQ		80000000
+
+// Pins are always GPIO on the host.
+#define PIN_FUNC_SELECT(mux, func)	do {} while (0)
+#define PIN_PULLUP_EN(mux)			do {} while (0)
+#define PIN_PULLUP_DIS(mux)			do {} while (0)
+
+uint32_t host_read_reg(uint32_t addr);
+void host_write_reg(uint32_t addr, uint32_t value);
+
+#define READ_PERI_REG(addr)			host_read_reg(addr)
+#define WRITE_PERI_REG(addr, val)	host_write_reg(addr, val)
+#define SET_PERI_REG_MASK(addr, mask) \
+	WRITE_PERI_REG(addr, READ_PERI_REG(addr) | (mask))
+#define CLEAR_PERI_REG_MASK(addr, mask) \
+	WRITE_PERI_REG(addr, READ_PERI_REG(addr) & ~(mask))
+
+#endif
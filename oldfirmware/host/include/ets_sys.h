@@ -0,0 +1,19 @@
+/* Host shim: system definitions */
+
+#ifndef _ETS_SYS_H_
+#define _ETS_SYS_H_
+
+#include "c_types.h"
+#include "os_type.h"
+#include "eagle_soc.h"
+
+// The UART interrupt is raised by the loop, see host_uart.c.
+void host_uart_attach(void (*handler)(void*), void *arg);
+void host_uart_intr(bool enabled);
+
+#define ETS_UART_INTR_ATTACH(func, arg) \
+	host_uart_attach((void (*)(void*))(func), (void*)(arg))
+#define ETS_UART_INTR_ENABLE()		host_uart_intr(true)
+#define ETS_UART_INTR_DISABLE()		host_uart_intr(false)
+
+#endif
@@ -0,0 +1,14 @@
+/* Host shim: GPIO, forwarded to the pin model */
+
+#ifndef _GPIO_H_
+#define _GPIO_H_
+
+#include "c_types.h"
+#include "host.h"
+
+#define GPIO_ID_PIN(n)				(n)
+#define GPIO_OUTPUT_SET(pin, level)	host_gpio_set(pin, level)
+#define GPIO_INPUT_GET(pin)			host_gpio_get(pin)
+#define GPIO_DIS_OUTPUT(pin)		host_gpio_input(pin)
+
+#endif
@@ -0,0 +1,100 @@
+/* 
+ * Host build of the programmer.
+ *
+ * A thin shim stands in for the NONOS SDK, so the firmware sources run
+ * unmodified on a workstation: espconn maps to POSIX sockets, OS timers
+ * and tasks to an event loop, os_delay_us to a virtual clock, and the
+ * GPIO macros to a pluggable pin model.
+ */
+
+#ifndef _HOST_H__
+#define _HOST_H__
+
+#include <c_types.h>
+#include <poll.h>
+
+
+// Clock: real time since start plus every os_delay_us, in nanoseconds.
+// The delays cost no wall time, so the ICSP timing shows up on the clock
+// without slowing the host down.
+uint64_t host_time_ns();
+
+// Nanoseconds spent in os_delay_us alone.
+uint64_t host_delay_ns();
+
+void host_delay_us(uint32_t us);
+
+// Sleep os_delay_us off in real time, for a programmer that answers with
+// the hardware's timing; host_pace() catches up on what is still owed.
+void host_set_realtime(bool enabled);
+void host_pace();
+
+// Simulated CPU clock, the cycle counter follows the clock.
+#define HOST_CPU_MHZ		80
+
+uint32_t host_ccount();
+
+
+// Target attached to the ICSP pins.  Levels are 0 or 1; get() is only
+// called on a pin that was released with input().
+typedef struct {
+	void (*set)(uint8_t pin, uint8_t level);
+	uint8_t (*get)(uint8_t pin);
+	void (*input)(uint8_t pin);
+} HostPinModel;
+
+// Without a model, driven pins are ignored and released ones read high.
+void host_gpio_set_model(const HostPinModel *model);
+
+void host_gpio_set(uint8_t pin, uint8_t level);
+uint8_t host_gpio_get(uint8_t pin);
+void host_gpio_input(uint8_t pin);
+
+
+// Record CLOCK, DATA, MCLR and VDD into a VCD file, in virtual time.
+bool host_vcd_open(const char *path);
+void host_vcd_close();
+void host_vcd_pin(uint8_t pin, char level);
+
+
+// Event loop: runs posted tasks, due timers and socket callbacks.
+// Returns false once nothing is left to wait for.
+bool host_loop_once(int timeout_ms);
+void host_loop_run();
+void host_loop_stop();
+
+// Nanoseconds until the next timer is due, -1 without armed timers.
+int64_t host_timers_next();
+void host_timers_run();
+bool host_tasks_run();
+
+
+// Serve an espconn listening on port `from` on `to` instead, e.g. to
+// keep webadmin off the privileged port 80.
+void host_espconn_map_port(uint16_t from, uint16_t to);
+
+// Hand a connected socket to the listener on a port, as if accepted.
+struct espconn * host_espconn_attach(uint16_t port, int fd);
+
+// Add the sockets to a poll set, then service them once polled; used by
+// the loop.  Deferred callbacks make the loop poll without waiting.
+int host_espconn_poll_fds(struct pollfd *fds, int max);
+void host_espconn_service(struct pollfd *fds, int count);
+bool host_espconn_pending();
+
+
+
+// UART0 on a pseudo terminal, for SP over serial.  The baud rate is that
+// of sp_uart.h, 0 until a pty is open; returns the slave's path.
+const char * host_uart_open_pty(uint32_t baud);
+uint32_t host_uart_baud();
+
+// Like the espconn hooks, the pending interrupt makes the loop not wait.
+int host_uart_poll_fds(struct pollfd *fds, int max);
+void host_uart_service(struct pollfd *fds, int count);
+bool host_uart_pending();
+
+uint32_t host_uart_read_reg(uint32_t addr);
+void host_uart_write_reg(uint32_t addr, uint32_t value);
+
+#endif
@@ -0,0 +1,22 @@
+/* Host shim: IP addresses */
+
+#ifndef _IP_ADDR_H_
+#define _IP_ADDR_H_
+
+#include "c_types.h"
+
+typedef struct ip_addr {
+	uint32_t addr;
+} ip_addr_t;
+
+#define IP4_ADDR(ipaddr, a, b, c, d) \
+	(ipaddr)->addr = ((uint32_t)((d) & 0xff) << 24) | \
+		((uint32_t)((c) & 0xff) << 16) | \
+		((uint32_t)((b) & 0xff) << 8) | \
+		(uint32_t)((a) & 0xff)
+
+#define IP2STR(ipaddr) ((uint8_t *)(ipaddr))[0], ((uint8_t *)(ipaddr))[1], \
+	((uint8_t *)(ipaddr))[2], ((uint8_t *)(ipaddr))[3]
+#define IPSTR "%d.%d.%d.%d"
+
+#endif
@@ -0,0 +1,14 @@
+/* Host shim: heap */
+
+#ifndef _MEM_H_
+#define _MEM_H_
+
+#include <stdlib.h>
+
+#define os_malloc			malloc
+#define os_zalloc(size)		calloc(1, (size))
+#define os_calloc			calloc
+#define os_realloc			realloc
+#define os_free				free
+
+#endif
@@ -0,0 +1,33 @@
+/* Host shim: OS types */
+
+#ifndef _OS_TYPE_H_
+#define _OS_TYPE_H_
+
+#include "c_types.h"
+
+
+typedef void os_timer_func_t(void *timer_arg);
+
+typedef struct _ETSTIMER_ {
+	struct _ETSTIMER_ *timer_next;
+	uint64_t timer_expire;
+	uint32_t timer_period;
+	os_timer_func_t *timer_func;
+	void *timer_arg;
+	bool timer_armed;
+} ETSTimer;
+
+typedef ETSTimer os_timer_t;
+
+typedef uint32_t ETSSignal;
+typedef uint32_t ETSParam;
+
+typedef struct ETSEventTag {
+	ETSSignal sig;
+	ETSParam par;
+} ETSEvent;
+
+typedef ETSEvent os_event_t;
+typedef void (*os_task_t)(os_event_t *e);
+
+#endif
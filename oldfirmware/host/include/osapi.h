@@ -0,0 +1,36 @@
+/* Host shim: OS API */
+
+#ifndef _OSAPI_H_
+#define _OSAPI_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include "c_types.h"
+#include "os_type.h"
+#include "host.h"
+
+#define os_printf			printf
+#define os_sprintf			sprintf
+#define os_snprintf			snprintf
+#define os_memcmp			memcmp
+#define os_memcpy			memcpy
+#define os_memmove			memmove
+#define os_memset			memset
+#define os_strcat			strcat
+#define os_strchr			strchr
+#define os_strcmp			strcmp
+#define os_strcpy			strcpy
+#define os_strlen			strlen
+#define os_strncmp			strncmp
+#define os_strncpy			strncpy
+#define os_strstr			strstr
+
+#define os_delay_us			host_delay_us
+
+void os_timer_arm(os_timer_t *ptimer, uint32_t milliseconds, bool repeat_flag);
+void os_timer_disarm(os_timer_t *ptimer);
+void os_timer_setfn(os_timer_t *ptimer, os_timer_func_t *pfunction,
+		void *parg);
+
+#endif
@@ -0,0 +1,107 @@
+/* 
+ * Behavioural model of a mid-range PIC's ICSP interface, for the host
+ * build.
+ *
+ * Installed as the pin model, it decodes the 6-bit commands of pic_io.h
+ * from the CLOCK and DATA edges, keeps the PC, program, config and data
+ * memories and their write latches, and checks every edge against the
+ * datasheet minimums in virtual time (host_delay_ns(), so runs are
+ * repeatable).  Devices come from the devices[] table.
+ */
+
+#ifndef _PIC_SIM_H__
+#define _PIC_SIM_H__
+
+#include <c_types.h>
+#include <stdio.h>
+
+
+// Bit timing minimums, in nanoseconds.
+#define PIC_SIM_TSET1		100		// DATA setup before CLOCK falls
+#define PIC_SIM_THLD1		100		// DATA hold after CLOCK falls
+#define PIC_SIM_TDLY2		1000	// Between a command and its data
+#define PIC_SIM_TDLY3		80		// CLOCK rise to DATA out valid
+#define PIC_SIM_TPPDP		5000	// VPP before VDD
+#define PIC_SIM_THLD0		5000	// VDD before the first CLOCK
+
+// Program cycle minimums, in microseconds.  Kept apart from the delays of
+// pic_io.h, so shortening one of those shows up as a violation.
+#define PIC_SIM_TPROG_FLASH		10000	// Erase and program, PIC16F84/627/628
+#define PIC_SIM_TPROG_FLASH4	4000
+#define PIC_SIM_TPROG_FLASH5	1000	// Program only, PIC16F87/88
+#define PIC_SIM_TDPROG			6000	// Data EEPROM
+#define PIC_SIM_TERA			6000	// Bulk erase
+
+
+// Where the virtual time went.
+typedef enum {
+	PIC_SIM_OFF,			// Not in programming mode
+	PIC_SIM_GAP,			// In programming mode, between shifts
+	PIC_SIM_COMMAND,		// Shifting a command in
+	PIC_SIM_LOAD,			// Shifting a data word in
+	PIC_SIM_READ,			// Shifting a data word out
+	PIC_SIM_PROGRAM,		// Waiting for a program cycle
+	PIC_SIM_ERASE,			// Waiting for a bulk erase
+	PIC_SIM_PHASES
+} PicSimPhase;
+
+
+// Constraints checked on every edge.
+typedef enum {
+	PIC_SIM_CHECK_TSET1,
+	PIC_SIM_CHECK_THLD1,
+	PIC_SIM_CHECK_TDLY2,
+	PIC_SIM_CHECK_TDLY3,
+	PIC_SIM_CHECK_TPPDP,
+	PIC_SIM_CHECK_THLD0,
+	PIC_SIM_CHECK_TPROG,	// Program and config memory cycles
+	PIC_SIM_CHECK_TDPROG,	// Data memory cycles
+	PIC_SIM_CHECK_TERA,		// Bulk erase
+	PIC_SIM_CHECK_DRIVE,	// DATA floating when latched, or contended
+	PIC_SIM_CHECK_COMMAND,	// Unknown command
+	PIC_SIM_CHECKS
+} PicSimCheck;
+
+
+typedef struct {
+	uint64_t phase_ns[PIC_SIM_PHASES];
+	uint32_t violations[PIC_SIM_CHECKS];
+	// Shortest time seen, UINT64_MAX when the check never ran.
+	uint64_t min_ns[PIC_SIM_CHECKS];
+	uint32_t sessions;
+	uint32_t commands;
+	uint32_t words_read;
+	uint32_t words_loaded;
+	uint32_t program_cycles;
+	uint32_t erases;
+} PicSimStats;
+
+
+// Insert a blank device from devices[] into the socket and install the
+// model, returns false if there is no such device.
+bool pic_sim_attach(const char *name);
+
+void pic_sim_detach();
+
+// Devices the model can stand in for, in the order of devices[].
+uint8_t pic_sim_devices();
+const char *pic_sim_device_name(uint8_t index);
+
+// Memory at a flat address, as the firmware addresses it.
+uint16_t pic_sim_peek(uint32_t addr);
+void pic_sim_poke(uint32_t addr, uint16_t word);
+
+// Start counting from now, the memories are left alone.
+void pic_sim_reset_stats();
+
+// Minimum time a check requires for the attached device.
+uint64_t pic_sim_required_ns(PicSimCheck check);
+
+const PicSimStats *pic_sim_stats();
+const char *pic_sim_phase_name(PicSimPhase phase);
+const char *pic_sim_check_name(PicSimCheck check);
+
+// Total virtual time, per-phase breakdown and the timing checks.
+void pic_sim_report(FILE *out);
+
+#endif
@@ -0,0 +1,70 @@
+/* Host shim: system and WiFi interface */
+
+#ifndef _USER_INTERFACE_H_
+#define _USER_INTERFACE_H_
+
+#include "c_types.h"
+#include "os_type.h"
+#include "ip_addr.h"
+#include "osapi.h"
+
+
+#define USER_TASK_PRIO_0	0
+#define USER_TASK_PRIO_1	1
+#define USER_TASK_PRIO_2	2
+#define USER_TASK_PRIO_MAX	3
+
+#define STATION_IF			0x00
+#define SOFTAP_IF			0x01
+
+#define NULL_MODE			0x00
+#define STATION_MODE		0x01
+#define SOFTAP_MODE			0x02
+#define STATIONAP_MODE		0x03
+
+enum {
+	STATION_IDLE = 0,
+	STATION_CONNECTING,
+	STATION_WRONG_PASSWORD,
+	STATION_NO_AP_FOUND,
+	STATION_CONNECT_FAIL,
+	STATION_GOT_IP
+};
+
+struct ip_info {
+	struct ip_addr ip;
+	struct ip_addr netmask;
+	struct ip_addr gw;
+};
+
+struct station_config {
+	uint8 ssid[32];
+	uint8 password[64];
+	uint8 bssid_set;
+	uint8 bssid[6];
+};
+
+
+bool system_os_task(os_task_t task, uint8 prio, os_event_t *queue, 
+		uint8 qlen);
+bool system_os_post(uint8 prio, ETSSignal sig, ETSParam par);
+
+uint32 system_get_time(void);
+uint32 system_get_free_heap_size(void);
+uint8 system_get_cpu_freq(void);
+void system_soft_wdt_feed(void);
+void system_restart(void);
+void system_set_os_print(uint8 onoff);
+
+bool wifi_set_opmode_current(uint8 opmode);
+uint8 wifi_get_opmode(void);
+uint8 wifi_softap_get_station_num(void);
+bool wifi_set_broadcast_if(uint8 interface);
+uint8 wifi_station_get_connect_status(void);
+bool wifi_station_connect(void);
+bool wifi_station_get_config(struct station_config *config);
+bool wifi_station_set_config(struct station_config *config);
+sint8 wifi_station_get_rssi(void);
+bool wifi_get_ip_info(uint8 if_index, struct ip_info *info);
+
+#endif
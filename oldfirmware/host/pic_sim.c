@@ -0,0 +1,645 @@
+/* 
+ * Behavioural PIC ICSP model, see pic_sim.h.
+ *
+ * The target latches DATA on falling CLOCK edges, LSB first: a 6-bit
+ * command, then for loads and reads a 16-bit word framed by a start and
+ * a stop bit.  Read words are driven out on the rising edges.  A program
+ * cycle or bulk erase runs until the next CLOCK edge, which must not come
+ * before the cycle's minimum time.
+ */
+
+#include "pic_sim.h"
+#include "host.h"
+
+#include "pic_io.h"
+#include "pic_devices.h"
+
+#include <mem.h>
+#include <stdint.h>
+
+
+// Reported in full, the rest are only counted.
+#define PIC_SIM_LOGGED_VIOLATIONS	8
+
+#define PIC_SIM_CONFIG_WORDS	32
+#define PIC_SIM_PC_MASK			0x1FFF
+
+
+typedef enum {
+	SHIFT_COMMAND,
+	SHIFT_LOAD,
+	SHIFT_READ,
+} Shift;
+
+typedef enum {
+	LATCH_PROGRAM,
+	LATCH_CONFIG,
+	LATCH_DATA,
+} Latch;
+
+
+static const HostPinModel model;
+
+static struct {
+	const struct deviceInfo *device;
+	uint16_t *program;
+	uint16_t config[PIC_SIM_CONFIG_WORDS];
+	uint8_t *data;
+
+	// Pins as the programmer drives them.
+	bool vpp;
+	bool vdd;
+	bool clock;
+	bool data_level;
+	bool data_driven;
+	uint64_t vpp_at;
+	uint64_t powered_at;
+	uint64_t data_at;
+	uint64_t rise_at;
+	uint64_t fall_at;
+	bool hold_pending;
+	bool clocked;
+
+	// ICSP state.
+	bool powered;
+	bool config_space;
+	uint16_t pc;
+	Shift shift;
+	uint8_t count;
+	uint16_t value;
+	uint64_t shift_end;
+	bool out_bit;
+	Latch load;
+	uint16_t program_latch;
+	uint8_t data_latch;
+
+	// Program cycle or erase running until the next edge.
+	PicSimPhase cycle;
+	PicSimCheck cycle_check;
+	uint64_t cycle_at;
+
+	PicSimPhase phase;
+	uint64_t accounted;
+	uint64_t required[PIC_SIM_CHECKS];
+	uint32_t logged;
+	PicSimStats stats;
+} sim;
+
+
+static const char *phase_names[PIC_SIM_PHASES] = {
+	"off", "gap", "command", "load", "read", "program", "erase"
+};
+
+static const char *check_names[PIC_SIM_CHECKS] = {
+	"TSET1", "THLD1", "TDLY2", "TDLY3", "TPPDP", "THLD0", "TPROG", 
+	"TDPROG", "TERA", "drive", "command"
+};
+
+
+static void
+_violation(PicSimCheck check, const char *detail, uint64_t observed) {
+	sim.stats.violations[check]++;
+	if (sim.logged++ < PIC_SIM_LOGGED_VIOLATIONS) {
+		fprintf(stderr, "pic_sim: %s violated at %.3f us: %s %.3f us, "
+				"needs %.3f us\n", check_names[check], 
+				host_delay_ns() / 1000.0, detail, observed / 1000.0, 
+				sim.required[check] / 1000.0);
+	}
+}
+
+
+// Check a time against its minimum.
+static void
+_check(PicSimCheck check, uint64_t observed) {
+	if (observed < sim.stats.min_ns[check]) {
+		sim.stats.min_ns[check] = observed;
+	}
+	if (observed < sim.required[check]) {
+		_violation(check, "observed", observed);
+	}
+}
+
+
+// Charge the time since the last pin event to the phase it was spent in.
+static uint64_t
+_account() {
+	uint64_t now = host_delay_ns();
+	sim.stats.phase_ns[sim.phase] += now - sim.accounted;
+	sim.accounted = now;
+	return now;
+}
+
+
+static void
+_update_phase() {
+	if (!sim.powered) {
+		sim.phase = PIC_SIM_OFF;
+	}
+	else if (sim.cycle != PIC_SIM_OFF) {
+		sim.phase = sim.cycle;
+	}
+	else if (sim.shift == SHIFT_LOAD) {
+		sim.phase = PIC_SIM_LOAD;
+	}
+	else if (sim.shift == SHIFT_READ) {
+		sim.phase = PIC_SIM_READ;
+	}
+	else {
+		sim.phase = sim.count ? PIC_SIM_COMMAND : PIC_SIM_GAP;
+	}
+}
+
+
+static uint16_t
+_read_program_space() {
+	if (sim.config_space) {
+		return sim.pc < PIC_SIM_CONFIG_WORDS ? sim.config[sim.pc] : 0x3FFF;
+	}
+	return sim.program[sim.pc % sim.device->programSize];
+}
+
+
+static void
+_start_cycle(PicSimPhase phase, PicSimCheck check) {
+	sim.cycle = phase;
+	sim.cycle_check = check;
+	sim.cycle_at = host_delay_ns();
+}
+
+
+// Write the loaded latch at the PC.  Erase-and-program cycles replace the
+// word, program-only cycles can only clear bits.
+static void
+_program(bool erase) {
+	uint16_t *word;
+
+	sim.stats.program_cycles++;
+	if (sim.load == LATCH_DATA) {
+		sim.data[sim.pc % sim.device->dataSize] = sim.data_latch;
+		_start_cycle(PIC_SIM_PROGRAM, PIC_SIM_CHECK_TDPROG);
+		return;
+	}
+	if (sim.config_space) {
+		// The device ID is read only.
+		if (sim.pc >= sim.device->configSize || sim.pc == DEV_ID) {
+			_start_cycle(PIC_SIM_PROGRAM, PIC_SIM_CHECK_TPROG);
+			return;
+		}
+		word = &sim.config[sim.pc];
+	}
+	else {
+		word = &sim.program[sim.pc % sim.device->programSize];
+	}
+	*word = erase ? sim.program_latch : *word & sim.program_latch;
+	_start_cycle(PIC_SIM_PROGRAM, PIC_SIM_CHECK_TPROG);
+}
+
+
+static void
+_execute(uint8_t command) {
+	uint16_t i;
+
+	sim.stats.commands++;
+	switch (command) {
+		case CMD_LOAD_CONFIG:
+		case CMD_LOAD_PROGRAM_MEMORY:
+		case CMD_LOAD_DATA_MEMORY:
+			sim.shift = SHIFT_LOAD;
+			sim.load = command == CMD_LOAD_DATA_MEMORY ? LATCH_DATA : 
+				command == CMD_LOAD_CONFIG ? LATCH_CONFIG : LATCH_PROGRAM;
+			break;
+
+		case CMD_READ_PROGRAM_MEMORY:
+			sim.shift = SHIFT_READ;
+			sim.value = (_read_program_space() & 0x3FFF) << 1;
+			break;
+
+		case CMD_READ_DATA_MEMORY:
+			sim.shift = SHIFT_READ;
+			sim.value = sim.data[sim.pc % sim.device->dataSize] << 1;
+			break;
+
+		case CMD_INCREMENT_ADDRESS:
+			sim.pc = (sim.pc + 1) & PIC_SIM_PC_MASK;
+			break;
+
+		case CMD_BEGIN_PROGRAM:
+			_program(true);
+			break;
+
+		case CMD_BEGIN_PROGRAM_ONLY:
+			_program(false);
+			break;
+
+		case CMD_END_PROGRAM_ONLY:
+			break;
+
+		case CMD_BULK_ERASE_PROGRAM:
+			for (i = 0; i < sim.device->programSize; i++) {
+				sim.program[i] = 0x3FFF;
+			}
+			if (sim.config_space) {
+				for (i = 0; i < sim.device->configSize; i++) {
+					if (i != DEV_ID) {
+						sim.config[i] = 0x3FFF;
+					}
+				}
+			}
+			sim.stats.erases++;
+			_start_cycle(PIC_SIM_ERASE, PIC_SIM_CHECK_TERA);
+			break;
+
+		case CMD_BULK_ERASE_DATA:
+			os_memset(sim.data, 0xFF, sim.device->dataSize);
+			sim.stats.erases++;
+			_start_cycle(PIC_SIM_ERASE, PIC_SIM_CHECK_TERA);
+			break;
+
+		default:
+			_violation(PIC_SIM_CHECK_COMMAND, "command", command);
+			break;
+	}
+}
+
+
+// A loaded word is in, LOAD_CONFIG also moves the PC to config memory.
+static void
+_loaded(uint16_t value) {
+	sim.stats.words_loaded++;
+	if (sim.load == LATCH_DATA) {
+		sim.data_latch = value >> 1;
+		return;
+	}
+	sim.program_latch = (value >> 1) & 0x3FFF;
+	if (sim.load == LATCH_CONFIG) {
+		sim.config_space = true;
+		sim.pc = 0;
+	}
+}
+
+
+static void
+_power(uint64_t now) {
+	bool powered = sim.vpp && sim.vdd;
+	if (powered == sim.powered) {
+		return;
+	}
+	sim.powered = powered;
+	sim.cycle = PIC_SIM_OFF;
+	if (powered) {
+		sim.stats.sessions++;
+		sim.powered_at = now;
+		sim.clocked = false;
+		sim.config_space = false;
+		sim.pc = 0;
+		sim.shift = SHIFT_COMMAND;
+		sim.count = 0;
+		sim.value = 0;
+		sim.shift_end = now;
+	}
+}
+
+
+static void
+_rise(uint64_t now) {
+	if (!sim.clocked) {
+		_check(PIC_SIM_CHECK_THLD0, now - sim.powered_at);
+		sim.clocked = true;
+	}
+	if (sim.cycle != PIC_SIM_OFF) {
+		_check(sim.cycle_check, now - sim.cycle_at);
+		sim.cycle = PIC_SIM_OFF;
+	}
+	else if (sim.count == 0 && sim.stats.commands) {
+		_check(PIC_SIM_CHECK_TDLY2, now - sim.shift_end);
+	}
+	sim.rise_at = now;
+	if (sim.shift == SHIFT_READ) {
+		if (sim.data_driven) {
+			_violation(PIC_SIM_CHECK_DRIVE, "DATA driven during read", 0);
+		}
+		sim.out_bit = (sim.value >> sim.count) & 1;
+	}
+}
+
+
+static void
+_fall(uint64_t now) {
+	bool bit = sim.data_level;
+
+	sim.fall_at = now;
+	if (sim.shift != SHIFT_READ) {
+		if (!sim.data_driven) {
+			_violation(PIC_SIM_CHECK_DRIVE, "DATA floating when latched", 0);
+			bit = 1;
+		}
+		_check(PIC_SIM_CHECK_TSET1, now - sim.data_at);
+		sim.hold_pending = true;
+	}
+
+	switch (sim.shift) {
+		case SHIFT_COMMAND:
+			sim.value |= bit << sim.count;
+			if (++sim.count == 6) {
+				sim.count = 0;
+				sim.shift_end = now;
+				_execute(sim.value);
+				sim.value = sim.shift == SHIFT_READ ? sim.value : 0;
+			}
+			break;
+
+		case SHIFT_LOAD:
+			sim.value |= bit << sim.count;
+			if (++sim.count == 16) {
+				_loaded(sim.value);
+				sim.count = 0;
+				sim.value = 0;
+				sim.shift = SHIFT_COMMAND;
+				sim.shift_end = now;
+			}
+			break;
+
+		case SHIFT_READ:
+			if (++sim.count == 16) {
+				sim.stats.words_read++;
+				sim.count = 0;
+				sim.value = 0;
+				sim.shift = SHIFT_COMMAND;
+				sim.shift_end = now;
+			}
+			break;
+	}
+}
+
+
+static void
+_set(uint8_t pin, uint8_t level) {
+	uint64_t now = _account();
+
+	switch (pin) {
+		case MCLR_NUM:
+			if (sim.vpp != (level == MCLR_VPP) && level == MCLR_VPP) {
+				sim.vpp_at = now;
+			}
+			sim.vpp = level == MCLR_VPP;
+			_power(now);
+			break;
+
+		case VDD_NUM:
+			if (!sim.vdd && level && sim.vpp) {
+				_check(PIC_SIM_CHECK_TPPDP, now - sim.vpp_at);
+			}
+			sim.vdd = level;
+			_power(now);
+			break;
+
+		case CLOCK_NUM:
+			if (sim.clock == level) {
+				break;
+			}
+			sim.clock = level;
+			if (sim.powered) {
+				if (level) {
+					_rise(now);
+				}
+				else {
+					_fall(now);
+				}
+			}
+			break;
+
+		case DATA_NUM:
+			if (!sim.data_driven || sim.data_level != level) {
+				if (sim.powered && sim.hold_pending) {
+					_check(PIC_SIM_CHECK_THLD1, now - sim.fall_at);
+				}
+				sim.hold_pending = false;
+				sim.data_at = now;
+			}
+			sim.data_level = level;
+			sim.data_driven = true;
+			break;
+	}
+	_update_phase();
+}
+
+
+static uint8_t
+_get(uint8_t pin) {
+	uint64_t now = _account();
+
+	if (pin != DATA_NUM || !sim.powered || sim.shift != SHIFT_READ || 
+			!sim.clock) {
+		// Pulled up.
+		return 1;
+	}
+	_check(PIC_SIM_CHECK_TDLY3, now - sim.rise_at);
+	return sim.out_bit;
+}
+
+
+static void
+_input(uint8_t pin) {
+	_account();
+	if (pin == DATA_NUM) {
+		sim.data_driven = false;
+	}
+}
+
+
+static const HostPinModel model = {_set, _get, _input};
+
+
+uint8_t
+pic_sim_devices() {
+	uint8_t count = 0;
+	while (devices[count].name != NULL) {
+		count++;
+	}
+	return count;
+}
+
+
+const char *
+pic_sim_device_name(uint8_t index) {
+	return index < pic_sim_devices() ? devices[index].name : NULL;
+}
+
+
+bool
+pic_sim_attach(const char *name) {
+	const struct deviceInfo *device;
+	uint16_t i;
+
+	for (device = devices; device->name != NULL; device++) {
+		if (os_strcmp(device->name, name) == 0) {
+			break;
+		}
+	}
+	if (device->name == NULL) {
+		return false;
+	}
+	pic_sim_detach();
+
+	sim.device = device;
+	sim.program = os_malloc(device->programSize * sizeof(uint16_t));
+	sim.data = os_malloc(device->dataSize);
+	for (i = 0; i < device->programSize; i++) {
+		sim.program[i] = 0x3FFF;
+	}
+	for (i = 0; i < PIC_SIM_CONFIG_WORDS; i++) {
+		sim.config[i] = 0x3FFF;
+	}
+	if (device->deviceId >= 0) {
+		sim.config[DEV_ID] = device->deviceId;
+	}
+	os_memset(sim.data, 0xFF, device->dataSize);
+
+	sim.required[PIC_SIM_CHECK_TSET1] = PIC_SIM_TSET1;
+	sim.required[PIC_SIM_CHECK_THLD1] = PIC_SIM_THLD1;
+	sim.required[PIC_SIM_CHECK_TDLY2] = PIC_SIM_TDLY2;
+	sim.required[PIC_SIM_CHECK_TDLY3] = PIC_SIM_TDLY3;
+	sim.required[PIC_SIM_CHECK_TPPDP] = PIC_SIM_TPPDP;
+	sim.required[PIC_SIM_CHECK_THLD0] = PIC_SIM_THLD0;
+	switch (device->progFlashType) {
+		case FLASH5:
+			sim.required[PIC_SIM_CHECK_TPROG] = PIC_SIM_TPROG_FLASH5 * 1000ULL;
+			break;
+		case FLASH4:
+			sim.required[PIC_SIM_CHECK_TPROG] = PIC_SIM_TPROG_FLASH4 * 1000ULL;
+			break;
+		default:
+			sim.required[PIC_SIM_CHECK_TPROG] = PIC_SIM_TPROG_FLASH * 1000ULL;
+			break;
+	}
+	sim.required[PIC_SIM_CHECK_TDPROG] = PIC_SIM_TDPROG * 1000ULL;
+	sim.required[PIC_SIM_CHECK_TERA] = PIC_SIM_TERA * 1000ULL;
+
+	// Unpowered, with the programmer's pins as they are.
+	sim.vpp = sim.vdd = sim.powered = false;
+	sim.clock = false;
+	sim.data_driven = false;
+	sim.cycle = PIC_SIM_OFF;
+	pic_sim_reset_stats();
+	host_gpio_set_model(&model);
+	return true;
+}
+
+
+void
+pic_sim_detach() {
+	if (sim.device == NULL) {
+		return;
+	}
+	host_gpio_set_model(NULL);
+	os_free(sim.program);
+	os_free(sim.data);
+	sim.program = NULL;
+	sim.data = NULL;
+	sim.device = NULL;
+}
+
+
+uint16_t
+pic_sim_peek(uint32_t addr) {
+	const struct deviceInfo *device = sim.device;
+	if (addr >= device->dataStart && 
+			addr < device->dataStart + device->dataSize) {
+		return sim.data[addr - device->dataStart];
+	}
+	if (addr >= device->configStart && 
+			addr < device->configStart + PIC_SIM_CONFIG_WORDS) {
+		return sim.config[addr - device->configStart];
+	}
+	return sim.program[addr % device->programSize];
+}
+
+
+void
+pic_sim_poke(uint32_t addr, uint16_t word) {
+	const struct deviceInfo *device = sim.device;
+	if (addr >= device->dataStart && 
+			addr < device->dataStart + device->dataSize) {
+		sim.data[addr - device->dataStart] = word;
+	}
+	else if (addr >= device->configStart && 
+			addr < device->configStart + PIC_SIM_CONFIG_WORDS) {
+		sim.config[addr - device->configStart] = word & 0x3FFF;
+	}
+	else {
+		sim.program[addr % device->programSize] = word & 0x3FFF;
+	}
+}
+
+
+void
+pic_sim_reset_stats() {
+	PicSimCheck check;
+	os_memset(&sim.stats, 0, sizeof(sim.stats));
+	for (check = 0; check < PIC_SIM_CHECKS; check++) {
+		sim.stats.min_ns[check] = UINT64_MAX;
+	}
+	sim.accounted = host_delay_ns();
+	sim.logged = 0;
+}
+
+
+uint64_t
+pic_sim_required_ns(PicSimCheck check) {
+	return sim.required[check];
+}
+
+
+const PicSimStats *
+pic_sim_stats() {
+	_account();
+	return &sim.stats;
+}
+
+
+const char *
+pic_sim_phase_name(PicSimPhase phase) {
+	return phase_names[phase];
+}
+
+
+const char *
+pic_sim_check_name(PicSimCheck check) {
+	return check_names[check];
+}
+
+
+void
+pic_sim_report(FILE *out) {
+	const PicSimStats *stats = pic_sim_stats();
+	uint64_t total = 0;
+	PicSimPhase phase;
+	PicSimCheck check;
+
+	for (phase = 0; phase < PIC_SIM_PHASES; phase++) {
+		total += stats->phase_ns[phase];
+	}
+	fprintf(out, "%s: %.3f ms virtual, %u sessions, %u commands, "
+			"%u words read, %u loaded, %u program cycles, %u erases\n",
+			sim.device->name, total / 1e6, stats->sessions, stats->commands,
+			stats->words_read, stats->words_loaded, stats->program_cycles,
+			stats->erases);
+	for (phase = 0; phase < PIC_SIM_PHASES; phase++) {
+		if (stats->phase_ns[phase]) {
+			fprintf(out, "  %-8s %12.3f ms %5.1f%%\n", phase_names[phase],
+					stats->phase_ns[phase] / 1e6, 
+					100.0 * stats->phase_ns[phase] / total);
+		}
+	}
+	for (check = 0; check < PIC_SIM_CHECKS; check++) {
+		if (stats->min_ns[check] != UINT64_MAX) {
+			fprintf(out, "  %-8s min %10.3f us, needs %10.3f us, %u violations\n",
+					check_names[check], stats->min_ns[check] / 1000.0,
+					sim.required[check] / 1000.0, stats->violations[check]);
+		}
+		else if (stats->violations[check]) {
+			fprintf(out, "  %-8s %u violations\n", check_names[check],
+					stats->violations[check]);
+		}
+	}
+}
@@ -0,0 +1,233 @@
+/* 
+ * Runs the firmware against the PIC model for every supported device.
+ *
+ *   wpp-sim [-v] [-c file.vcd] [device ...]
+ *
+ * Each device goes through DETECT, a READ of all memories, a WRITEBIN
+ * and a WRITE_DATA, sent over SP like a client would.  Prints the
+ * virtual time per word of each step, then with -v the model's full
+ * report: per-phase breakdown and the timing checks.  -c records the
+ * ICSP pins of the whole run into a VCD file.  Exits non-zero on any
+ * timing violation or failed step.
+ */
+
+#include "host.h"
+#include "pic_sim.h"
+
+#include "sp.h"
+#include "sp_tcpserver.h"
+#include "bigendian.h"
+#include "pic_devices.h"
+#include "pool.h"
+#include "log.h"
+#include "stats.h"
+
+#include <osapi.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+#define SIM_WRITE_WORDS		64
+#define SIM_WRITE_BYTES		32
+
+
+static int client = -1;
+static char frames[4096];
+static uint32_t buffered;
+
+
+// Send a request and wait for its final response, returns the status and
+// the number of words in READ_MORE responses.
+static int
+_request(uint8_t command, const char *body, uint32_t length, 
+		uint32_t *words) {
+	char head[5];
+	uint32_t size;
+	ssize_t received;
+	uint8_t status;
+
+	*words = 0;
+	head[0] = command;
+	bigendian_serialize_uint32(head + 1, length);
+	if (write(client, head, 5) != 5 || 
+			(length && write(client, body, length) != length)) {
+		return -1;
+	}
+	for (;;) {
+		while (buffered >= 5) {
+			status = frames[0];
+			size = bigendian_deserialize_uint32(frames + 1);
+			if (buffered < 5 + size) {
+				break;
+			}
+			os_memmove(frames, frames + 5 + size, buffered - 5 - size);
+			buffered -= 5 + size;
+			if (status == SP_STATUS_READ_MORE) {
+				*words += size / 4;
+				continue;
+			}
+			return status;
+		}
+		host_loop_once(10);
+		received = read(client, frames + buffered, sizeof(frames) - buffered);
+		if (received == 0) {
+			return -1;
+		}
+		if (received > 0) {
+			buffered += received;
+		}
+	}
+}
+
+
+static uint64_t
+_sim_ns() {
+	const PicSimStats *stats = pic_sim_stats();
+	uint64_t total = 0;
+	int phase;
+	for (phase = 0; phase < PIC_SIM_PHASES; phase++) {
+		total += stats->phase_ns[phase];
+	}
+	return total;
+}
+
+
+static bool
+_step(const char *name, uint8_t command, const char *body, uint32_t length,
+		uint32_t words) {
+	uint64_t start = _sim_ns();
+	uint32_t read;
+	int status = _request(command, body, length, &read);
+	uint64_t elapsed = _sim_ns() - start;
+
+	if (read) {
+		words = read;
+	}
+	printf("  %-8s %6u words %12.3f ms %10.1f us/word%s\n", name, words, 
+			elapsed / 1e6, words ? elapsed / 1000.0 / words : 0.0, 
+			status == SP_OK || status == SP_STATUS_READ_DONE ? "" : 
+			"  FAILED");
+	return status == SP_OK || status == SP_STATUS_READ_DONE;
+}
+
+
+static bool
+_run(const struct deviceInfo *device, bool verbose) {
+	char body[4 + SIM_WRITE_WORDS * 2];
+	uint32_t violations = 0;
+	bool ok = true;
+	uint32_t i;
+
+	if (!pic_sim_attach(device->name)) {
+		return false;
+	}
+	printf("%s\n", device->name);
+	ok &= _step("detect", SP_CMD_DETECT, NULL, 0, 0);
+	if (!ok) {
+		// PIC16F84 has no device ID, nothing to match it with.
+		if (device->deviceId < 0) {
+			printf("  no device ID, skipped\n");
+		}
+		pic_sim_detach();
+		return device->deviceId < 0;
+	}
+
+	bigendian_serialize_uint32(body, 0);
+	bigendian_serialize_uint32(body + 4, 0);
+	bigendian_serialize_uint32(body + 8, device->programSize - 1);
+	ok &= _step("read", SP_CMD_READ, body, 12, 0);
+	bigendian_serialize_uint32(body, device->dataStart);
+	bigendian_serialize_uint32(body + 8, 
+			device->dataStart + device->dataSize - 1);
+	ok &= _step("readdata", SP_CMD_READ, body, 12, 0);
+
+	bigendian_serialize_uint32(body, 0);
+	for (i = 0; i < SIM_WRITE_WORDS; i++) {
+		bigendian_serialize_uint16(body + 4 + i * 2, (i * 0x123) & 0x3FFF);
+	}
+	ok &= _step("write", SP_CMD_WRITEBIN, body, sizeof(body), 
+			SIM_WRITE_WORDS);
+	bigendian_serialize_uint32(body, device->dataStart);
+	for (i = 0; i < SIM_WRITE_BYTES; i++) {
+		body[4 + i] = i;
+	}
+	ok &= _step("writedata", SP_CMD_WRITE_DATA, body, 4 + SIM_WRITE_BYTES, 
+			SIM_WRITE_BYTES);
+	for (i = 0; i < SIM_WRITE_WORDS; i++) {
+		ok &= pic_sim_peek(i) == ((i * 0x123) & 0x3FFF);
+	}
+	_step("pwroff", SP_CMD_PWROFF, NULL, 0, 0);
+
+	for (i = 0; i < PIC_SIM_CHECKS; i++) {
+		violations += pic_sim_stats()->violations[i];
+	}
+	if (verbose || violations) {
+		pic_sim_report(stdout);
+	}
+	pic_sim_detach();
+	return ok && !violations;
+}
+
+
+int
+main(int argc, char **argv) {
+	const struct deviceInfo *device;
+	bool verbose = false;
+	bool ok = true;
+	int option;
+	int fds[2];
+	int i;
+
+	while ((option = getopt(argc, argv, "vc:")) != -1) {
+		switch (option) {
+			case 'v':
+				verbose = true;
+				break;
+
+			case 'c':
+				if (!host_vcd_open(optarg)) {
+					return 1;
+				}
+				break;
+
+			default:
+				fprintf(stderr, "usage: %s [-v] [-c file.vcd] [device ...]\n",
+						argv[0]);
+				return 2;
+		}
+	}
+
+	log_initialize();
+	stats_initialize();
+	pool_initialize();
+	sp_initialize();
+	sp_start();
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 ||
+			host_espconn_attach(SP_TCPSERVER_PORT, fds[0]) == NULL) {
+		perror("wpp-sim");
+		return 1;
+	}
+	client = fds[1];
+	fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+
+	for (device = devices; device->name != NULL; device++) {
+		if (optind < argc) {
+			for (i = optind; i < argc && strcmp(argv[i], device->name); i++) {
+			}
+			if (i == argc) {
+				continue;
+			}
+		}
+		ok &= _run(device, verbose);
+	}
+
+	close(client);
+	host_loop_once(0);
+	sp_shutdown();
+	host_vcd_close();
+	return ok ? 0 : 1;
+}
@@ -12,4 +12,11 @@ unsigned char * bigendian_serialize_uint32(unsigned char *buffer,
 ICACHE_FLASH_ATTR
 uint32_t bigendian_deserialize_uint32(const unsigned char *buffer);
 
+ICACHE_FLASH_ATTR
+unsigned char * bigendian_serialize_uint16(unsigned char *buffer, 
+		uint16_t value);
+
+ICACHE_FLASH_ATTR
+uint16_t bigendian_deserialize_uint16(const unsigned char *buffer);
+
 #endif
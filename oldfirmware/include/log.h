@@ -0,0 +1,80 @@
+/* Leveled logging into a RAM ring buffer */
+
+#ifndef _LOG_H__
+#define _LOG_H__
+
+#include <c_types.h>
+
+
+#define LOG_LEVEL_NONE		0
+#define LOG_LEVEL_ERROR		1
+#define LOG_LEVEL_WARN		2
+#define LOG_LEVEL_INFO		3
+#define LOG_LEVEL_DEBUG		4
+
+// Messages above this level compile to nothing.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL			LOG_LEVEL_INFO
+#endif
+
+// Bytes of log history kept in RAM.
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE		2048
+#endif
+
+// Longest formatted line, longer ones are cut.
+#define LOG_LINE_SIZE		128
+
+#define LOG_TASK_PRIO		USER_TASK_PRIO_0
+
+// Milliseconds to wait while the UART FIFO is full.
+#define LOG_DRAIN_INTERVAL	5
+
+
+// The format string stays in flash, like with os_printf.
+#define _LOG(level, fmt, ...) do { \
+	static const char _log_fmt[] ICACHE_RODATA_ATTR STORE_ATTR = fmt; \
+	log_write(level, _log_fmt, ##__VA_ARGS__); \
+} while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) _LOG(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) _LOG(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) _LOG(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...) _LOG(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) do {} while (0)
+#endif
+
+
+ICACHE_FLASH_ATTR
+void log_initialize();
+
+ICACHE_FLASH_ATTR
+void log_write(uint8_t level, const char *format, ...);
+
+ICACHE_FLASH_ATTR
+uint16_t log_read(uint32_t *position, char *buffer, uint16_t size);
+
+ICACHE_FLASH_ATTR
+uint32_t log_dropped();
+
+ICACHE_FLASH_ATTR
+void log_detach_uart();
+
+#endif
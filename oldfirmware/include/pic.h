@@ -0,0 +1,53 @@
+/* PIC ICSP engine's header */
+
+#ifndef _PIC_H__
+#define _PIC_H__
+
+#include "sp.h"
+
+#include <c_types.h>
+
+
+ICACHE_FLASH_ATTR
+void pic_initialize();
+
+ICACHE_FLASH_ATTR
+void pic_shutdown();
+
+ICACHE_FLASH_ATTR
+void pic_session_begin();
+
+ICACHE_FLASH_ATTR
+void pic_session_end();
+
+// Name and ID of the last detected device, NULL if there is none.
+ICACHE_FLASH_ATTR
+const char * pic_detected_device(uint32_t *deviceId);
+
+ICACHE_FLASH_ATTR
+SPError pic_command_detect_device(const SPPacket *req);
+
+ICACHE_FLASH_ATTR
+SPError pic_command_read(const SPPacket *req);
+
+ICACHE_FLASH_ATTR
+SPError pic_command_write_data(const SPPacket *req);
+
+ICACHE_FLASH_ATTR
+SPError pic_command_power_off(const SPPacket *req);
+
+ICACHE_FLASH_ATTR
+SPError pic_stream_write_binary(const SPPacketHead *head, uint32_t offset,
+		const char *chunk, uint16_t length);
+
+ICACHE_FLASH_ATTR
+SPError pic_command_write_binary(const SPPacket *req);
+
+// Programming outside of SP, e.g. an upload through webadmin.
+ICACHE_FLASH_ATTR
+SPError pic_write_word(uint32_t addr, uint16_t word);
+
+ICACHE_FLASH_ATTR
+void pic_write_end();
+
+#endif
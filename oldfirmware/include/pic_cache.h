@@ -0,0 +1,26 @@
+/* Shadow cache of the target chip contents */
+
+#ifndef _PIC_CACHE_H__
+#define _PIC_CACHE_H__
+
+#include <c_types.h>
+
+
+ICACHE_FLASH_ATTR
+bool pic_cache_setup(uint32_t deviceId, uint32_t programSize,
+		uint32_t configStart, uint16_t configSize, 
+		uint32_t dataStart, uint16_t dataSize);
+
+ICACHE_FLASH_ATTR
+void pic_cache_invalidate();
+
+ICACHE_FLASH_ATTR
+void pic_cache_release();
+
+ICACHE_FLASH_ATTR
+bool pic_cache_lookup(uint32_t addr, uint32_t *word);
+
+ICACHE_FLASH_ATTR
+void pic_cache_store(uint32_t addr, uint32_t word);
+
+#endif
@@ -0,0 +1,62 @@
+/* Fixed-block pools for network and request buffers */
+
+#ifndef _POOL_H__
+#define _POOL_H__
+
+#include <c_types.h>
+
+
+// Size classes, blocks are taken from the smallest class that fits.
+typedef enum {
+	// Status responses and short bodies
+	POOL_SMALL,
+
+	// Response chunks, e.g. a compressed READ chunk with its head
+	POOL_CHUNK,
+
+	// Batch results and web pages
+	POOL_LARGE,
+
+	POOL_COUNT
+} PoolClass;
+
+
+#define POOL_SMALL_SIZE			64
+#define POOL_SMALL_BLOCKS		12
+#define POOL_CHUNK_SIZE			1088
+#define POOL_CHUNK_BLOCKS		4
+#define POOL_LARGE_SIZE			2112
+#define POOL_LARGE_BLOCKS		1
+
+
+typedef struct {
+	uint16_t block_size;
+	uint16_t blocks;
+	uint16_t used;
+	uint16_t high_water;
+	uint16_t failures;
+} PoolStats;
+
+
+ICACHE_FLASH_ATTR
+void pool_initialize();
+
+ICACHE_FLASH_ATTR
+void * pool_alloc(uint16_t size);
+
+ICACHE_FLASH_ATTR
+void pool_free(void *block);
+
+ICACHE_FLASH_ATTR
+uint16_t pool_grow(PoolClass pool, uint16_t blocks, uint32_t budget);
+
+ICACHE_FLASH_ATTR
+bool pool_shrink(PoolClass pool);
+
+ICACHE_FLASH_ATTR
+void pool_stats(PoolClass pool, PoolStats *stats);
+
+ICACHE_FLASH_ATTR
+void pool_print_stats();
+
+#endif
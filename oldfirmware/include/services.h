@@ -0,0 +1,24 @@
+/* Service manager, gives heap to programming while a lease is held */
+
+#ifndef _SERVICES_H__
+#define _SERVICES_H__
+
+#include <c_types.h>
+
+
+// Extra chunk blocks taken from the memory of suspended services.
+#ifndef SERVICES_EXTRA_CHUNKS
+#define SERVICES_EXTRA_CHUNKS	4
+#endif
+
+// Heap left alone for the network stack when growing the pools.
+#define SERVICES_HEAP_RESERVE	8192
+
+// Milliseconds between attempts to return the extra blocks.
+#define SERVICES_RETRY_INTERVAL	100
+
+
+ICACHE_FLASH_ATTR
+void services_programming(bool active);
+
+#endif
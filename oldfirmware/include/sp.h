@@ -5,11 +5,26 @@
 
 #include <c_types.h>
 
-#ifndef SP_VERBOSE
-#define SP_VERBOSE	true
+#define SP_VERSION	"0.1.0"
+
+// Room for the combined result of a BATCH command.
+#ifndef SP_BATCH_RESULT_SIZE
+#define SP_BATCH_RESULT_SIZE	2048
 #endif
 
-#define SP_VERSION	"0.1.0"
+// Set in the command byte of a request, and echoed in the status byte of
+// its responses, when a 16-bit tag follows the length field.
+#define SP_TAG_FLAG		0x80
+#define SP_TAGGED_HEAD_SIZE	7
+
+// Set in the command byte of a request whose body is compressed, see
+// sp_codec.h.  The decoded length (uint32) follows the length and tag, and
+// all responses to the request are compressed and framed the same way.
+#define SP_COMPRESS_FLAG	0x40
+#define SP_MAX_HEAD_SIZE	11
+
+// Most log bytes returned by one LOG command.
+#define SP_LOG_CHUNK	512
 
 
 // List of all commands that are understood by the programmer.
@@ -42,7 +57,31 @@ typedef enum {
 	SP_CMD_SETDEVICE, 
 
 	// Powers off the device in the programming socke
-	SP_CMD_PWROFF
+	SP_CMD_PWROFF,
+
+	// Writes data memory bytes, skipping those already holding the value
+	SP_CMD_WRITE_DATA,
+
+	// Executes a list of commands in one ICSP session
+	SP_CMD_BATCH,
+
+	// Cancels the running tagged operation
+	SP_CMD_CANCEL,
+
+	// Reports the programmer state and the last detected device
+	SP_CMD_STATUS,
+
+	// Reports usage of the buffer pools
+	SP_CMD_POOLS,
+
+	// Returns recent log messages
+	SP_CMD_LOG,
+
+	// Reports performance counters
+	SP_CMD_STATS,
+
+	// Returns recorded trace events
+	SP_CMD_TRACE
 } SPCommand;
 
 
@@ -50,12 +89,19 @@ typedef enum {
 	SP_STATUS_OK,
 	SP_STATUS_READ_MORE,
 	SP_STATUS_READ_DONE,
+
+	// Tagged operations: started in the background, and still running
+	SP_STATUS_ACCEPTED = 0x40,
+	SP_STATUS_PROGRESS,
 } SPStatus;
 
 
 typedef struct {
 	uint8_t command;
 	uint32_t body_length;
+	bool tagged;
+	bool compressed;
+	uint16_t tag;
 } SPPacketHead;
 
 
@@ -70,6 +116,29 @@ typedef enum {
 	SP_ERR_INVALID_COMMAND,
 	SP_ERR_REQ_LEN,
 	SP_ERR_DEVICE_NOT_DETECTED,
+	SP_ERR_ADDRESS_RANGE,
+	SP_ERR_WRITE_FAILED,
+	SP_ERR_BATCH_OVERFLOW,
+	SP_ERR_BUSY,
+	SP_ERR_CANCELLED,
+	SP_ERR_NO_SUCH_JOB,
+	SP_ERR_LEASED,
 } SPError;
 
+
+// Sets up the programmer and serves the UART if configured, once at boot.
+void ICACHE_FLASH_ATTR
+sp_initialize();
+
+// Starts serving TCP clients, once the station has an address.
+void ICACHE_FLASH_ATTR
+sp_start();
+
+// Stops serving TCP clients, e.g. when the station is disconnected.
+void ICACHE_FLASH_ATTR
+sp_stop();
+
+void ICACHE_FLASH_ATTR
+sp_shutdown();
+
 #endif
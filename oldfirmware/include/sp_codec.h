@@ -0,0 +1,49 @@
+/* Compressed transfer encoding of request and response bodies */
+
+#ifndef _SP_CODEC_H__
+#define _SP_CODEC_H__
+
+#include <c_types.h>
+
+
+// A small LZ77 variant with a 256 byte window.  The encoded stream is a
+// sequence of tokens:
+//
+//   0nnnnnnn                 literal run, n + 1 bytes follow
+//   1nnnnnnn dddddddd        copy n + 3 bytes from d + 1 bytes back
+//
+// Copies may overlap their own output, so runs of a repeated word cost
+// two bytes per 130 bytes.
+#define SP_CODEC_WINDOW			256
+#define SP_CODEC_MAX_LITERAL	128
+#define SP_CODEC_MIN_MATCH		3
+#define SP_CODEC_MAX_MATCH		130
+
+
+// Decoder state, kept across chunks of a body.
+typedef struct {
+	unsigned char window[SP_CODEC_WINDOW];
+	uint8_t position;
+	uint8_t state;
+	uint8_t count;
+	uint8_t distance;
+} SPDecoder;
+
+
+// Largest encoded size of length bytes.
+#define sp_codec_bound(length) ((length) + (length) / SP_CODEC_MAX_LITERAL + 1)
+
+
+ICACHE_FLASH_ATTR
+uint32_t sp_codec_encode(const unsigned char *in, uint16_t length, 
+		unsigned char *out);
+
+ICACHE_FLASH_ATTR
+void sp_codec_decoder_init(SPDecoder *decoder);
+
+ICACHE_FLASH_ATTR
+uint16_t sp_codec_decode(SPDecoder *decoder, const unsigned char *in, 
+		uint16_t length, unsigned char *out, uint16_t size, 
+		uint16_t *produced);
+
+#endif
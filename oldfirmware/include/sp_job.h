@@ -0,0 +1,55 @@
+/* Background executor for long, tagged operations */
+
+#ifndef _SP_JOB_H__
+#define _SP_JOB_H__
+
+#include "sp.h"
+#include "sp_tcpserver.h"
+
+#include <c_types.h>
+
+
+// Units of work, e.g. words, done per task run.  Cancellation takes
+// effect between slices.
+#ifndef SP_JOB_SLICE
+#define SP_JOB_SLICE			32
+#endif
+
+// Units of work between two progress frames.
+#ifndef SP_JOB_PROGRESS_INTERVAL
+#define SP_JOB_PROGRESS_INTERVAL	512
+#endif
+
+#define SP_JOB_TASK_PRIO		USER_TASK_PRIO_1
+#define SP_JOB_RETRY_INTERVAL	5
+
+
+// Does up to SP_JOB_SLICE units of work and updates the units done so
+// far.  Sets finished once there is nothing left.
+typedef SPError (*SPJobStep)(uint32_t *done, bool *finished);
+
+// Stops the operation, e.g. powers the target down.
+typedef void (*SPJobAbort)();
+
+
+ICACHE_FLASH_ATTR
+SPError sp_job_start(uint16_t tag, uint32_t total, SPJobStep step, 
+		SPJobAbort abort);
+
+ICACHE_FLASH_ATTR
+SPError sp_job_cancel(uint16_t tag);
+
+ICACHE_FLASH_ATTR
+bool sp_job_running();
+
+// Stops the job of a client that went away, nobody is left to report to.
+ICACHE_FLASH_ATTR
+void sp_job_client_gone(SPConnection *client);
+
+ICACHE_FLASH_ATTR
+void sp_job_initialize();
+
+ICACHE_FLASH_ATTR
+void sp_job_shutdown();
+
+#endif
@@ -10,14 +10,164 @@
 #define SP_TCPSERVER_PORT	8585
 #endif
 
+// Number of responses that may wait for the sent callback.
+#ifndef SP_TCPSERVER_TXQUEUE_SIZE
+#define SP_TCPSERVER_TXQUEUE_SIZE	4
+#endif
+
+// Milliseconds to wait before retrying a rejected espconn_sent.
+#define SP_TCPSERVER_RETRY_INTERVAL	10
+
+// Largest body that is buffered whole, longer ones must be streamed.
+#ifndef SP_TCPSERVER_MAX_BODY
+#define SP_TCPSERVER_MAX_BODY	1024
+#endif
+
+// Pipelined input kept while a request is in progress, one full segment.
+#define SP_TCPSERVER_RX_BUFFER	1460
+
+// Clients served at once, only one of them may program the target.
+#ifndef SP_TCPSERVER_MAX_CLIENTS
+#define SP_TCPSERVER_MAX_CLIENTS	3
+#endif
+
+// Largest body of a shared command sent by a client without the lease.
+#define SP_TCPSERVER_SHARED_BODY	64
+
+// Number of commands that may stream their body.
+#define SP_TCPSERVER_MAX_STREAMS	4
+
+// Decoded bytes handed to a stream consumer per run.  Consumers such as
+// WRITEBIN program the target as they go, so the client is held and the
+// system gets a turn between slices.
+#ifndef SP_TCPSERVER_STREAM_SLICE
+#define SP_TCPSERVER_STREAM_SLICE	32
+#endif
+
+
+// Framing of responses, following the request they answer.
+typedef struct {
+	bool tagged;
+	bool compressed;
+	uint16_t tag;
+} SPResponseMode;
+
+
+// A client of the server, over TCP or the UART.
+typedef struct SPConnection SPConnection;
 
 typedef SPError (*SPRequestCallback)(SPPacket*);
+typedef void (*SPResumeCallback)();
+typedef void (*SPAbortCallback)();
+typedef void (*SPLeaseCallback)(bool held);
+typedef void (*SPGoneCallback)(SPConnection*);
+
+// Receives a streamed body chunk at the given offset.  Once the body is
+// complete, the request callback is called with a NULL body.
+typedef SPError (*SPChunkCallback)(const SPPacketHead*, uint32_t, 
+		const char*, uint16_t);
+
+ICACHE_FLASH_ATTR
+void sp_tcpserver_initialize(SPRequestCallback request_callback);
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_listen();
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_close();
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_shutdown();
 
 void ICACHE_FLASH_ATTR
 sp_tcpserver_cleanup_request();
-	
 
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_register_stream(uint8_t command, SPChunkCallback consumer);
+
+SPChunkCallback ICACHE_FLASH_ATTR
+sp_tcpserver_find_stream(uint8_t command);
+
+// Called whenever the programming lease is taken or released.
+void ICACHE_FLASH_ATTR
+sp_tcpserver_set_lease_callback(SPLeaseCallback callback);
+
+// Called when a client goes away, before its lease is released.
+void ICACHE_FLASH_ATTR
+sp_tcpserver_set_gone_callback(SPGoneCallback callback);
+
+// Lets the holder of the programming lease run a command, any client may
+// take the lease with it while nobody holds it.  Commands neither shared
+// nor leased are refused.
 void ICACHE_FLASH_ATTR
+sp_tcpserver_lease_command(uint8_t command);
+
+// Lets clients without the programming lease run a command.
+void ICACHE_FLASH_ATTR
+sp_tcpserver_share_command(uint8_t command);
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_capture_begin(char *buffer, uint32_t size);
+
+int32_t ICACHE_FLASH_ATTR
+sp_tcpserver_capture_end();
+	
+
+bool ICACHE_FLASH_ATTR
 sp_tcpserver_response(int8_t, const char*, uint32_t);
 
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_txqueue_available();
+
+// Calls resume once the client being served has room in its TX queue
+// again, or abort if it disconnects first, e.g. to power the target down.
+void ICACHE_FLASH_ATTR
+sp_tcpserver_resume_when_available(SPResumeCallback, SPAbortCallback);
+
+SPConnection * ICACHE_FLASH_ATTR
+sp_tcpserver_client();
+
+SPConnection * ICACHE_FLASH_ATTR
+sp_tcpserver_set_client(SPConnection *c);
+
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_connected();
+
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_lease_remote(uint8_t *ip);
+
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_holds_lease();
+
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_lease_acquire();
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_lease_release();
+
+uint8_t ICACHE_FLASH_ATTR
+sp_tcpserver_clients();
+
+// The UART transport, see sp_uart.h.
+void ICACHE_FLASH_ATTR
+sp_tcpserver_serial_open();
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_serial_close();
+
+uint16_t ICACHE_FLASH_ATTR
+sp_tcpserver_serial_receive(const unsigned char *data, uint16_t length);
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_serial_sent();
+
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_serial_idle();
+
+SPResponseMode ICACHE_FLASH_ATTR
+sp_tcpserver_response_mode();
+
+SPResponseMode ICACHE_FLASH_ATTR
+sp_tcpserver_set_response_mode(SPResponseMode mode);
+
 #endif
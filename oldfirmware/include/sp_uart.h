@@ -0,0 +1,58 @@
+/* SP over UART0, a wired transport next to TCP */
+
+#ifndef _SP_UART_H__
+#define _SP_UART_H__
+
+#include <c_types.h>
+
+// Serve SP on UART0 at this baud rate, 0 leaves the UART to the log.  The
+// host build decides at run time, see wpp-host -u.
+#ifdef HOST_BUILD
+#include <host.h>
+#define SP_UART_BAUD		host_uart_baud()
+#endif
+
+#ifndef SP_UART_BAUD
+#define SP_UART_BAUD		0
+#endif
+
+// Received bytes waiting to be parsed, a power of two.  Clients keep
+// requests shorter than this unless RTS is wired, see sp_uart.c.
+#ifndef SP_UART_RX_BUFFER
+#define SP_UART_RX_BUFFER	2048
+#endif
+
+// FIFO levels, in bytes, that raise the RX and TX interrupts, and that
+// deassert RTS to pause the sender.
+#define SP_UART_RX_THRESHOLD	64
+#define SP_UART_TX_THRESHOLD	16
+#define SP_UART_RTS_THRESHOLD	112
+
+// Idle bit times after which a partly filled RX FIFO is read anyway.
+#define SP_UART_RX_TIMEOUT		2
+
+// Milliseconds without input after which the client counts as gone: its
+// lease is released and parsing starts over with a fresh head.
+#ifndef SP_UART_IDLE_TIMEOUT
+#define SP_UART_IDLE_TIMEOUT	5000
+#endif
+
+#define SP_UART_TASK_PRIO		USER_TASK_PRIO_2
+
+
+void ICACHE_FLASH_ATTR
+sp_uart_initialize(uint32_t baud);
+
+void ICACHE_FLASH_ATTR
+sp_uart_shutdown();
+
+// Queue a response for sending, false while the previous one is still
+// going out.  The TCP server is told with sp_tcpserver_serial_sent().
+bool ICACHE_FLASH_ATTR
+sp_uart_send(const unsigned char *data, uint16_t length);
+
+// Offer the unparsed input again, once the client is no longer busy.
+void ICACHE_FLASH_ATTR
+sp_uart_resume();
+
+#endif
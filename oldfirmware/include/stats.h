@@ -0,0 +1,165 @@
+/* Performance counters, accumulated since boot or the last reset */
+
+#ifndef _STATS_H__
+#define _STATS_H__
+
+#include <c_types.h>
+
+
+typedef enum {
+	// Words shifted in from the target
+	STATS_WORDS_READ,
+
+	// Words programmed, and those left alone as they already matched
+	STATS_WORDS_WRITTEN,
+	STATS_WORDS_SKIPPED,
+
+	// Entries into programming mode, and address increments to seek
+	STATS_ICSP_RESETS,
+	STATS_INCREMENTS,
+
+	// TCP payload, and espconn_sent calls that had to be retried
+	STATS_BYTES_SENT,
+	STATS_BYTES_RECEIVED,
+	STATS_SEND_RETRIES,
+
+	// Programmed words that read back right
+	STATS_WORDS_VERIFIED,
+
+	STATS_COUNTER_COUNT
+} StatsCounter;
+
+
+// Where the CPU time goes; each cycle is counted in exactly one zone.
+typedef enum {
+	STATS_ZONE_NONE,
+
+	// Clocking commands and data over ICSP, accounted per word written
+	// and per chunk read
+	STATS_ZONE_SHIFT,
+
+	// Waiting for the target, e.g. program cycles and reset timing
+	STATS_ZONE_WAIT,
+
+	// Network callbacks; parsing, copying and sending
+	STATS_ZONE_NETWORK,
+
+	// Command handlers, apart from their ICSP time
+	STATS_ZONE_PROCESS,
+
+	STATS_ZONE_COUNT
+} StatsZone;
+
+
+// Points on the way up from boot, each timed the first time it is reached.
+typedef enum {
+	// Station connected, with an address
+	STATS_MILESTONE_WIFI_READY,
+
+	// First SP response queued to a client
+	STATS_MILESTONE_FIRST_RESPONSE,
+
+	STATS_MILESTONE_COUNT
+} StatsMilestone;
+
+
+// Commands are numbered below this.
+#define STATS_COMMANDS			24
+
+// Latency histogram buckets; the first ends at STATS_BUCKET_BASE
+// microseconds, each following one is 4 times as wide, the last is open.
+#define STATS_BUCKETS			8
+#define STATS_BUCKET_BASE		250
+
+// Job duration histogram; the first bucket ends at STATS_JOB_BUCKET_BASE
+// milliseconds, each following one is twice as wide, the last is open.
+#define STATS_JOB_BUCKETS		9
+#define STATS_JOB_BUCKET_BASE	250
+
+// Seconds between checks for the wrap of the microsecond clock.
+#define STATS_UPTIME_INTERVAL	60
+
+
+// Jobs that ended, and how long they took: background reads, WRITEBIN,
+// BATCH and webadmin uploads.
+typedef struct {
+	uint32_t completed;
+	uint32_t failed;
+	uint32_t durations[STATS_JOB_BUCKETS];
+	uint64_t totalMs;
+} StatsJobs;
+
+
+// Length of the serialized counters, see stats_serialize().
+#define STATS_SERIALIZED_SIZE	(17 + STATS_COUNTER_COUNT * 4 + \
+		(STATS_ZONE_COUNT - 1) * 8 + STATS_COMMANDS * STATS_BUCKETS * 2)
+
+
+// Xtensa cycle counter, simulated by the host build.
+#ifdef HOST_BUILD
+#include <host.h>
+#define stats_ccount	host_ccount
+#else
+static inline uint32_t stats_ccount() {
+	uint32_t ccount;
+	__asm__ __volatile__("rsr %0, ccount" : "=a"(ccount));
+	return ccount;
+}
+#endif
+
+
+ICACHE_FLASH_ATTR
+void stats_count(StatsCounter counter, uint32_t amount);
+
+// Switch the CPU time accounting to a zone, returns the zone to go back to.
+ICACHE_FLASH_ATTR
+StatsZone stats_enter(StatsZone zone);
+
+ICACHE_FLASH_ATTR
+void stats_leave(StatsZone previous);
+
+ICACHE_FLASH_ATTR
+void stats_latency(uint8_t command, uint32_t us);
+
+ICACHE_FLASH_ATTR
+void stats_job(bool ok, uint32_t us);
+
+ICACHE_FLASH_ATTR
+void stats_sample_heap();
+
+ICACHE_FLASH_ATTR
+uint32_t stats_counter(StatsCounter counter);
+
+ICACHE_FLASH_ATTR
+uint32_t stats_heap_min();
+
+ICACHE_FLASH_ATTR
+const StatsJobs * stats_jobs();
+
+// Seconds since boot, unaffected by stats_reset().
+ICACHE_FLASH_ATTR
+uint32_t stats_uptime();
+
+ICACHE_FLASH_ATTR
+void stats_milestone(StatsMilestone milestone);
+
+ICACHE_FLASH_ATTR
+bool stats_milestone_reached(StatsMilestone milestone);
+
+// Milliseconds from boot to the milestone, once reached.
+ICACHE_FLASH_ATTR
+uint32_t stats_milestone_ms(StatsMilestone milestone);
+
+ICACHE_FLASH_ATTR
+const char * stats_milestone_name(StatsMilestone milestone);
+
+ICACHE_FLASH_ATTR
+uint16_t stats_serialize(char *buffer);
+
+ICACHE_FLASH_ATTR
+void stats_reset();
+
+ICACHE_FLASH_ATTR
+void stats_initialize();
+
+#endif
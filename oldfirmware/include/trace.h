@@ -0,0 +1,73 @@
+/* Begin/end trace points recorded into a RAM ring buffer */
+
+#ifndef _TRACE_H__
+#define _TRACE_H__
+
+#include <c_types.h>
+
+
+// Events kept in RAM, 8 bytes each.  Zero compiles the trace points out.
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS		512
+#endif
+
+// Most events returned by one TRACE command.
+#define TRACE_CHUNK			64
+#define TRACE_EVENT_SIZE	8
+
+
+// Trace points, grouped into categories by the high nibble.  Each
+// category can be switched off at runtime, see trace_set_mask().
+typedef enum {
+	// TCP server: receive callback, request parsing, espconn_sent and
+	// the sent callback
+	TRACE_RECEIVE = 0x10,
+	TRACE_PARSE,
+	TRACE_SEND,
+	TRACE_SENT,
+
+	// Command dispatch and background job slices
+	TRACE_DISPATCH = 0x20,
+	TRACE_JOB_STEP,
+
+	// High voltage programming mode and program cycles
+	TRACE_HVP = 0x30,
+	TRACE_WAIT,
+
+	// ICSP transfers, a word written or a chunk of words read
+	TRACE_WRITE = 0x40,
+	TRACE_READ,
+} TraceEvent;
+
+#define TRACE_CATEGORY(event)	((event) >> 4)
+#define TRACE_MASK_ALL			0xFF
+
+
+typedef enum {
+	TRACE_PHASE_BEGIN,
+	TRACE_PHASE_END,
+	TRACE_PHASE_INSTANT
+} TracePhase;
+
+
+#if TRACE_EVENTS
+#define TRACE_BEGIN(event, arg)		trace_record(event, TRACE_PHASE_BEGIN, arg)
+#define TRACE_END(event, arg)		trace_record(event, TRACE_PHASE_END, arg)
+#define TRACE_INSTANT(event, arg)	trace_record(event, TRACE_PHASE_INSTANT, arg)
+#else
+#define TRACE_BEGIN(event, arg)		do {} while (0)
+#define TRACE_END(event, arg)		do {} while (0)
+#define TRACE_INSTANT(event, arg)	do {} while (0)
+#endif
+
+
+ICACHE_FLASH_ATTR
+void trace_record(uint8_t event, uint8_t phase, uint16_t arg);
+
+ICACHE_FLASH_ATTR
+void trace_set_mask(uint8_t mask);
+
+ICACHE_FLASH_ATTR
+uint16_t trace_read(uint32_t *position, char *buffer, uint16_t count);
+
+#endif
@@ -5,6 +5,15 @@
 #define WA_HTTPSERVER_PORT 80
 #define WA_OK 0
 
+// Piece of a response sent at a time.
+#define WA_CHUNK 256
+
+// Responses being sent at once, e.g. a page and its /config.
+#define WA_MAX_RESPONSES 3
+
+// Milliseconds to wait before retrying a rejected espconn_sent.
+#define WA_RETRY_INTERVAL 10
+
 
 typedef enum httpverb {
 	GET,
@@ -13,6 +22,7 @@ typedef enum httpverb {
 
 typedef struct request {
 	HTTPVerb verb;
+	char *path;
 	char *body;
 	uint16_t body_length;
 } Request;
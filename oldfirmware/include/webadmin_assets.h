@@ -0,0 +1,20 @@
+/* Static webadmin pages, gzipped into flash by webadmin/assets.py */
+
+#ifndef _WEBADMIN_ASSETS_H__
+#define _WEBADMIN_ASSETS_H__
+
+#include <c_types.h>
+
+
+// A complete response, head and gzipped body, in flash.  Read it with
+// aligned 32-bit loads only.
+typedef struct {
+	const char *path;
+	const uint8_t *data;
+	uint16_t length;
+} WAAsset;
+
+// Terminated by an entry with a NULL path.
+extern const WAAsset webadmin_assets[];
+
+#endif
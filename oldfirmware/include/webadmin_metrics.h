@@ -0,0 +1,17 @@
+/* Prometheus text exposition of the programmer's metrics */
+
+#ifndef _WEBADMIN_METRICS_H__
+#define _WEBADMIN_METRICS_H__
+
+#include <c_types.h>
+
+
+// Longest single line of the exposition.
+#define WA_METRICS_LINE		128
+
+
+ICACHE_FLASH_ATTR
+uint16_t webadmin_metrics_render(uint16_t *position, char *buffer, 
+		uint16_t size);
+
+#endif
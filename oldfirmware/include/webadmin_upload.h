@@ -0,0 +1,50 @@
+/* Program upload through webadmin, Intel HEX or raw binary */
+
+#ifndef _WEBADMIN_UPLOAD_H__
+#define _WEBADMIN_UPLOAD_H__
+
+#include "sp.h"
+
+#include <c_types.h>
+#include <ip_addr.h>
+#include <espconn.h>
+
+
+// Received body kept while it is programmed, one full segment.
+#define WA_UPLOAD_BUFFER		1460
+
+// Words programmed per run, requests are served in between.
+#define WA_UPLOAD_SLICE			16
+
+// Milliseconds between two runs, 0 for as soon as the system is idle.
+#define WA_UPLOAD_INTERVAL		0
+
+// Outcomes besides the SP errors of the programming path.
+#define WA_UPLOAD_ERR_SYNTAX	0x20
+#define WA_UPLOAD_ERR_CHECKSUM	0x21
+#define WA_UPLOAD_ERR_TRUNCATED	0x22
+
+
+// Called once the upload on conn is programmed, or failed.
+typedef void (*WAUploadCallback)(struct espconn *conn, bool ok);
+
+ICACHE_FLASH_ATTR
+SPError webadmin_upload_begin(struct espconn *conn, uint32_t length,
+		WAUploadCallback done);
+
+ICACHE_FLASH_ATTR
+void webadmin_upload_receive(const char *data, uint16_t length);
+
+// Whether body segments on conn belong to the upload.
+ICACHE_FLASH_ATTR
+bool webadmin_upload_owns(struct espconn *conn);
+
+ICACHE_FLASH_ATTR
+void webadmin_upload_disconnected(struct espconn *conn);
+
+// State of the last upload as a form, see webadmin/upload.html.
+ICACHE_FLASH_ATTR
+uint16_t webadmin_upload_render(uint16_t *position, char *buffer,
+		uint16_t size);
+
+#endif
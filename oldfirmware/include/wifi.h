@@ -9,18 +9,31 @@
 #define WIFI_SOFTAP_PSK			"esp-8266"
 #define WIFI_VERBOSE			false
 
+// Milliseconds between two calls of the tick callback while connected.
+#define WIFI_TICK_INTERVAL		2000
+
+// RTC memory block of the fast connect cache, the first one for users.
+#define WIFI_RTC_BLOCK			64
+#define WIFI_CACHE_VALID		0x01
+
 typedef void (*WifiCallback)(uint8_t);
 typedef void (*TickCallback)(uint32_t);
 
 void ICACHE_FLASH_ATTR 
 wifi_initialize(const char *device_name, WifiCallback cb, TickCallback tcb);
 
+/*
+ * Kept in RTC memory over a reset: the last lease, and the AP and channel
+ * it came from, for the station config with the given hash.
+ */
 struct dhcp_client_info {
 	ip_addr_t ip_addr;
 	ip_addr_t netmask;
 	ip_addr_t gw;
 	uint8 flag;
-	uint8 pad[3];
+	uint8 channel;
+	uint8 bssid[6];
+	uint32 config;
 };
 
 
@@ -0,0 +1,184 @@
+/* 
+ * Leveled logging into a RAM ring buffer.
+ *
+ * Writing a message only formats it into the ring; nothing waits on the
+ * UART.  A low-priority task drains the ring to UART0 as long as the TX
+ * FIFO has room, so logging from the ICSP and network paths costs a
+ * format and a copy.  The last LOG_BUFFER_SIZE bytes stay readable, e.g.
+ * over SP, after they went out on the UART.
+ */
+
+#include "log.h"
+
+#include <c_types.h>
+#include <stdarg.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <user_interface.h>
+#include <driver/uart.h>
+#include <driver/uart_register.h>
+
+
+// ROM function, not declared by the SDK headers.
+int ets_vsnprintf(char *str, size_t size, const char *format, va_list arg);
+
+#define UART_TX_FIFO_SIZE	128
+
+
+static const char level_names[] = "-EWID";
+
+static char ring[LOG_BUFFER_SIZE];
+
+// Bytes ever written and ever sent to the UART; the ring holds the bytes
+// between written - LOG_BUFFER_SIZE and written.
+static uint32_t written;
+static uint32_t drained;
+static uint32_t dropped;
+static bool draining;
+
+// Set once UART0 carries something else, e.g. SP, the ring is kept only.
+static bool detached;
+
+static os_event_t log_queue[1];
+static ETSTimer log_drain_timer;
+
+
+// Format strings live in flash, which only takes aligned 32-bit reads.
+static ICACHE_FLASH_ATTR
+void _copy_format(char *buffer, const char *format, uint16_t size) {
+	const uint32_t *source = (const uint32_t *)((size_t)format & ~3);
+	uint8_t shift = ((size_t)format & 3) * 8;
+	uint32_t word = *source++ >> shift;
+	uint16_t i;
+
+	for (i = 0; i < size - 1; i++) {
+		buffer[i] = word & 0xFF;
+		if (buffer[i] == 0) {
+			return;
+		}
+		shift += 8;
+		if (shift == 32) {
+			word = *source++;
+			shift = 0;
+		}
+		else {
+			word >>= 8;
+		}
+	}
+	buffer[i] = 0;
+}
+
+
+static ICACHE_FLASH_ATTR
+void _put(const char *data, uint16_t length) {
+	uint16_t i;
+	for (i = 0; i < length; i++) {
+		ring[written++ % LOG_BUFFER_SIZE] = data[i];
+	}
+	if (written - drained > LOG_BUFFER_SIZE) {
+		// The UART fell a whole ring behind, skip what was overwritten.
+		dropped += written - drained - LOG_BUFFER_SIZE;
+		drained = written - LOG_BUFFER_SIZE;
+	}
+}
+
+
+static ICACHE_FLASH_ATTR
+void _post() {
+	system_os_post(LOG_TASK_PRIO, 0, 0);
+}
+
+
+// Feed the UART FIFO without waiting, come back later for the rest.
+static ICACHE_FLASH_ATTR
+void _drain(os_event_t *event) {
+	uint16_t room = UART_TX_FIFO_SIZE - ((READ_PERI_REG(UART_STATUS(UART0)) 
+			>> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT);
+
+	if (detached) {
+		drained = written;
+	}
+	while (room > 0 && drained != written) {
+		WRITE_PERI_REG(UART_FIFO(UART0), ring[drained++ % LOG_BUFFER_SIZE]);
+		room--;
+	}
+	if (drained == written) {
+		draining = false;
+		return;
+	}
+	os_timer_disarm(&log_drain_timer);
+	os_timer_setfn(&log_drain_timer, (os_timer_func_t *)_post, NULL);
+	os_timer_arm(&log_drain_timer, LOG_DRAIN_INTERVAL, 0);
+}
+
+
+ICACHE_FLASH_ATTR
+void log_write(uint8_t level, const char *format, ...) {
+	char fmt[LOG_LINE_SIZE];
+	char line[LOG_LINE_SIZE];
+	int length;
+	va_list args;
+
+	_copy_format(fmt, format, sizeof(fmt));
+	line[0] = level_names[level];
+	line[1] = ' ';
+	va_start(args, format);
+	length = ets_vsnprintf(line + 2, sizeof(line) - 4, fmt, args);
+	va_end(args);
+	if (length < 0) {
+		return;
+	}
+	length += 2;
+	if (length > sizeof(line) - 3) {
+		// Truncated, up to the NUL that ets_vsnprintf put last.
+		length = sizeof(line) - 3;
+	}
+	line[length++] = '\r';
+	line[length++] = '\n';
+	_put(line, length);
+
+	if (!draining) {
+		draining = true;
+		_post();
+	}
+}
+
+
+// Copy out retained history from the given position on, oldest first.
+// Positions count bytes ever written; one that was overwritten already
+// moves up to the oldest byte still held.
+ICACHE_FLASH_ATTR
+uint16_t log_read(uint32_t *position, char *buffer, uint16_t size) {
+	uint32_t oldest = written > LOG_BUFFER_SIZE ? 
+		written - LOG_BUFFER_SIZE : 0;
+	uint32_t cursor;
+	uint16_t length = 0;
+
+	if (*position < oldest || *position > written) {
+		*position = oldest;
+	}
+	cursor = *position;
+	while (cursor != written && length < size) {
+		buffer[length++] = ring[cursor++ % LOG_BUFFER_SIZE];
+	}
+	return length;
+}
+
+
+ICACHE_FLASH_ATTR
+uint32_t log_dropped() {
+	return dropped;
+}
+
+
+// Stop writing to UART0 for good, the history stays readable over SP.
+ICACHE_FLASH_ATTR
+void log_detach_uart() {
+	detached = true;
+}
+
+
+ICACHE_FLASH_ATTR
+void log_initialize() {
+	system_os_task(_drain, LOG_TASK_PRIO, log_queue, 1);
+}
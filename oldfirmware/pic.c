@@ -1,27 +1,105 @@
+#include "pic.h"
+#include "pic_cache.h"
 #include "pic_io.h"
 #include "pic_devices.h"
 #include "sp.h"
+#include "sp_tcpserver.h"
+#include "sp_job.h"
+#include "bigendian.h"
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <c_types.h>
 #include <mem.h>
+#include <user_interface.h>
 
 
 static int _state;
-static uint64_t _program_counter; 
+static uint16_t _program_counter; 
+static bool _session = false;
+
+// Outcome of the last detection, so it can be reported without ICSP.
+static int _detectedIndex = -1;
+static uint32_t _detectedId = 0;
+
+
+// Memory regions of a device.
+#define REGION_PROGRAM      0
+#define REGION_CONFIG       1
+#define REGION_DATA         2
+#define REGION_RESERVED     3
+#define REGION_COUNT        4
+
+
+// Everything needed to address a word of a region.  Bounds are flat
+// addresses and fit in 16 bits, so the per-word paths stay in native 32-bit
+// arithmetic on the Xtensa core.
+struct picRegion {
+    uint16_t start;         // First flat address.
+    uint16_t end;           // Last flat address (inclusive).
+    uint16_t mask;          // Valid bits of a word.
+    uint8_t state;          // ICSP state needed to address the region.
+    uint8_t readCommand;    // Reads the word at the PC.
+    uint8_t loadCommand;    // Loads the word at the PC for programming.
+    uint8_t flashType;      // Type of flash backing the region.
+};
 
 
 // Flat address ranges for the various memory spaces.  Defaults to the values
 // for the PIC16F628A.  "DEVICE" command updates to the correct values later.
-static uint64_t programEnd			 = 0x07FF;
-static uint64_t configStart  		 = 0x2000;
-static uint64_t configEnd    		 = 0x2007;
-static uint64_t dataStart    		 = 0x2100;
-static uint64_t dataEnd      		 = 0x217F;
-static uint64_t reservedStart		 = 0x0800;
-static uint64_t reservedEnd  		 = 0x07FF;
-static uint32_t configSave   		 = 0x0000;
-static uint8_t progFlashType		= FLASH4;
-static uint8_t dataFlashType		= EEPROM;
+static const struct picRegion defaultRegions[REGION_COUNT] = {
+    {0x0000, 0x07FF, 0x3FFF, STATE_PROGRAM, CMD_READ_PROGRAM_MEMORY,
+        CMD_LOAD_PROGRAM_MEMORY, FLASH4},
+    {0x2000, 0x2007, 0x3FFF, STATE_CONFIG, CMD_READ_PROGRAM_MEMORY,
+        CMD_LOAD_PROGRAM_MEMORY, FLASH4},
+    {0x2100, 0x217F, 0x00FF, STATE_PROGRAM, CMD_READ_DATA_MEMORY,
+        CMD_LOAD_DATA_MEMORY, EEPROM},
+    {0x0800, 0x07FF, 0x3FFF, STATE_PROGRAM, CMD_READ_PROGRAM_MEMORY,
+        CMD_LOAD_PROGRAM_MEMORY, FLASH4},
+};
+static struct picRegion regions[REGION_COUNT];
+static uint16_t configSave = 0x0000;
+
+
+// Reset the regions to the defaults until a device is detected.
+static ICACHE_FLASH_ATTR
+void _reset_regions() {
+    os_memcpy(regions, defaultRegions, sizeof(regions));
+    configSave = 0x0000;
+}
+
+
+// Find the region a flat address belongs to.  Anything outside the config
+// and data ranges is addressed as program memory.
+static ICACHE_FLASH_ATTR
+const struct picRegion *_find_region(uint32_t addr) {
+    const struct picRegion *region = &regions[REGION_DATA];
+    if (addr >= region->start && addr <= region->end)
+        return region;
+    region = &regions[REGION_CONFIG];
+    if (addr >= region->start && addr <= region->end)
+        return region;
+    return &regions[REGION_PROGRAM];
+}
+
+
+// Whether every address from start to end is in one of the regions.  The
+// offsets within a region fit the 16 bits the PC is set with.
+static ICACHE_FLASH_ATTR
+bool _range_valid(uint32_t start, uint32_t end) {
+    const struct picRegion *region;
+    if (end < start)
+        return false;
+    for (;;) {
+        region = _find_region(start);
+        if (start < region->start || start > region->end)
+            return false;
+        if (end <= region->end)
+            return true;
+        start = region->end + 1;
+    }
+}
 
 
 // Enter high voltage programming mode.
@@ -30,6 +108,8 @@ void _enter_program_mode() {
     // Bail out if already in programming mode.
     if (_state != STATE_IDLE)
         return;
+    StatsZone previous = stats_enter(STATS_ZONE_WAIT);
+    TRACE_BEGIN(TRACE_HVP, 0);
     // Lower MCLR, VDD, DATA, and CLOCK initially.  This will put the
     // PIC into the powered-off, reset state just in case.
     GPIO_SET(MCLR_NUM, MCLR_RESET);
@@ -49,6 +129,8 @@ void _enter_program_mode() {
     // Now in program mode, starting at the first word of program memory.
     _state = STATE_PROGRAM;
     _program_counter = 0;
+    stats_count(STATS_ICSP_RESETS, 1);
+    stats_leave(previous);
 }
 
 
@@ -70,6 +152,16 @@ void _exit_program_mode() {
     // Now in the idle state with the PIC powered off.
     _state = STATE_IDLE;
     _program_counter = 0;
+    TRACE_END(TRACE_HVP, 0);
+}
+
+
+// Leave programming mode at the end of a command, unless a batch is
+// keeping the ICSP session open.
+static ICACHE_FLASH_ATTR
+void _end_command() {
+    if (!_session)
+        _exit_program_mode();
 }
 
 
@@ -142,52 +234,33 @@ uint32_t _send_read_command(uint8_t cmd) {
     }
     GPIO_OUTPUT(DATA_NUM);
     os_delay_us(DELAY_TDLY2);
+    stats_count(STATS_WORDS_READ, 1);
     return data;
 }
 
 
-// Set the program counter to a specific "flat" address.
+// Set the program counter to an offset within a region.
 static ICACHE_FLASH_ATTR
-void _set_program_counter(uint64_t addr) {
-    if (addr >= dataStart && addr <= dataEnd) {
-        // Data memory.
-        addr -= dataStart;
-        if (_state != STATE_PROGRAM || addr < _program_counter) {
-            // Device is off, currently looking at configuration memory,
-            // or the address is further back.  Reset the device.
-            _exit_program_mode();
-            _enter_program_mode();
-        }
-    } else if (addr >= configStart && addr <= configEnd) {
-        // Configuration memory.
-        addr -= configStart;
-        if (_state == STATE_IDLE) {
-            // Enter programming mode and switch to config memory.
-            _enter_program_mode();
-            _send_write_command(CMD_LOAD_CONFIG, 0);
-            _state = STATE_CONFIG;
-        } else if (_state == STATE_PROGRAM) {
-            // Switch from program memory to config memory.
-            _send_write_command(CMD_LOAD_CONFIG, 0);
-            _state = STATE_CONFIG;
-            _program_counter = 0;
-        } else if (addr < _program_counter) {
-            // Need to go backwards in config memory, so reset the device.
-            _exit_program_mode();
-            _enter_program_mode();
+void _set_program_counter(const struct picRegion *region, uint16_t offset) {
+    if (region->state == STATE_CONFIG && _state == STATE_PROGRAM) {
+        // Switch from program memory to config memory.
+        _send_write_command(CMD_LOAD_CONFIG, 0);
+        _state = STATE_CONFIG;
+        _program_counter = 0;
+    } else if (_state != region->state || offset < _program_counter) {
+        // Device is off, looking at the other memory space, or the
+        // address is further back.  Reset the device.
+        _exit_program_mode();
+        _enter_program_mode();
+        if (region->state == STATE_CONFIG) {
             _send_write_command(CMD_LOAD_CONFIG, 0);
             _state = STATE_CONFIG;
         }
-    } else {
-        // Program memory.
-        if (_state != STATE_PROGRAM || addr < _program_counter) {
-            // Device is off, currently looking at configuration memory,
-            // or the address is further back.  Reset the device.
-            _exit_program_mode();
-            _enter_program_mode();
-        }
     }
-    while (_program_counter < addr) {
+    if (_program_counter < offset) {
+        stats_count(STATS_INCREMENTS, offset - _program_counter);
+    }
+    while (_program_counter < offset) {
         _send_simple_command(CMD_INCREMENT_ADDRESS);
         ++_program_counter;
     }
@@ -207,15 +280,120 @@ void _set_erase_program_counter() {
 }
 
 
-// Read a word from memory (program, config, or data depending upon addr).
+// Read a word at an offset within a region.
 // The start and stop bits will be stripped from the raw value from the PIC.
 static ICACHE_FLASH_ATTR
-uint32_t _read_word(uint64_t addr) {
-    _set_program_counter(addr);
-    if (addr >= dataStart && addr <= dataEnd)
-        return (_send_read_command(CMD_READ_DATA_MEMORY) >> 1) & 0x00FF;
-    else
-        return (_send_read_command(CMD_READ_PROGRAM_MEMORY) >> 1) & 0x3FFF;
+uint32_t _read_region_word(const struct picRegion *region, uint16_t offset) {
+    _set_program_counter(region, offset);
+    return (_send_read_command(region->readCommand) >> 1) & region->mask;
+}
+
+
+// Read a word from memory (program, config, or data depending upon addr).
+static ICACHE_FLASH_ATTR
+uint32_t _read_word(uint32_t addr) {
+    const struct picRegion *region = _find_region(addr);
+    return _read_region_word(region, addr - region->start);
+}
+
+
+// Read a word through the shadow cache, only touching the ICSP bus on a miss.
+static ICACHE_FLASH_ATTR
+uint32_t _read_cached_word(const struct picRegion *region, uint32_t addr) {
+    uint32_t word;
+    if (pic_cache_lookup(addr, &word))
+        return word;
+    word = _read_region_word(region, addr - region->start);
+    pic_cache_store(addr, word);
+    return word;
+}
+
+
+// Start a programming cycle for the word loaded at the current PC and wait
+// for it to complete.  The command and delay depend on the flash type.
+static ICACHE_FLASH_ATTR
+void _begin_program_cycle(const struct picRegion *region) {
+    StatsZone previous = stats_enter(STATS_ZONE_WAIT);
+    TRACE_BEGIN(TRACE_WAIT, region->flashType);
+    switch (region->flashType) {
+    case FLASH:
+    case EEPROM:
+        _send_simple_command(CMD_BEGIN_PROGRAM);
+        os_delay_us(region == &regions[REGION_DATA] ? 
+                DELAY_TDPROG : DELAY_TPROG + DELAY_TERA);
+        break;
+    case FLASH4:
+        _send_simple_command(CMD_BEGIN_PROGRAM);
+        os_delay_us(DELAY_TPROG);
+        break;
+    case FLASH5:
+        _send_simple_command(CMD_BEGIN_PROGRAM_ONLY);
+        os_delay_us(DELAY_TPROG5);
+        _send_simple_command(CMD_END_PROGRAM_ONLY);
+        break;
+    }
+    TRACE_END(TRACE_WAIT, region->flashType);
+    stats_leave(previous);
+}
+
+
+// Program a word at a flat address within a region and verify it.  Its
+// ICSP time is accounted as a whole, the program cycle as a wait.
+static ICACHE_FLASH_ATTR
+bool _write_word(const struct picRegion *region, uint32_t addr, 
+        uint32_t word) {
+    uint16_t offset = addr - region->start;
+    uint32_t current;
+    StatsZone previous = stats_enter(STATS_ZONE_SHIFT);
+    TRACE_BEGIN(TRACE_WRITE, offset);
+    word &= region->mask;
+    if (region == &regions[REGION_CONFIG] && offset == DEV_CONFIG_WORD && 
+            configSave != 0) {
+        // Preserve bits from the current config word.
+        word = (word & ~configSave) | 
+            (_read_region_word(region, offset) & configSave);
+    }
+    _set_program_counter(region, offset);
+    _send_write_command(region->loadCommand, word << 1);
+    _begin_program_cycle(region);
+    stats_count(STATS_WORDS_WRITTEN, 1);
+    // Verify, the PC is still pointing at the same location.
+    current = (_send_read_command(region->readCommand) >> 1) & region->mask;
+    pic_cache_store(addr, current);
+    TRACE_END(TRACE_WRITE, offset);
+    stats_leave(previous);
+    if (current != word)
+        return false;
+    stats_count(STATS_WORDS_VERIFIED, 1);
+    return true;
+}
+
+
+// Outcome of a data memory compare-write.
+#define DATA_WRITE_SKIPPED  0
+#define DATA_WRITE_DONE     1
+#define DATA_WRITE_FAILED   2
+
+// Write a byte to data memory unless it already holds that value.  The
+// byte is read back while the PC is positioned, so an unchanged byte costs
+// one read instead of a full DELAY_TDPROG cycle.
+static ICACHE_FLASH_ATTR
+uint8_t _write_data_byte(uint32_t addr, uint8_t value) {
+    const struct picRegion *region = &regions[REGION_DATA];
+    uint32_t current;
+    if (pic_cache_lookup(addr, &current) && current == value) {
+        stats_count(STATS_WORDS_SKIPPED, 1);
+        return DATA_WRITE_SKIPPED;
+    }
+    current = _read_region_word(region, addr - region->start);
+    pic_cache_store(addr, current);
+    if (current == value) {
+        stats_count(STATS_WORDS_SKIPPED, 1);
+        return DATA_WRITE_SKIPPED;
+    }
+    if (!_write_word(region, addr, value))
+        return DATA_WRITE_FAILED;
+    return DATA_WRITE_DONE;
 }
 
 
@@ -225,30 +403,20 @@ uint32_t _read_word(uint64_t addr) {
  * flat address ranges are presently unknown.
  */
 static ICACHE_FLASH_ATTR
-uint32_t _read_config_word(uint64_t addr) {
+uint32_t _read_config_word(uint16_t addr) {
+    return _read_region_word(&regions[REGION_CONFIG], addr);
+}
 
-    if (_state == STATE_IDLE) {
-        // Enter programming mode and switch to config memory.
-        _enter_program_mode();
-        _send_write_command(CMD_LOAD_CONFIG, 0);
-        _state = STATE_CONFIG;
-    } else if (_state == STATE_PROGRAM) {
-        // Switch from program memory to config memory.
-        _send_write_command(CMD_LOAD_CONFIG, 0);
-        _state = STATE_CONFIG;
-        _program_counter = 0;
-    } else if (addr < _program_counter) {
-        // Need to go backwards in config memory, so reset the device.
-        _exit_program_mode();
-        _enter_program_mode();
-        _send_write_command(CMD_LOAD_CONFIG, 0);
-        _state = STATE_CONFIG;
-    }
-    while (_program_counter < addr) {
-        _send_simple_command(CMD_INCREMENT_ADDRESS);
-        _program_counter++;
-    }
-    return (_send_read_command(CMD_READ_PROGRAM_MEMORY) >> 1) & 0x3FFF;
+
+// Drop the shadow cache if a config word read during detection does not
+// match the cached copy, e.g. another chip of the same type was inserted.
+static ICACHE_FLASH_ATTR
+void _check_cached_config_word(uint32_t offset, uint32_t word) {
+    uint32_t cached;
+    uint32_t addr = regions[REGION_CONFIG].start + offset;
+    if (pic_cache_lookup(addr, &cached) && cached != word)
+        pic_cache_invalidate();
+    pic_cache_store(addr, word);
 }
 
 
@@ -256,29 +424,35 @@ uint32_t _read_config_word(uint64_t addr) {
 // print them to the serial port.  Note: "dev" is in PROGMEM.
 ICACHE_FLASH_ATTR
 void _init_device(const struct deviceInfo *dev) {
+    struct picRegion *program = &regions[REGION_PROGRAM];
+    struct picRegion *config = &regions[REGION_CONFIG];
+    struct picRegion *data = &regions[REGION_DATA];
+    struct picRegion *reserved = &regions[REGION_RESERVED];
+
     // Update the global device details.
-    programEnd = dev->programSize - 1;
-    configStart = dev->configStart;
-    configEnd = configStart + dev->configSize - 1;
-    dataStart = dev->dataStart;
-    dataEnd = dataStart + dev->dataSize - 1;
-    reservedStart = programEnd - dev->reservedWords + 1;
-    reservedEnd = programEnd;
+    _reset_regions();
+    program->end = dev->programSize - 1;
+    program->flashType = dev->progFlashType;
+    config->start = dev->configStart;
+    config->end = dev->configStart + dev->configSize - 1;
+    config->flashType = dev->progFlashType;
+    data->start = dev->dataStart;
+    data->end = dev->dataStart + dev->dataSize - 1;
+    data->flashType = dev->dataFlashType;
+    reserved->start = program->end - dev->reservedWords + 1;
+    reserved->end = program->end;
+    reserved->flashType = dev->progFlashType;
     configSave = dev->configSave;
-    progFlashType = dev->progFlashType;
-    dataFlashType = dev->dataFlashType;
 
     // Print the extra device information.
-	os_printf("DeviceName: %s\r\n", dev->name);
-    os_printf("ProgramRange: 0000-%04X\r\n", (uint32_t)programEnd);
-    os_printf("ConfigRange: %04X-%04X\r\n", (uint32_t)configStart, 
-			(uint32_t)configEnd);
-    os_printf("ConfigSave: %02X\r\n", (uint16_t)configSave);
-    os_printf("DataRange: %04X-%04X\r\n", (uint32_t)dataStart, 
-			(uint32_t)dataEnd);
-    if (reservedStart <= reservedEnd) {
-        os_printf("ReservedRange: %04X-%04X\r\n", (uint32_t)reservedStart,
-				(uint32_t)reservedEnd);
+	LOG_DEBUG("DeviceName: %s", dev->name);
+    LOG_DEBUG("ProgramRange: 0000-%04X", program->end);
+    LOG_DEBUG("ConfigRange: %04X-%04X", config->start, config->end);
+    LOG_DEBUG("ConfigSave: %02X", configSave);
+    LOG_DEBUG("DataRange: %04X-%04X", data->start, data->end);
+    if (reserved->start <= reserved->end) {
+        LOG_DEBUG("ReservedRange: %04X-%04X", reserved->start,
+				reserved->end);
     }
 }
 
@@ -288,8 +462,6 @@ ICACHE_FLASH_ATTR
 SPError pic_command_detect_device(const SPPacket *req) {
     // Make sure the device is reset before we start.
     _exit_program_mode();
-	
-	os_printf("Reading configuration...");
 
     // Read identifiers and configuration words from config memory.
     uint32_t userid0 = _read_config_word(DEV_USERID0);
@@ -319,14 +491,15 @@ SPError pic_command_detect_device(const SPPacket *req) {
             ++addr;
         }
         if (!word) {
-            os_printf("ERROR\r\n");
-            _exit_program_mode();
-            return;
+            LOG_INFO("No device in the socket");
+            _detectedIndex = -1;
+            _detectedId = 0;
+            _end_command();
+            return SP_ERR_DEVICE_NOT_DETECTED;
         }
         deviceId = 0;
     }
-    os_printf("OK\r\n");
-    os_printf("DeviceID: %02X\r\n", deviceId);
+    LOG_INFO("DeviceID: %02X", deviceId);
     // Find the device in the built-in list if we have details for it.
     int index = 0;
 
@@ -344,63 +517,356 @@ SPError pic_command_detect_device(const SPPacket *req) {
 		}
         ++index;
     }	
+    _detectedIndex = index;
+    _detectedId = deviceId;
     if (index >= 0) {
         _init_device(&(devices[index]));
+        pic_cache_setup(deviceId, devices[index].programSize,
+                devices[index].configStart, devices[index].configSize,
+                devices[index].dataStart, devices[index].dataSize);
+        _check_cached_config_word(DEV_USERID0, userid0);
+        _check_cached_config_word(DEV_USERID1, userid1);
+        _check_cached_config_word(DEV_USERID2, userid2);
+        _check_cached_config_word(DEV_USERID3, userid3);
+        _check_cached_config_word(DEV_ID, deviceId);
+        _check_cached_config_word(DEV_CONFIG_WORD, configWord);
     } 
 	else {
-		os_printf("No device detected\r\n");
+		LOG_INFO("Unknown device");
+        pic_cache_release();
         // Reset the global parameters to their defaults.  A separate
         // "SETDEVICE" command will be needed to set the correct values.
-        programEnd    = 0x07FF;
-        configStart   = 0x2000;
-        configEnd     = 0x2007;
-        dataStart     = 0x2100;
-        dataEnd       = 0x217F;
-        reservedStart = 0x0800;
-        reservedEnd   = 0x07FF;
-        configSave    = 0x0000;
-        progFlashType = FLASH4;
-        dataFlashType = EEPROM;
-    }
-    os_printf("ConfigWord: %02X\r\n", configWord);
-    os_printf(".\r\n");
+        _reset_regions();
+    }
+    LOG_DEBUG("ConfigWord: %02X", configWord);
     // Don't need programming mode once the details have been read.
-    _exit_program_mode();
+    _end_command();
 
     if (index < 0) {
-		sp_tcpserver_response(SP_ERR_DEVICE_NOT_DETECTED, NULL, 0);
+		// The TCP server responds with the error.
 		return SP_ERR_DEVICE_NOT_DETECTED;
 	}
 	return SP_OK;
 }
 
 
-ICACHE_FLASH_ATTR
-SPError pic_command_read(const SPPacket *req) {
-    uint32_t start = bigendian_deserialize_uint32(req->body);
-    uint32_t end = bigendian_deserialize_uint32(req->body + 8);
-	uint32_t length = end - start;
-    int count = 0;
-    bool activity = true;
-	char *buffer = (char*)os_zalloc(1024);
-    while (start <= end) {
-        uint32_t word = _read_word(start);
-		bigendian_serialize_uint32(buffer + count * 4, word);
-        ++start;
-        ++count;
-        if (count == 256) {
-			sp_tcpserver_response(SP_STATUS_READ_MORE, buffer, 1024);		
-		}
-		if((count % 32) == 0) {
+// State of a READ in progress.  The transfer pauses whenever the TCP
+// server's TX queue is full, and is resumed from its sent callback.  Tagged
+// READs run as a background job instead.
+#define READ_CHUNK_WORDS    256
+
+static struct {
+    uint32_t next;
+    uint32_t end;
+    const struct picRegion *region;
+    bool activity;
+#ifdef PIC_PROFILE
+    uint32_t cycles;
+    uint32_t words;
+#endif
+} readJob;
+static char readBuffer[READ_CHUNK_WORDS * 4];
+
+
+// Read up to max words into readBuffer and send them as one READ_MORE
+// chunk, returns the number of words read or -1 if the chunk could not be
+// sent, e.g. for want of a buffer.
+static ICACHE_FLASH_ATTR
+int _read_chunk(int max) {
+    int count;
+    StatsZone previous = stats_enter(STATS_ZONE_SHIFT);
+    TRACE_BEGIN(TRACE_READ, max);
+    for (count = 0; count < max && readJob.next <= readJob.end; count++) {
+        if (readJob.next > readJob.region->end) {
+            // Crossed into the next memory space.
+            readJob.region = _find_region(readJob.next);
+        }
+#ifdef PIC_PROFILE
+        uint32_t ccount = stats_ccount();
+#endif
+        uint32_t word = _read_cached_word(readJob.region, readJob.next);
+#ifdef PIC_PROFILE
+        readJob.cycles += stats_ccount() - ccount;
+#endif
+        bigendian_serialize_uint32(readBuffer + count * 4, word);
+        ++readJob.next;
+        if (((count + 1) % 32) == 0) {
             // Toggle the activity LED to make it blink during long reads.
-            activity ^= true;
-			GPIO_SET(LED_NUM, activity);
+            readJob.activity ^= true;
+            GPIO_SET(LED_NUM, readJob.activity);
         }
     }
+    TRACE_END(TRACE_READ, count);
+    stats_leave(previous);
+    if (!sp_tcpserver_response(SP_STATUS_READ_MORE, readBuffer, count * 4)) {
+        return -1;
+    }
+    return count;
+}
+
+
+// A cancelled READ, or one whose client went away, leaves the target
+// powered down.
+static ICACHE_FLASH_ATTR
+void _read_abort() {
+    _exit_program_mode();
+}
+
+
+static ICACHE_FLASH_ATTR
+void _read_continue() {
+    while (readJob.next <= readJob.end) {
+        if (!sp_tcpserver_txqueue_available()) {
+            sp_tcpserver_resume_when_available(_read_continue, _read_abort);
+            return;
+        }
+        if (_read_chunk(READ_CHUNK_WORDS) < 0) {
+            // A gap would go unnoticed, end the READ instead.
+            sp_tcpserver_response(SP_ERR_BUSY, NULL, 0);
+            _end_command();
+            return;
+        }
+    }
+    if (!sp_tcpserver_txqueue_available()) {
+        sp_tcpserver_resume_when_available(_read_continue, _read_abort);
+        return;
+    }
+#ifdef PIC_PROFILE
+    if (readJob.words) {
+        LOG_DEBUG("READ: %u words, %u cycles/word", readJob.words, 
+                readJob.cycles / readJob.words);
+    }
+#endif
 	sp_tcpserver_response(SP_STATUS_READ_DONE, NULL, 0);		
+    _end_command();
+}
+
+
+// Job step of a tagged READ, one slice per call.
+static ICACHE_FLASH_ATTR
+SPError _read_step(uint32_t *done, bool *finished) {
+    int count = _read_chunk(SP_JOB_SLICE);
+    if (count < 0) {
+        return SP_ERR_BUSY;
+    }
+    *done += count;
+    if (readJob.next > readJob.end) {
+        _end_command();
+        *finished = true;
+    }
+    return SP_OK;
+}
+
+
+/*
+ * READ command.
+ * Body: flat start address (uint32), unused (uint32), end address (uint32).
+ * Response: READ_MORE chunks of words (uint32 each), then READ_DONE.  When
+ * tagged, the read runs as a cancellable job and ends with its final frame.
+ */
+ICACHE_FLASH_ATTR
+SPError pic_command_read(const SPPacket *req) {
+    if (req->head.body_length < 12) {
+        return SP_ERR_REQ_LEN;
+    }
+    readJob.next = bigendian_deserialize_uint32(req->body);
+    readJob.end = bigendian_deserialize_uint32(req->body + 8);
+    if (!_range_valid(readJob.next, readJob.end)) {
+        return SP_ERR_ADDRESS_RANGE;
+    }
+    readJob.region = _find_region(readJob.next);
+    readJob.activity = true;
+#ifdef PIC_PROFILE
+    readJob.cycles = 0;
+    readJob.words = readJob.end - readJob.next + 1;
+#endif
+    if (req->head.tagged) {
+        return sp_job_start(req->head.tag, readJob.end - readJob.next + 1,
+                _read_step, _read_abort);
+    }
+    _read_continue();
 	return SP_OK;
 }
 
+/*
+ * WRITE_DATA command.
+ * Body: flat start address (uint32) followed by one byte per location.
+ * Response: number of bytes written and skipped (uint32 each).
+ */
+ICACHE_FLASH_ATTR
+SPError pic_command_write_data(const SPPacket *req) {
+    char response[8];
+    uint32_t written = 0;
+    uint32_t skipped = 0;
+    uint32_t count;
+    uint32_t addr;
+    uint32_t end;
+    uint32_t i;
+
+    if (req->head.body_length <= 4) {
+        return SP_ERR_REQ_LEN;
+    }
+    addr = bigendian_deserialize_uint32(req->body);
+    count = req->head.body_length - 4;
+    // The last address must not wrap around past the top.
+    if (count - 1 > 0xFFFFFFFF - addr) {
+        return SP_ERR_ADDRESS_RANGE;
+    }
+    end = addr + count - 1;
+    if (!_range_valid(addr, end) || addr < regions[REGION_DATA].start ||
+            end > regions[REGION_DATA].end) {
+        return SP_ERR_ADDRESS_RANGE;
+    }
+
+    for (i = 0; i < count; i++) {
+        switch (_write_data_byte(addr + i, req->body[4 + i])) {
+            case DATA_WRITE_SKIPPED:
+                skipped++;
+                break;
+            case DATA_WRITE_DONE:
+                written++;
+                break;
+            default:
+                _end_command();
+                return SP_ERR_WRITE_FAILED;
+        }
+    }
+    _end_command();
+
+    bigendian_serialize_uint32(response, written);
+    bigendian_serialize_uint32(response + 4, skipped);
+    sp_tcpserver_response(SP_OK, response, 8);
+    return SP_OK;
+}
+
+// State of a WRITEBIN upload.  Words are programmed as the body streams
+// in, so the image is never buffered whole.
+static struct {
+    unsigned char address[4];
+    uint32_t addr;
+    uint32_t count;
+    const struct picRegion *region;
+    uint8_t high;           // First byte of a word split across segments.
+    bool activity;
+    uint32_t started;
+} writeJob;
+
+
+// Account a WRITEBIN as a job, unless it is a step of a batch, which is
+// accounted as a whole.
+static ICACHE_FLASH_ATTR
+void _write_done(bool ok) {
+    if (!_session)
+        stats_job(ok, system_get_time() - writeJob.started);
+}
+
+
+/*
+ * WRITEBIN body consumer.
+ * Body: flat start address (uint32) followed by big-endian 16 bit words,
+ * all within the same memory space.
+ */
+ICACHE_FLASH_ATTR
+SPError pic_stream_write_binary(const SPPacketHead *head, uint32_t offset,
+        const char *chunk, uint16_t length) {
+    uint16_t i;
+    if (offset == 0 && (head->body_length < 4 || (head->body_length & 1))) {
+        return SP_ERR_REQ_LEN;
+    }
+    if (offset == 0 && sp_job_running()) {
+        return SP_ERR_BUSY;
+    }
+    for (i = 0; i < length; i++, offset++) {
+        if (offset < 4) {
+            writeJob.address[offset] = chunk[i];
+            if (offset == 3) {
+                writeJob.addr = bigendian_deserialize_uint32(writeJob.address);
+                writeJob.region = _find_region(writeJob.addr);
+                writeJob.count = 0;
+                writeJob.activity = true;
+                writeJob.started = system_get_time();
+            }
+            continue;
+        }
+        if ((offset & 1) == 0) {
+            writeJob.high = chunk[i];
+            continue;
+        }
+        if (writeJob.addr < writeJob.region->start || 
+                writeJob.addr > writeJob.region->end) {
+            _end_command();
+            _write_done(false);
+            return SP_ERR_ADDRESS_RANGE;
+        }
+        if (!_write_word(writeJob.region, writeJob.addr, 
+                    (writeJob.high << 8) | (uint8_t)chunk[i])) {
+            _end_command();
+            _write_done(false);
+            return SP_ERR_WRITE_FAILED;
+        }
+        ++writeJob.addr;
+        ++writeJob.count;
+        if ((writeJob.count % 24) == 0) {
+            // Toggle the activity LED to make it blink during long writes.
+            writeJob.activity ^= true;
+            GPIO_SET(LED_NUM, writeJob.activity);
+            // Streamed bodies come in slices, but a batch step is
+            // written in one go.
+            system_soft_wdt_feed();
+        }
+    }
+    return SP_OK;
+}
+
+
+// WRITEBIN command, called once the whole body has been consumed.
+ICACHE_FLASH_ATTR
+SPError pic_command_write_binary(const SPPacket *req) {
+    char response[4];
+    _end_command();
+    _write_done(true);
+    bigendian_serialize_uint32(response, writeJob.count);
+    sp_tcpserver_response(SP_OK, response, 4);
+    return SP_OK;
+}
+
+
+/*
+ * Program a word at a flat address and verify it, for images that do not
+ * come over SP.  The target stays in programming mode until
+ * pic_write_end().
+ */
+ICACHE_FLASH_ATTR
+SPError pic_write_word(uint32_t addr, uint16_t word) {
+    const struct picRegion *region = _find_region(addr);
+    if (addr < region->start || addr > region->end) {
+        return SP_ERR_ADDRESS_RANGE;
+    }
+    if (!_write_word(region, addr, word)) {
+        return SP_ERR_WRITE_FAILED;
+    }
+    return SP_OK;
+}
+
+
+ICACHE_FLASH_ATTR
+void pic_write_end() {
+    _end_command();
+}
+
+
+// PWROFF command.
+ICACHE_FLASH_ATTR
+SPError pic_command_power_off(const SPPacket *req) {
+    _exit_program_mode();
+    // Whatever is in the socket next time may be a different chip.
+    pic_cache_invalidate();
+    _detectedIndex = -1;
+    _detectedId = 0;
+	sp_tcpserver_response(SP_OK, NULL, 0);
+    return SP_OK;
+}
+
 /*
 // READBIN command.
 void cmdReadBinary(const char *args)
@@ -628,8 +1094,34 @@ void cmdWriteBinary(const char *args)
 } 
  */
 
+// Keep the target in programming mode across commands, until the
+// session ends.
+ICACHE_FLASH_ATTR
+void pic_session_begin() {
+    _session = true;
+}
+
+
+ICACHE_FLASH_ATTR
+void pic_session_end() {
+    _session = false;
+    _exit_program_mode();
+}
+
+
+ICACHE_FLASH_ATTR
+const char * pic_detected_device(uint32_t *deviceId) {
+    *deviceId = _detectedId;
+    if (_detectedIndex < 0) {
+        return NULL;
+    }
+    return (const char *)devices[_detectedIndex].name;
+}
+
+
 ICACHE_FLASH_ATTR
 void pic_initialize() {
+    _reset_regions();
 	PIN_FUNC_SELECT(DATA_MUX, DATA_FUNC);
 	PIN_PULLUP_EN(DATA_MUX);
 	GPIO_OUTPUT(DATA_NUM);
@@ -638,6 +1130,7 @@ void pic_initialize() {
 
 ICACHE_FLASH_ATTR
 void pic_shutdown() {
-	// Do nothing here for now
+    _exit_program_mode();
+    pic_cache_release();
 }
 
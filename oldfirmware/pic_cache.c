@@ -0,0 +1,129 @@
+/* 
+ * Shadow cache of the target chip contents.
+ *
+ * Words are recorded as they are read or written during a session, so
+ * repeated reads of the same range are served without touching the ICSP
+ * bus.  The cache is dropped on power-off and whenever detection reports a
+ * different device ID.
+ */
+
+#include "pic_cache.h"
+#include "log.h"
+
+#include <c_types.h>
+#include <mem.h>
+#include <osapi.h>
+
+
+static uint32_t cacheDeviceId = 0;
+static uint32_t cacheProgramSize = 0;
+static uint32_t cacheConfigStart = 0;
+static uint16_t cacheConfigSize = 0;
+static uint32_t cacheDataStart = 0;
+static uint16_t cacheDataSize = 0;
+static uint32_t cacheWords = 0;
+
+// One slot per cacheable word: program, then config, then data memory.
+static uint16_t *cacheData = NULL;
+static uint8_t *cacheValid = NULL;
+
+
+// Map a flat address to a cache slot, -1 if it is not cacheable.
+static ICACHE_FLASH_ATTR
+int32_t _slot(uint32_t addr) {
+	if (addr < cacheProgramSize) {
+		return addr;
+	}
+	if (addr >= cacheConfigStart && addr < cacheConfigStart + cacheConfigSize) {
+		return cacheProgramSize + addr - cacheConfigStart;
+	}
+	if (addr >= cacheDataStart && addr < cacheDataStart + cacheDataSize) {
+		return cacheProgramSize + cacheConfigSize + addr - cacheDataStart;
+	}
+	return -1;
+}
+
+
+ICACHE_FLASH_ATTR
+bool pic_cache_setup(uint32_t deviceId, uint32_t programSize,
+		uint32_t configStart, uint16_t configSize, 
+		uint32_t dataStart, uint16_t dataSize) {
+	uint32_t words = programSize + configSize + dataSize;
+
+	if (cacheData != NULL && deviceId == cacheDeviceId && 
+			words == cacheWords) {
+		// Same chip as before, keep what we already know.
+		return true;
+	}
+
+	pic_cache_release();
+	cacheData = (uint16_t*) os_zalloc(words * sizeof(uint16_t));
+	cacheValid = (uint8_t*) os_zalloc((words + 7) / 8);
+	if (cacheData == NULL || cacheValid == NULL) {
+		LOG_WARN("Cannot allocate shadow cache");
+		pic_cache_release();
+		return false;
+	}
+
+	cacheDeviceId = deviceId;
+	cacheProgramSize = programSize;
+	cacheConfigStart = configStart;
+	cacheConfigSize = configSize;
+	cacheDataStart = dataStart;
+	cacheDataSize = dataSize;
+	cacheWords = words;
+	return true;
+}
+
+
+ICACHE_FLASH_ATTR
+void pic_cache_invalidate() {
+	if (cacheValid != NULL) {
+		os_memset(cacheValid, 0, (cacheWords + 7) / 8);
+	}
+}
+
+
+ICACHE_FLASH_ATTR
+void pic_cache_release() {
+	if (cacheData != NULL) {
+		os_free(cacheData);
+		cacheData = NULL;
+	}
+	if (cacheValid != NULL) {
+		os_free(cacheValid);
+		cacheValid = NULL;
+	}
+	cacheWords = 0;
+	cacheDeviceId = 0;
+}
+
+
+ICACHE_FLASH_ATTR
+bool pic_cache_lookup(uint32_t addr, uint32_t *word) {
+	int32_t slot;
+	if (cacheData == NULL) {
+		return false;
+	}
+	slot = _slot(addr);
+	if (slot < 0 || !(cacheValid[slot >> 3] & (1 << (slot & 7)))) {
+		return false;
+	}
+	*word = cacheData[slot];
+	return true;
+}
+
+
+ICACHE_FLASH_ATTR
+void pic_cache_store(uint32_t addr, uint32_t word) {
+	int32_t slot;
+	if (cacheData == NULL) {
+		return;
+	}
+	slot = _slot(addr);
+	if (slot < 0) {
+		return;
+	}
+	cacheData[slot] = word;
+	cacheValid[slot >> 3] |= 1 << (slot & 7);
+}
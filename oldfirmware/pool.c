@@ -0,0 +1,218 @@
+/* 
+ * Fixed-block pools for network and request buffers.
+ *
+ * Each size class is reserved in one piece at boot and handed out block by
+ * block from a free list, so sending responses and pages does not touch
+ * the heap and cannot fragment it over a long shift.  A request that no
+ * class can serve fails instead of falling back to the heap, and is
+ * counted against the pool that should have served it.
+ *
+ * A pool may temporarily grow by one extra region, e.g. with memory that
+ * idle services gave back, and shrinks again once all its blocks are free.
+ */
+
+#include "pool.h"
+#include "log.h"
+
+#include <c_types.h>
+#include <mem.h>
+#include <osapi.h>
+
+
+// Each block starts with a small header naming its pool; the caller gets
+// the space after it.
+typedef union poolBlock {
+	union poolBlock *next;
+	uint32_t pool;
+} PoolBlock;
+
+#define HEADER_SIZE		sizeof(PoolBlock)
+
+
+static struct {
+	uint16_t size;
+	uint16_t blocks;
+	uint16_t used;
+	uint16_t highWater;
+	uint16_t failures;
+	char *memory;
+	char *extra;
+	uint16_t extraBlocks;
+	PoolBlock *free;
+} pools[POOL_COUNT] = {
+	{POOL_SMALL_SIZE, POOL_SMALL_BLOCKS},
+	{POOL_CHUNK_SIZE, POOL_CHUNK_BLOCKS},
+	{POOL_LARGE_SIZE, POOL_LARGE_BLOCKS},
+};
+
+
+#define _stride(p) (HEADER_SIZE + pools[p].size)
+
+
+// Put the blocks of a region on the free list of its pool.
+static ICACHE_FLASH_ATTR
+void _add_region(uint8_t p, char *memory, uint16_t blocks) {
+	PoolBlock *block;
+	uint16_t i;
+	for (i = blocks; i > 0; i--) {
+		block = (PoolBlock *)(memory + (i - 1) * _stride(p));
+		block->next = pools[p].free;
+		pools[p].free = block;
+	}
+}
+
+
+ICACHE_FLASH_ATTR
+void pool_initialize() {
+	uint8_t p;
+
+	for (p = 0; p < POOL_COUNT; p++) {
+		if (pools[p].memory != NULL) {
+			continue;
+		}
+		pools[p].memory = (char *)os_malloc(_stride(p) * pools[p].blocks);
+		if (pools[p].memory == NULL) {
+			LOG_ERROR("POOL: cannot reserve %d x %d bytes", 
+					pools[p].blocks, pools[p].size);
+			pools[p].blocks = 0;
+			continue;
+		}
+		pools[p].free = NULL;
+		_add_region(p, pools[p].memory, pools[p].blocks);
+	}
+	pool_print_stats();
+}
+
+
+// Grow a pool by up to blocks, using at most budget bytes of heap.
+// Returns the number of blocks added.
+ICACHE_FLASH_ATTR
+uint16_t pool_grow(PoolClass pool, uint16_t blocks, uint32_t budget) {
+	if (pools[pool].extra != NULL) {
+		return 0;
+	}
+	if (blocks > budget / _stride(pool)) {
+		blocks = budget / _stride(pool);
+	}
+	if (!blocks) {
+		return 0;
+	}
+	pools[pool].extra = (char *)os_malloc(_stride(pool) * blocks);
+	if (pools[pool].extra == NULL) {
+		return 0;
+	}
+	pools[pool].extraBlocks = blocks;
+	pools[pool].blocks += blocks;
+	_add_region(pool, pools[pool].extra, blocks);
+	return blocks;
+}
+
+
+// Give the extra region of a pool back to the heap.  Fails while any of
+// its blocks is still in use.
+ICACHE_FLASH_ATTR
+bool pool_shrink(PoolClass pool) {
+	char *start = pools[pool].extra;
+	char *end = start + _stride(pool) * pools[pool].extraBlocks;
+	PoolBlock **link;
+	uint16_t count = 0;
+
+	if (start == NULL) {
+		return true;
+	}
+	for (link = &pools[pool].free; *link != NULL; link = &(*link)->next) {
+		if ((char *)*link >= start && (char *)*link < end) {
+			count++;
+		}
+	}
+	if (count < pools[pool].extraBlocks) {
+		return false;
+	}
+
+	// Unlink the region's blocks, then release it.
+	link = &pools[pool].free;
+	while (*link != NULL) {
+		if ((char *)*link >= start && (char *)*link < end) {
+			*link = (*link)->next;
+		}
+		else {
+			link = &(*link)->next;
+		}
+	}
+	os_free(start);
+	pools[pool].blocks -= pools[pool].extraBlocks;
+	pools[pool].extra = NULL;
+	pools[pool].extraBlocks = 0;
+	return true;
+}
+
+
+// Returns a block of at least size bytes, not zeroed, or NULL.
+ICACHE_FLASH_ATTR
+void * pool_alloc(uint16_t size) {
+	PoolBlock *block;
+	uint8_t fitting = 0;
+	uint8_t p;
+
+	// A failure counts against the smallest class that fits, or the
+	// largest one, and only once no class could serve the request.
+	while (fitting < POOL_LARGE && size > pools[fitting].size) {
+		fitting++;
+	}
+	for (p = fitting; p < POOL_COUNT; p++) {
+		if (size > pools[p].size) {
+			continue;
+		}
+		block = pools[p].free;
+		if (block == NULL) {
+			// Larger classes may still have room.
+			continue;
+		}
+		pools[p].free = block->next;
+		block->pool = p;
+		if (++pools[p].used > pools[p].highWater) {
+			pools[p].highWater = pools[p].used;
+		}
+		return (char *)block + HEADER_SIZE;
+	}
+	pools[fitting].failures++;
+	LOG_WARN("POOL: no block for %d bytes", size);
+	return NULL;
+}
+
+
+ICACHE_FLASH_ATTR
+void pool_free(void *pointer) {
+	PoolBlock *block;
+	uint8_t p;
+
+	if (pointer == NULL) {
+		return;
+	}
+	block = (PoolBlock *)((char *)pointer - HEADER_SIZE);
+	p = block->pool;
+	block->next = pools[p].free;
+	pools[p].free = block;
+	pools[p].used--;
+}
+
+
+ICACHE_FLASH_ATTR
+void pool_stats(PoolClass pool, PoolStats *stats) {
+	stats->block_size = pools[pool].size;
+	stats->blocks = pools[pool].blocks;
+	stats->used = pools[pool].used;
+	stats->high_water = pools[pool].highWater;
+	stats->failures = pools[pool].failures;
+}
+
+
+ICACHE_FLASH_ATTR
+void pool_print_stats() {
+	uint8_t p;
+	for (p = 0; p < POOL_COUNT; p++) {
+		LOG_INFO("POOL %d: %d x %d bytes, used: %d, max: %d, failed: %d",
+				p, pools[p].blocks, pools[p].size, pools[p].used, 
+				pools[p].highWater, pools[p].failures);
+	}
+}
@@ -0,0 +1,125 @@
+/* 
+ * Service manager.
+ *
+ * Webadmin, the soft-AP and the mDNS responder are only needed to find and
+ * configure the programmer.  While a client holds the programming lease
+ * they are suspended, and the heap they used goes to the chunk pool.  All
+ * of it is restored, in reverse order, once the lease is released.  The
+ * soft-AP stays up while stations use it, as the lease holder may be one.
+ */
+
+#include "services.h"
+#include "pool.h"
+#include "webadmin.h"
+#include "sp_mdns.h"
+#include "sp_tcpserver.h"
+#include "log.h"
+
+#include <c_types.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <espconn.h>
+#include <user_interface.h>
+
+
+static bool wanted = false;
+static bool suspended = false;
+static ETSTimer services_timer;
+
+// Operating mode before suspending, restored on resume.
+static uint8_t opmode;
+
+
+// Whether a station is connected to the soft-AP, or the lease holder is
+// on its network.
+static ICACHE_FLASH_ATTR
+bool _softap_in_use() {
+	struct ip_info info;
+	uint8_t ip[4];
+	uint32_t remote;
+
+	if (wifi_softap_get_station_num()) {
+		return true;
+	}
+	if (!sp_tcpserver_lease_remote(ip) ||
+			!wifi_get_ip_info(SOFTAP_IF, &info)) {
+		return false;
+	}
+	os_memcpy(&remote, ip, 4);
+	return (remote & info.netmask.addr) ==
+		(info.ip.addr & info.netmask.addr);
+}
+
+
+static ICACHE_FLASH_ATTR
+void _suspend() {
+	uint32_t before = system_get_free_heap_size();
+	uint32_t after;
+	uint16_t grown;
+
+	webadmin_shutdown();
+	opmode = wifi_get_opmode();
+	if (opmode == STATIONAP_MODE && !_softap_in_use()) {
+		wifi_set_opmode_current(STATION_MODE);
+	}
+	espconn_mdns_close();
+	after = system_get_free_heap_size();
+	LOG_INFO("SERVICES: suspended, free heap: %d -> %d", before, after);
+
+	grown = pool_grow(POOL_CHUNK, SERVICES_EXTRA_CHUNKS, 
+			after > SERVICES_HEAP_RESERVE ? after - SERVICES_HEAP_RESERVE : 0);
+	LOG_INFO("SERVICES: %d extra chunk blocks, free heap: %d", grown, 
+			system_get_free_heap_size());
+}
+
+
+static ICACHE_FLASH_ATTR
+bool _resume() {
+	uint32_t before;
+
+	// The services need their memory back first.
+	if (!pool_shrink(POOL_CHUNK)) {
+		return false;
+	}
+	before = system_get_free_heap_size();
+	if (wifi_station_get_connect_status() == STATION_GOT_IP) {
+		sp_mdns_setup();
+	}
+	if (wifi_get_opmode() != opmode) {
+		wifi_set_opmode_current(opmode);
+	}
+	webadmin_initialize();
+	LOG_INFO("SERVICES: restored, free heap: %d -> %d", before, 
+			system_get_free_heap_size());
+	return true;
+}
+
+
+static ICACHE_FLASH_ATTR
+void _apply() {
+	os_timer_disarm(&services_timer);
+	if (wanted && !suspended) {
+		_suspend();
+		suspended = true;
+	}
+	else if (!wanted && suspended) {
+		if (!_resume()) {
+			// A chunk is still queued, try again shortly.
+			os_timer_setfn(&services_timer, (os_timer_func_t *)_apply, NULL);
+			os_timer_arm(&services_timer, SERVICES_RETRY_INTERVAL, 0);
+			return;
+		}
+		suspended = false;
+	}
+}
+
+
+// Called when the programming lease is taken or released.  The change is
+// applied from a timer, outside of the network callbacks.
+ICACHE_FLASH_ATTR
+void services_programming(bool active) {
+	wanted = active;
+	os_timer_disarm(&services_timer);
+	os_timer_setfn(&services_timer, (os_timer_func_t *)_apply, NULL);
+	os_timer_arm(&services_timer, 0, 0);
+}
@@ -1,40 +1,320 @@
 /* Serial Programmer main module */
 
 #include "sp.h"
+#include "pic.h"
 #include "sp_mdns.h"
 #include "sp_tcpserver.h"
-#include "pic_devices.h"
+#include "sp_uart.h"
+#include "sp_job.h"
+#include "bigendian.h"
+#include "pool.h"
+#include "services.h"
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <osapi.h>
+#include <espconn.h>
+#include <user_interface.h>
 
 
 static ICACHE_FLASH_ATTR
 SPError sp_command_echo(SPPacket *req) {
-	sp_tcpserver_response(SP_OK, req->body, req->head.body_length);
+	if (!sp_tcpserver_response(SP_OK, req->body, req->head.body_length)) {
+		return SP_ERR_BUSY;
+	}
 	return SP_OK;
 }
 
 
 static ICACHE_FLASH_ATTR
 SPError sp_command_programmer_version(SPPacket *req) {
-	sp_tcpserver_response(SP_OK, SP_VERSION, os_strlen(SP_VERSION));
+	if (!sp_tcpserver_response(SP_OK, SP_VERSION, os_strlen(SP_VERSION))) {
+		return SP_ERR_BUSY;
+	}
 	return SP_OK;
 }
 
 
+/*
+ * STATUS command, shared with clients that do not hold the lease.
+ * Response: flags (1 byte; bit 0: a job is running, bit 1: the lease is
+ * held, bit 2: held by the caller), number of clients (1 byte), ID of the
+ * last detected device (uint32) and its name.  Nothing touches the target.
+ */
 static ICACHE_FLASH_ATTR
-SPError sp_process_request(SPPacket *req) {
+SPError sp_command_status(SPPacket *req) {
+	char response[6 + 32];
+	uint32_t deviceId;
+	const char *name = pic_detected_device(&deviceId);
+	uint32_t length = 6;
+
+	response[0] = (sp_job_running() ? 1 : 0) | 
+		(sp_tcpserver_connected() ? 2 : 0) | 
+		(sp_tcpserver_holds_lease() ? 4 : 0);
+	response[1] = sp_tcpserver_clients();
+	bigendian_serialize_uint32(response + 2, deviceId);
+	if (name != NULL) {
+		while (*name && length < sizeof(response)) {
+			response[length++] = *name++;
+		}
+	}
+	if (!sp_tcpserver_response(SP_OK, response, length)) {
+		return SP_ERR_BUSY;
+	}
+	return SP_OK;
+}
+
+
+/*
+ * POOLS command, shared.
+ * Response: for each pool; block size, blocks, blocks in use, most blocks
+ * ever in use and failed allocations (uint16 each).
+ */
+static ICACHE_FLASH_ATTR
+SPError sp_command_pools(SPPacket *req) {
+	char response[POOL_COUNT * 10];
+	char *cursor = response;
+	PoolStats stats;
+	uint8_t p;
+
+	for (p = 0; p < POOL_COUNT; p++) {
+		pool_stats(p, &stats);
+		cursor = bigendian_serialize_uint16(cursor, stats.block_size);
+		cursor = bigendian_serialize_uint16(cursor, stats.blocks);
+		cursor = bigendian_serialize_uint16(cursor, stats.used);
+		cursor = bigendian_serialize_uint16(cursor, stats.high_water);
+		cursor = bigendian_serialize_uint16(cursor, stats.failures);
+	}
+	if (!sp_tcpserver_response(SP_OK, response, sizeof(response))) {
+		return SP_ERR_BUSY;
+	}
+	return SP_OK;
+}
+
+
+/*
+ * LOG command, shared.
+ * Body: optional position (uint32) to read from, 0 when omitted.
+ * Response: position of the first returned byte (uint32), bytes dropped
+ * before reaching the UART (uint32) and up to SP_LOG_CHUNK bytes of log
+ * text.  Positions count bytes ever logged, so reading on from position
+ * plus length follows the log; an overwritten position moves up to the
+ * oldest byte still held.
+ */
+static ICACHE_FLASH_ATTR
+SPError sp_command_log(SPPacket *req) {
+	char response[8 + SP_LOG_CHUNK];
+	uint32_t position = 0;
+	uint16_t length;
+
+	if (req->head.body_length >= 4) {
+		position = bigendian_deserialize_uint32(req->body);
+	}
+	length = log_read(&position, response + 8, SP_LOG_CHUNK);
+	bigendian_serialize_uint32(response, position);
+	bigendian_serialize_uint32(response + 4, log_dropped());
+	if (!sp_tcpserver_response(SP_OK, response, 8 + length)) {
+		return SP_ERR_BUSY;
+	}
+	return SP_OK;
+}
+
 
-#if SP_VERBOSE
-	os_printf("Command: %d", req->head.command); 
-	if (req->head.body_length) {
-		char body[req->head.body_length+1]; 
-		os_strcpy(body, req->body);
-		os_printf(" len: %d body: %s", req->head.body_length, body);
+/*
+ * STATS command, shared.
+ * Body: optional flags (1 byte); bit 0: reset the counters once reported.
+ * Response: the counters since boot or the last reset, laid out as
+ * described at stats_serialize().
+ */
+static ICACHE_FLASH_ATTR
+SPError sp_command_stats(SPPacket *req) {
+	char response[STATS_SERIALIZED_SIZE];
+	uint16_t length = stats_serialize(response);
+	if (!sp_tcpserver_response(SP_OK, response, length)) {
+		// Not reported, so not reset either.
+		return SP_ERR_BUSY;
+	}
+	if (req->head.body_length >= 1 && (req->body[0] & 1)) {
+		stats_reset();
 	}
-	os_printf("\r\n");
-#endif
-	
+	return SP_OK;
+}
+
+
+/*
+ * TRACE command, shared.
+ * Body: optional position (uint32) to read from, 0 when omitted, and
+ * optionally a mask (1 byte) of the event categories to record from now
+ * on, bit n for events 0xn0-0xnF.
+ * Response: position of the first returned event (uint32), the cycle
+ * counter now (uint32), CPU clock in MHz (1 byte) and up to TRACE_CHUNK
+ * events as laid out at trace_read().
+ */
+static ICACHE_FLASH_ATTR
+SPError sp_command_trace(SPPacket *req) {
+	char response[9 + TRACE_CHUNK * TRACE_EVENT_SIZE];
+	uint32_t position = 0;
+	uint16_t count;
+
+	if (req->head.body_length >= 4) {
+		position = bigendian_deserialize_uint32(req->body);
+	}
+	if (req->head.body_length >= 5) {
+		trace_set_mask(req->body[4]);
+	}
+	count = trace_read(&position, response + 9, TRACE_CHUNK);
+	bigendian_serialize_uint32(response, position);
+	bigendian_serialize_uint32(response + 4, stats_ccount());
+	response[8] = system_get_cpu_freq();
+	if (!sp_tcpserver_response(SP_OK, response,
+				9 + count * TRACE_EVENT_SIZE)) {
+		return SP_ERR_BUSY;
+	}
+	return SP_OK;
+}
+
+
+static ICACHE_FLASH_ATTR
+SPError sp_process_request(SPPacket *req);
+
+
+// Run a single request, feeding the body to its consumer first if the
+// command normally streams it.
+static ICACHE_FLASH_ATTR
+SPError sp_execute(SPPacket *req) {
+	SPChunkCallback consumer = sp_tcpserver_find_stream(req->head.command);
+	SPError err;
+	if (consumer != NULL) {
+		err = consumer(&req->head, 0, req->body, req->head.body_length);
+		if (err != SP_OK) {
+			return err;
+		}
+		req->body = NULL;
+	}
+	return sp_process_request(req);
+}
+
+
+/*
+ * BATCH command.
+ * Body: a sequence of requests, each with the usual 5 bytes of head.
+ * Response: one record per executed step; command, status, body length
+ * (uint32) and the step's response bodies.  Steps run back to back in a
+ * single ICSP session and execution stops at the first failure, whose
+ * error is also the status of the whole response.
+ */
+static ICACHE_FLASH_ATTR
+SPError sp_command_batch(SPPacket *req) {
+	static char result[SP_BATCH_RESULT_SIZE];
+	uint32_t result_length = 0;
+	uint32_t offset = 0;
+	SPError err = SP_OK;
+	SPPacket step;
+	int32_t captured;
+	char *record;
+	uint32_t started = system_get_time();
+
+	pic_session_begin();
+	while (offset < req->head.body_length) {
+		if (req->head.body_length - offset < 5) {
+			err = SP_ERR_REQ_LEN;
+			break;
+		}
+		step.head.command = req->body[offset];
+		step.head.tagged = false;
+		step.head.compressed = false;
+		step.head.tag = 0;
+		step.head.body_length = bigendian_deserialize_uint32(
+				req->body + offset + 1);
+		step.body = req->body + offset + 5;
+		offset += 5;
+		if (step.head.body_length > req->head.body_length - offset) {
+			err = SP_ERR_REQ_LEN;
+			break;
+		}
+		offset += step.head.body_length;
+		if (result_length + 6 > SP_BATCH_RESULT_SIZE) {
+			err = SP_ERR_BATCH_OVERFLOW;
+			break;
+		}
+
+		// Run the step, collecting its responses into its record.
+		record = result + result_length;
+		sp_tcpserver_capture_begin(record + 6, 
+				SP_BATCH_RESULT_SIZE - result_length - 6);
+		if (step.head.command == SP_CMD_BATCH) {
+			err = SP_ERR_INVALID_COMMAND;
+		}
+		else {
+			err = sp_execute(&step);
+		}
+		captured = sp_tcpserver_capture_end();
+		if (captured < 0) {
+			// Whatever the step made of its own failed response.
+			err = SP_ERR_BATCH_OVERFLOW;
+			captured = 0;
+		}
+		record[0] = step.head.command;
+		record[1] = err;
+		bigendian_serialize_uint32(record + 2, captured);
+		result_length += 6 + captured;
+		if (err != SP_OK) {
+			break;
+		}
+	}
+	pic_session_end();
+	stats_job(err == SP_OK, system_get_time() - started);
+
+	sp_tcpserver_response(err, result, result_length);
+	return SP_OK;
+}
+
+
+/*
+ * CANCEL command.
+ * Body: tag (uint16) of the running operation.
+ * Response: empty.  The operation itself ends with a CANCELLED frame.
+ */
+static ICACHE_FLASH_ATTR
+SPError sp_command_cancel(SPPacket *req) {
+	SPError err;
+	if (req->head.body_length < 2) {
+		return SP_ERR_REQ_LEN;
+	}
+	err = sp_job_cancel(bigendian_deserialize_uint16(req->body));
+	if (err != SP_OK) {
+		return err;
+	}
+	sp_tcpserver_response(SP_OK, NULL, 0);
+	return SP_OK;
+}
+
+
+static ICACHE_FLASH_ATTR
+SPError sp_dispatch(SPPacket *req) {
+
+	LOG_DEBUG("Command: %d len: %d", req->head.command, 
+			req->head.body_length);
+
+	// Only commands that leave the target alone run next to a job.
+	if (sp_job_running()) {
+		switch (req->head.command) {
+			case SP_CMD_ECHO:
+			case SP_CMD_PROGRAMMER_VERSION:
+			case SP_CMD_CANCEL:
+			case SP_CMD_STATUS:
+			case SP_CMD_POOLS:
+			case SP_CMD_LOG:
+			case SP_CMD_STATS:
+			case SP_CMD_TRACE:
+				break;
+
+			default:
+				return SP_ERR_BUSY;
+		}
+	}
+
 	switch (req->head.command) {
 		case SP_CMD_ECHO:
 			return sp_command_echo(req);
@@ -48,6 +328,36 @@ SPError sp_process_request(SPPacket *req) {
 		case SP_CMD_READ:
 			return pic_command_read(req);
 
+		case SP_CMD_WRITEBIN:
+			return pic_command_write_binary(req);
+
+		case SP_CMD_PWROFF:
+			return pic_command_power_off(req);
+
+		case SP_CMD_WRITE_DATA:
+			return pic_command_write_data(req);
+
+		case SP_CMD_BATCH:
+			return sp_command_batch(req);
+
+		case SP_CMD_CANCEL:
+			return sp_command_cancel(req);
+
+		case SP_CMD_STATUS:
+			return sp_command_status(req);
+
+		case SP_CMD_POOLS:
+			return sp_command_pools(req);
+
+		case SP_CMD_LOG:
+			return sp_command_log(req);
+
+		case SP_CMD_STATS:
+			return sp_command_stats(req);
+
+		case SP_CMD_TRACE:
+			return sp_command_trace(req);
+
 		default:
 			return SP_ERR_INVALID_COMMAND;
 	}
@@ -57,17 +367,69 @@ SPError sp_process_request(SPPacket *req) {
 }
 
 
+static ICACHE_FLASH_ATTR
+SPError sp_process_request(SPPacket *req) {
+	SPError err;
+	TRACE_BEGIN(TRACE_DISPATCH, req->head.command);
+	err = sp_dispatch(req);
+	TRACE_END(TRACE_DISPATCH, err);
+	return err;
+}
+
+
 void ICACHE_FLASH_ATTR
 sp_initialize() {
-	sp_mdns_setup();
 	sp_tcpserver_initialize(sp_process_request);
+	sp_tcpserver_register_stream(SP_CMD_WRITEBIN, pic_stream_write_binary);
+	// Anyone may look, only the lease holder may program.
+	sp_tcpserver_share_command(SP_CMD_ECHO);
+	sp_tcpserver_share_command(SP_CMD_PROGRAMMER_VERSION);
+	sp_tcpserver_share_command(SP_CMD_STATUS);
+	sp_tcpserver_share_command(SP_CMD_POOLS);
+	sp_tcpserver_share_command(SP_CMD_LOG);
+	sp_tcpserver_share_command(SP_CMD_STATS);
+	sp_tcpserver_share_command(SP_CMD_TRACE);
+	sp_tcpserver_lease_command(SP_CMD_DETECT);
+	sp_tcpserver_lease_command(SP_CMD_READ);
+	sp_tcpserver_lease_command(SP_CMD_WRITEBIN);
+	sp_tcpserver_lease_command(SP_CMD_PWROFF);
+	sp_tcpserver_lease_command(SP_CMD_WRITE_DATA);
+	sp_tcpserver_lease_command(SP_CMD_BATCH);
+	sp_tcpserver_lease_command(SP_CMD_CANCEL);
+	sp_tcpserver_set_lease_callback(services_programming);
+	sp_tcpserver_set_gone_callback(sp_job_client_gone);
+	sp_job_initialize();
 	pic_initialize();
+	if (SP_UART_BAUD) {
+		sp_uart_initialize(SP_UART_BAUD);
+	}
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_start() {
+	sp_mdns_setup();
+	sp_tcpserver_listen();
+}
+
+
+// The UART client, if any, carries on.  Otherwise nobody is left to
+// finish with the target.
+void ICACHE_FLASH_ATTR
+sp_stop() {
+	espconn_mdns_close();
+	sp_tcpserver_close();
+	if (!sp_tcpserver_connected()) {
+		pic_shutdown();
+	}
 }
 
 
 void ICACHE_FLASH_ATTR
 sp_shutdown() {
+	sp_job_shutdown();
 	pic_shutdown();
-	espconn_mdns_close();
+	sp_stop();
+	sp_uart_shutdown();
 	sp_tcpserver_shutdown();
 }
@@ -0,0 +1,194 @@
+/* 
+ * Compressed transfer encoding of request and response bodies.
+ *
+ * Images and dumps are mostly runs of 0x3FFF, repeated RETLW tables and
+ * zero-filled EEPROM, which a tiny LZ with a 256 byte window already
+ * shrinks several times.  The decoder works incrementally, so bodies may
+ * be split anywhere by TCP and streamed straight to their consumer.
+ */
+
+#include "sp_codec.h"
+
+#include <c_types.h>
+#include <osapi.h>
+
+
+#define DECODE_CONTROL		0
+#define DECODE_LITERAL		1
+#define DECODE_DISTANCE		2
+#define DECODE_MATCH		3
+
+#define NO_POSITION			0xFFFF
+
+
+// Last position of each 3 byte hash, encoder scratch.
+static uint16_t encodeTable[256];
+
+
+static ICACHE_FLASH_ATTR
+uint8_t _hash(const unsigned char *p) {
+	return (p[0] * 33 + p[1] * 7 + p[2]) & 0xFF;
+}
+
+
+static ICACHE_FLASH_ATTR
+uint16_t _match_length(const unsigned char *in, uint16_t from, uint16_t pos, 
+		uint16_t max) {
+	uint16_t length = 0;
+	while (length < max && in[from + length] == in[pos + length]) {
+		length++;
+	}
+	return length;
+}
+
+
+static ICACHE_FLASH_ATTR
+uint32_t _flush_literals(const unsigned char *in, uint16_t start, 
+		uint16_t end, unsigned char *out) {
+	uint32_t o = 0;
+	uint16_t run;
+	while (start < end) {
+		run = end - start;
+		if (run > SP_CODEC_MAX_LITERAL) {
+			run = SP_CODEC_MAX_LITERAL;
+		}
+		out[o++] = run - 1;
+		os_memcpy(out + o, in + start, run);
+		o += run;
+		start += run;
+	}
+	return o;
+}
+
+
+// Encode length bytes, returns the encoded length.  out must have room
+// for sp_codec_bound(length) bytes.
+ICACHE_FLASH_ATTR
+uint32_t sp_codec_encode(const unsigned char *in, uint16_t length, 
+		unsigned char *out) {
+	// Candidates besides the hash hit: runs of bytes, words and dwords.
+	static const uint8_t distances[] = {1, 2, 4};
+	uint16_t pos = 0;
+	uint16_t literal = 0;
+	uint16_t best, bestDistance, max, candidate, l;
+	uint32_t o = 0;
+	uint8_t h, i;
+
+	os_memset(encodeTable, 0xFF, sizeof(encodeTable));
+	while (pos < length) {
+		best = 0;
+		bestDistance = 0;
+		max = length - pos;
+		if (max > SP_CODEC_MAX_MATCH) {
+			max = SP_CODEC_MAX_MATCH;
+		}
+		if (max >= SP_CODEC_MIN_MATCH) {
+			h = _hash(in + pos);
+			candidate = encodeTable[h];
+			encodeTable[h] = pos;
+			if (candidate != NO_POSITION && pos - candidate <= SP_CODEC_WINDOW) {
+				best = _match_length(in, candidate, pos, max);
+				bestDistance = pos - candidate;
+			}
+			for (i = 0; i < sizeof(distances); i++) {
+				if (distances[i] > pos) {
+					break;
+				}
+				l = _match_length(in, pos - distances[i], pos, max);
+				if (l > best) {
+					best = l;
+					bestDistance = distances[i];
+				}
+			}
+		}
+		if (best < SP_CODEC_MIN_MATCH) {
+			pos++;
+			continue;
+		}
+		o += _flush_literals(in, literal, pos, out + o);
+		out[o++] = 0x80 | (best - SP_CODEC_MIN_MATCH);
+		out[o++] = bestDistance - 1;
+		pos += best;
+		literal = pos;
+	}
+	o += _flush_literals(in, literal, length, out + o);
+	return o;
+}
+
+
+ICACHE_FLASH_ATTR
+void sp_codec_decoder_init(SPDecoder *decoder) {
+	decoder->position = 0;
+	decoder->state = DECODE_CONTROL;
+	decoder->count = 0;
+	decoder->distance = 0;
+}
+
+
+// Decode up to length input bytes into at most size output bytes.  Returns
+// the number of input bytes used and sets the number of bytes produced; 
+// decoding stops early once out is full.
+ICACHE_FLASH_ATTR
+uint16_t sp_codec_decode(SPDecoder *decoder, const unsigned char *in, 
+		uint16_t length, unsigned char *out, uint16_t size, 
+		uint16_t *produced) {
+	uint16_t used = 0;
+	uint16_t o = 0;
+	unsigned char c;
+
+	for (;;) {
+		switch (decoder->state) {
+			case DECODE_CONTROL:
+				if (used == length) {
+					goto done;
+				}
+				c = in[used++];
+				if (c & 0x80) {
+					decoder->count = (c & 0x7F) + SP_CODEC_MIN_MATCH;
+					decoder->state = DECODE_DISTANCE;
+				}
+				else {
+					decoder->count = c + 1;
+					decoder->state = DECODE_LITERAL;
+				}
+				break;
+
+			case DECODE_LITERAL:
+				if (used == length || o == size) {
+					goto done;
+				}
+				c = in[used++];
+				decoder->window[decoder->position++] = c;
+				out[o++] = c;
+				if (!--decoder->count) {
+					decoder->state = DECODE_CONTROL;
+				}
+				break;
+
+			case DECODE_DISTANCE:
+				if (used == length) {
+					goto done;
+				}
+				decoder->distance = in[used++];
+				decoder->state = DECODE_MATCH;
+				break;
+
+			case DECODE_MATCH:
+				if (o == size) {
+					goto done;
+				}
+				// The window index wraps around with the uint8_t arithmetic.
+				c = decoder->window[(uint8_t)(decoder->position - 
+						decoder->distance - 1)];
+				decoder->window[decoder->position++] = c;
+				out[o++] = c;
+				if (!--decoder->count) {
+					decoder->state = DECODE_CONTROL;
+				}
+				break;
+		}
+	}
+done:
+	*produced = o;
+	return used;
+}
@@ -0,0 +1,227 @@
+/* 
+ * Background executor for long, tagged operations.
+ *
+ * A tagged request for a long operation is answered with an ACCEPTED
+ * frame right away.  The work then runs in slices from an OS task, so the
+ * TCP server keeps parsing requests in the meantime, and a CANCEL can stop
+ * it between two slices.  Progress frames are sent periodically and a
+ * final frame, carrying the same tag, reports the outcome.
+ */
+
+#include "sp_job.h"
+#include "sp_tcpserver.h"
+#include "bigendian.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <c_types.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <user_interface.h>
+
+
+static struct {
+	bool running;
+	bool cancelled;
+	// Client that started the job, its frames go there.
+	SPConnection *client;
+	uint16_t tag;
+	SPResponseMode mode;
+	uint32_t total;
+	uint32_t done;
+	uint32_t reported;
+	uint32_t started;
+	SPJobStep step;
+	SPJobAbort abort;
+} job;
+
+static os_event_t job_queue[1];
+static ETSTimer job_retry_timer;
+
+
+static void ICACHE_FLASH_ATTR
+_respond(int8_t status) {
+	char body[8];
+	SPResponseMode previous = sp_tcpserver_set_response_mode(job.mode);
+	SPConnection *client = sp_tcpserver_set_client(job.client);
+	bigendian_serialize_uint32(body, job.done);
+	bigendian_serialize_uint32(body + 4, job.total);
+	sp_tcpserver_response(status, body, 8);
+	sp_tcpserver_set_client(client);
+	sp_tcpserver_set_response_mode(previous);
+}
+
+
+static bool ICACHE_FLASH_ATTR
+_txqueue_available() {
+	SPConnection *client = sp_tcpserver_set_client(job.client);
+	bool available = sp_tcpserver_txqueue_available();
+	sp_tcpserver_set_client(client);
+	return available;
+}
+
+
+static void ICACHE_FLASH_ATTR
+_post() {
+	system_os_post(SP_JOB_TASK_PRIO, 0, 0);
+}
+
+
+// Try again shortly, the TX queue has no room for our frames.
+static void ICACHE_FLASH_ATTR
+_retry() {
+	os_timer_disarm(&job_retry_timer);
+	os_timer_setfn(&job_retry_timer, (os_timer_func_t *)_post, NULL);
+	os_timer_arm(&job_retry_timer, SP_JOB_RETRY_INTERVAL, 0);
+}
+
+
+static void ICACHE_FLASH_ATTR
+_finish(int8_t status) {
+	if (!_txqueue_available()) {
+		_retry();
+		return;
+	}
+	job.running = false;
+	stats_job(status == SP_OK, system_get_time() - job.started);
+	_respond(status);
+}
+
+
+static void ICACHE_FLASH_ATTR
+_run(os_event_t *event) {
+	bool finished = false;
+	SPResponseMode previous;
+	SPConnection *client;
+	StatsZone zone;
+	SPError err;
+
+	if (!job.running) {
+		return;
+	}
+	if (job.cancelled) {
+		if (job.abort != NULL) {
+			job.abort();
+			job.abort = NULL;
+		}
+		_finish(SP_ERR_CANCELLED);
+		return;
+	}
+	if (job.step == NULL) {
+		// Done already, waiting to report it.
+		_finish(SP_OK);
+		return;
+	}
+	if (!_txqueue_available()) {
+		_retry();
+		return;
+	}
+
+	previous = sp_tcpserver_set_response_mode(job.mode);
+	client = sp_tcpserver_set_client(job.client);
+	zone = stats_enter(STATS_ZONE_PROCESS);
+	TRACE_BEGIN(TRACE_JOB_STEP, job.tag);
+	err = job.step(&job.done, &finished);
+	TRACE_END(TRACE_JOB_STEP, err);
+	stats_leave(zone);
+	sp_tcpserver_set_client(client);
+	sp_tcpserver_set_response_mode(previous);
+
+	if (err != SP_OK) {
+		if (job.abort != NULL) {
+			job.abort();
+		}
+		job.step = NULL;
+		job.abort = NULL;
+		_finish(err);
+		return;
+	}
+	if (finished) {
+		job.step = NULL;
+		job.abort = NULL;
+		_finish(SP_OK);
+		return;
+	}
+	if (job.done - job.reported >= SP_JOB_PROGRESS_INTERVAL && 
+			_txqueue_available()) {
+		job.reported = job.done;
+		_respond(SP_STATUS_PROGRESS);
+	}
+	_post();
+}
+
+
+ICACHE_FLASH_ATTR
+SPError sp_job_start(uint16_t tag, uint32_t total, SPJobStep step, 
+		SPJobAbort abort) {
+	if (job.running) {
+		return SP_ERR_BUSY;
+	}
+	job.running = true;
+	job.cancelled = false;
+	job.client = sp_tcpserver_client();
+	job.tag = tag;
+	// Frames of the job are framed like the request that started it.
+	job.mode = sp_tcpserver_response_mode();
+	job.total = total;
+	job.done = 0;
+	job.reported = 0;
+	job.started = system_get_time();
+	job.step = step;
+	job.abort = abort;
+	_respond(SP_STATUS_ACCEPTED);
+	_post();
+	return SP_OK;
+}
+
+
+ICACHE_FLASH_ATTR
+SPError sp_job_cancel(uint16_t tag) {
+	if (!job.running || job.tag != tag) {
+		return SP_ERR_NO_SUCH_JOB;
+	}
+	job.cancelled = true;
+	_post();
+	return SP_OK;
+}
+
+
+ICACHE_FLASH_ATTR
+bool sp_job_running() {
+	return job.running;
+}
+
+
+// Aborted right away, before the lease of the client is released and
+// another one may take the target.
+ICACHE_FLASH_ATTR
+void sp_job_client_gone(SPConnection *client) {
+	if (!job.running || job.client != client) {
+		return;
+	}
+	os_timer_disarm(&job_retry_timer);
+	if (job.abort != NULL) {
+		job.abort();
+	}
+	job.running = false;
+	job.step = NULL;
+	job.abort = NULL;
+	stats_job(false, system_get_time() - job.started);
+}
+
+
+ICACHE_FLASH_ATTR
+void sp_job_initialize() {
+	os_memset(&job, 0, sizeof(job));
+	system_os_task(_run, SP_JOB_TASK_PRIO, job_queue, 1);
+}
+
+
+ICACHE_FLASH_ATTR
+void sp_job_shutdown() {
+	os_timer_disarm(&job_retry_timer);
+	if (job.running && job.abort != NULL) {
+		job.abort();
+	}
+	os_memset(&job, 0, sizeof(job));
+}
@@ -1,5 +1,11 @@
 #include "sp_tcpserver.h"
+#include "sp_uart.h"
 #include "bigendian.h"
+#include "sp_codec.h"
+#include "pool.h"
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <mem.h>
 #include <c_types.h>
@@ -13,79 +19,745 @@
 
 
 static struct espconn * esp_conn;
-static uint32_t sp_reading_bytes = 0;
-static SPPacket sp_current_request;
 static SPRequestCallback sp_request_callback = NULL;
 
 
+// Framing state of the incoming byte stream.  Requests may be split or
+// coalesced in any way by TCP, so bytes are consumed one state at a time.
+typedef enum {
+	SP_PARSE_HEAD,
+	SP_PARSE_BODY,
+	SP_PARSE_DISCARD
+} SPParseState;
 
-static SPError ICACHE_FLASH_ATTR
-_process_request(SPPacket *req) {
+
+// Responses waiting to be sent.  A buffer is owned by the queue until the
+// sent callback confirms it, then the next one goes out.
+typedef struct {
+	unsigned char *buffer;
+	uint16_t length;
+} SPTxItem;
+
+
+// Everything the server keeps about one client.
+struct SPConnection {
+	struct espconn *conn;
+	bool in_use;
+
+	// The UART client, which has no espconn.  Its unparsed input waits in
+	// the UART ring instead of rx_buffer.
+	bool serial;
+
+	SPPacket request;
+	SPParseState parse_state;
+	unsigned char head_buffer[SP_MAX_HEAD_SIZE];
+	uint8_t head_bytes;
+	uint32_t reading_bytes;
+	uint32_t discard_bytes;
+	SPChunkCallback stream;
+	uint32_t started;
+
+	// Body bytes on the wire, which differ from the body length when
+	// compressed.
+	uint32_t wire_length;
+	uint32_t wire_bytes;
+	SPDecoder decoder;
+
+	// Pipelined input that arrived while a request was still in progress.
+	// It is parsed, in order, once that request is done.
+	unsigned char rx_buffer[SP_TCPSERVER_RX_BUFFER];
+	uint16_t rx_length;
+
+	// Bodies of shared commands sent by observers.
+	char body[SP_TCPSERVER_SHARED_BODY];
+
+	SPTxItem txqueue[SP_TCPSERVER_TXQUEUE_SIZE];
+	uint8_t txqueue_head;
+	uint8_t txqueue_count;
+	bool txqueue_sending;
+	ETSTimer retry_timer;
+	SPResumeCallback resume_callback;
+	SPAbortCallback abort_callback;
+
+	// Set while the request that took the programming lease is refused, it
+	// is released again.
+	bool lease_request;
+
+	// Set between two slices of a streamed body.
+	bool yielding;
+	ETSTimer yield_timer;
+};
+
+static SPConnection sp_connections[SP_TCPSERVER_MAX_CLIENTS];
+static SPConnection sp_serial;
+
+
+// Holder of the exclusive programming lease, if any.  Other clients may
+// only run shared commands.
+static SPConnection *sp_lease = NULL;
+
+// Lease taken by the programmer itself, e.g. for a webadmin upload.
+static bool sp_lease_local = false;
+
+// Client whose request is being dispatched.  Outside of a dispatch,
+// responses go to the lease holder.
+static SPConnection *sp_dispatching = NULL;
+
+// Commands every client may run, one bit per command.
+static uint32_t sp_shared_commands = 0;
+
+// Commands that need the programming lease, one bit per command.
+static uint32_t sp_lease_commands = 0;
+
+static SPLeaseCallback sp_lease_callback = NULL;
+static SPGoneCallback sp_gone_callback = NULL;
+
+
+// Bodies of the lease holder are buffered here, unless the command
+// streams its body.
+static char sp_body_buffer[SP_TCPSERVER_MAX_BODY];
+
+
+// Commands that consume their body chunk by chunk, as segments arrive.
+typedef struct {
+	uint8_t command;
+	SPChunkCallback consumer;
+} SPStream;
+
+static SPStream sp_streams[SP_TCPSERVER_MAX_STREAMS];
+static uint8_t sp_streams_count = 0;
+
+
+// While capturing, response bodies are collected here instead of being
+// sent, e.g. for the steps of a batch.
+static char *sp_capture_buffer = NULL;
+static uint32_t sp_capture_size = 0;
+static uint32_t sp_capture_length = 0;
+static bool sp_capture_overflow = false;
+
+
+// Framing of the responses being sent, following their request.
+static SPResponseMode sp_response_mode;
+
+
+// Decoded slices of compressed bodies that are streamed.
+static unsigned char sp_decode_buffer[SP_TCPSERVER_STREAM_SLICE];
+
+
+
+static SPConnection * ICACHE_FLASH_ATTR
+_target() {
+	return sp_dispatching != NULL ? sp_dispatching : sp_lease;
+}
+
+
+static bool ICACHE_FLASH_ATTR
+_is_shared(uint8_t command) {
+	return command < 32 && (sp_shared_commands & (1UL << command));
+}
+
+
+static bool ICACHE_FLASH_ATTR
+_needs_lease(uint8_t command) {
+	return command < 32 && (sp_lease_commands & (1UL << command));
+}
+
+
+static void ICACHE_FLASH_ATTR
+_release_lease(SPConnection *c) {
+	if (c != sp_lease) {
+		return;
+	}
+	LOG_INFO("SP TCPSERVER: programming lease released");
+	sp_lease = NULL;
+	if (sp_lease_callback != NULL) {
+		sp_lease_callback(false);
+	}
+}
+
+
+static void ICACHE_FLASH_ATTR
+_txqueue_clear(SPConnection *c) {
+	os_timer_disarm(&c->retry_timer);
+	while (c->txqueue_count) {
+		pool_free(c->txqueue[c->txqueue_head].buffer);
+		c->txqueue_head = (c->txqueue_head + 1) % SP_TCPSERVER_TXQUEUE_SIZE;
+		c->txqueue_count--;
+	}
+	c->txqueue_head = 0;
+	c->txqueue_sending = false;
+	c->resume_callback = NULL;
+	c->abort_callback = NULL;
+}
+
+
+static void ICACHE_FLASH_ATTR
+_txqueue_send_next(SPConnection *c) {
+	SPTxItem *item = &c->txqueue[c->txqueue_head];
+	sint8 err;
+
+	if (c->txqueue_sending || !c->txqueue_count || !c->in_use) {
+		return;
+	}
+	TRACE_BEGIN(TRACE_SEND, item->length);
+	if (c->serial) {
+		err = sp_uart_send(item->buffer, item->length) ?
+			ESPCONN_OK : ESPCONN_MAXNUM;
+	}
+	else {
+		err = espconn_sent(c->conn, item->buffer, item->length);
+	}
+	TRACE_END(TRACE_SEND, err);
+	if (err == ESPCONN_OK) {
+		c->txqueue_sending = true;
+		stats_count(STATS_BYTES_SENT, item->length);
+		return;
+	}
+
+	// The stack is still busy with a previous segment, try again shortly.
+	stats_count(STATS_SEND_RETRIES, 1);
+	os_timer_disarm(&c->retry_timer);
+	os_timer_setfn(&c->retry_timer, (os_timer_func_t *)_txqueue_send_next, c);
+	os_timer_arm(&c->retry_timer, SP_TCPSERVER_RETRY_INTERVAL, 0);
+}
+
+
+static bool ICACHE_FLASH_ATTR
+_txqueue_available(SPConnection *c) {
+	return c->txqueue_count < SP_TCPSERVER_TXQUEUE_SIZE;
+}
+
+
+// A client is busy while a producer waits for room in its TX queue, when
+// a new request would have no room for its response, or between two
+// slices of a streamed body.
+#define _busy(c) ((c)->resume_callback != NULL || \
+		!_txqueue_available(c) || (c)->yielding)
+
+
+static SPResponseMode ICACHE_FLASH_ATTR
+_request_mode(const SPPacketHead *head) {
+	SPResponseMode mode;
+	mode.tagged = head->tagged;
+	mode.compressed = head->compressed;
+	mode.tag = head->tag;
+	return mode;
+}
+
+
+// A request that took the lease but turned out to be malformed gives it
+// back, so the lease always ends up with a client that programs.
+static void ICACHE_FLASH_ATTR
+_reject(SPConnection *c, SPError err) {
+	SPConnection *previous_target = sp_dispatching;
+	SPResponseMode previous = sp_tcpserver_set_response_mode(
+			_request_mode(&c->request.head));
+	LOG_WARN("Cannot process request: %d", err);
+	sp_dispatching = c;
+	sp_tcpserver_response(err, NULL, 0);
+	sp_dispatching = previous_target;
+	sp_tcpserver_set_response_mode(previous);
+	if (c->lease_request && (err == SP_ERR_INVALID_COMMAND ||
+			err == SP_ERR_REQ_LEN)) {
+		_release_lease(c);
+	}
+	c->lease_request = false;
+}
+
+
+static void ICACHE_FLASH_ATTR
+_process_request(SPConnection *c) {
+	SPPacket *req = &c->request;
+	SPError err = SP_ERR_INVALID_COMMAND;
+	StatsZone previous = stats_enter(STATS_ZONE_PROCESS);
+	sp_dispatching = c;
+	sp_response_mode = _request_mode(&req->head);
 	if (sp_request_callback != NULL) {
-		return sp_request_callback(req);
+		err = sp_request_callback(req);
 	}
+	if (err != SP_OK) {
+		_reject(c, err);
+	}
+	c->lease_request = false;
+	os_memset(&sp_response_mode, 0, sizeof(SPResponseMode));
+	sp_dispatching = NULL;
+	stats_leave(previous);
+	// From the end of the head until the handler returns.
+	stats_latency(req->head.command, system_get_time() - c->started);
 }
 
 
-static SPError ICACHE_FLASH_ATTR
-_read_request_body(const unsigned char *data, uint16_t length, SPPacket *req) {
-	uint32_t remaining_bytes = req->head.body_length - sp_reading_bytes;
-	
-	if (remaining_bytes < length) {
-		return SP_ERR_REQ_LEN;
+SPChunkCallback ICACHE_FLASH_ATTR
+sp_tcpserver_find_stream(uint8_t command) {
+	uint8_t i;
+	for (i = 0; i < sp_streams_count; i++) {
+		if (sp_streams[i].command == command) {
+			return sp_streams[i].consumer;
+		}
+	}
+	return NULL;
+}
+
+
+// Bytes of head expected, a tag and the decoded length follow the length
+// when flagged.
+static uint8_t ICACHE_FLASH_ATTR
+_head_size(SPConnection *c) {
+	uint8_t size = 5;
+	if (!c->head_bytes) {
+		return 1;
+	}
+	if (c->head_buffer[0] & SP_TAG_FLAG) {
+		size += 2;
+	}
+	if (c->head_buffer[0] & SP_COMPRESS_FLAG) {
+		size += 4;
+	}
+	return size;
+}
+
+
+static void ICACHE_FLASH_ATTR
+_cleanup_request(SPConnection *c) {
+	// Cleaning up, the body buffers are static
+	os_memset(&c->request, 0, sizeof(SPPacket));
+	c->stream = NULL;
+	c->reading_bytes = 0;
+	c->wire_length = 0;
+	c->wire_bytes = 0;
+}
+
+
+// Skip the body of a refused request before the next one.
+static void ICACHE_FLASH_ATTR
+_refuse(SPConnection *c, SPError err) {
+	c->discard_bytes = c->wire_length;
+	c->parse_state = c->discard_bytes ? SP_PARSE_DISCARD : SP_PARSE_HEAD;
+	_reject(c, err);
+}
+
+
+// Start a new request once its head is complete.
+static void ICACHE_FLASH_ATTR
+_begin_request(SPConnection *c) {
+	SPPacket *req = &c->request;
+	unsigned char *extra = c->head_buffer + 5;
+
+	_cleanup_request(c);
+	c->lease_request = false;
+	c->started = system_get_time();
+	req->head.command = c->head_buffer[0] & ~(SP_TAG_FLAG | SP_COMPRESS_FLAG);
+	req->head.body_length = bigendian_deserialize_uint32(c->head_buffer + 1);
+	req->head.tagged = (c->head_buffer[0] & SP_TAG_FLAG) != 0;
+	req->head.compressed = (c->head_buffer[0] & SP_COMPRESS_FLAG) != 0;
+	if (req->head.tagged) {
+		req->head.tag = bigendian_deserialize_uint16(extra);
+		extra += 2;
+	}
+	c->wire_length = req->head.body_length;
+	if (req->head.compressed) {
+		// Handlers only ever see the decoded body.
+		req->head.body_length = bigendian_deserialize_uint32(extra);
+		sp_codec_decoder_init(&c->decoder);
+		if (!c->wire_length != !req->head.body_length) {
+			_refuse(c, SP_ERR_REQ_LEN);
+			return;
+		}
 	}
 
-	os_memcpy(&(req->body[sp_reading_bytes]), data, length);  
-	remaining_bytes -= length;
-	
-	if (remaining_bytes == 0) {
-		sp_reading_bytes = 0;
-		return _process_request(req);
+	// Unknown commands are refused before they could take the lease.
+	if (!_is_shared(req->head.command) && !_needs_lease(req->head.command)) {
+		_refuse(c, SP_ERR_INVALID_COMMAND);
+		return;
+	}
+	if (c != sp_lease && _needs_lease(req->head.command)) {
+		if (sp_lease != NULL || sp_lease_local) {
+			_refuse(c, SP_ERR_LEASED);
+			return;
+		}
+		LOG_INFO("SP TCPSERVER: programming lease taken");
+		sp_lease = c;
+		c->lease_request = true;
+		if (sp_lease_callback != NULL) {
+			sp_lease_callback(true);
+		}
+	}
+
+	// Process request without body
+	if (!req->head.body_length) {
+		_process_request(c);
+		return;
 	}
-	sp_reading_bytes += length;
-	return SP_OK;
+
+	c->stream = sp_tcpserver_find_stream(req->head.command);
+	if (c->stream == NULL) {
+		if (c == sp_lease &&
+				req->head.body_length <= SP_TCPSERVER_MAX_BODY) {
+			req->body = sp_body_buffer;
+		}
+		else if (c != sp_lease &&
+				req->head.body_length <= SP_TCPSERVER_SHARED_BODY) {
+			req->body = c->body;
+		}
+		else {
+			_refuse(c, SP_ERR_REQ_LEN);
+			return;
+		}
+	}
+	c->parse_state = SP_PARSE_BODY;
 }
 
 
+// Hand decoded body bytes to the stream consumer or the body buffer.
 static SPError ICACHE_FLASH_ATTR
-_parse_request(const unsigned char *data, uint16_t length) {
-	SPPacket *req = &sp_current_request; 
-	
-	// Append to read buffer if status is reading
-	if (sp_reading_bytes) {
-		return _read_request_body(data, length, req);	
+_store_body(SPConnection *c, const unsigned char *data, uint16_t length) {
+	SPPacket *req = &c->request;
+	SPError err = SP_OK;
+
+	if (c->stream != NULL) {
+		err = c->stream(&req->head, c->reading_bytes,
+				(const char*)data, length);
 	}
+	else {
+		os_memcpy(&(req->body[c->reading_bytes]), data, length);
+	}
+	c->reading_bytes += length;
+	return err;
+}
 
-	// Process a new request
-	if (length < 5) {
-		return SP_ERR_REQ_LEN;
+
+// Decode a compressed chunk, returns the number of wire bytes used.
+static uint16_t ICACHE_FLASH_ATTR
+_decode_body(SPConnection *c, const unsigned char *data, uint16_t length,
+		SPError *err) {
+	SPPacket *req = &c->request;
+	uint16_t used = 0;
+	uint16_t produced;
+	uint32_t room;
+	unsigned char *out;
+
+	for (;;) {
+		room = req->head.body_length - c->reading_bytes;
+		if (!room) {
+			if (used < length) {
+				// More input than the announced length.
+				*err = SP_ERR_REQ_LEN;
+			}
+			break;
+		}
+		if (c->stream != NULL) {
+			out = sp_decode_buffer;
+			if (room > SP_TCPSERVER_STREAM_SLICE) {
+				room = SP_TCPSERVER_STREAM_SLICE;
+			}
+		}
+		else {
+			out = (unsigned char *)req->body + c->reading_bytes;
+		}
+		used += sp_codec_decode(&c->decoder, data + used, length - used,
+				out, room, &produced);
+		if (c->stream != NULL) {
+			// One slice per run.
+			*err = _store_body(c, out, produced);
+			break;
+		}
+		c->reading_bytes += produced;
+		// Stop once the input is used up, unless a copy is still pending.
+		if (produced < room) {
+			break;
+		}
 	}
-	sp_tcpserver_cleanup_request();
-	req->head.command = data[0];
-	req->head.body_length = bigendian_deserialize_uint32(data+1);
-	//os_memcpy(&(req->head), data, 5);
+	return used;
+}
+
+
+static void ICACHE_FLASH_ATTR
+_resume_parsing(SPConnection *c);
+
+
+static void ICACHE_FLASH_ATTR
+_yield_done(SPConnection *c) {
+	StatsZone previous = stats_enter(STATS_ZONE_NETWORK);
+	c->yielding = false;
+	_resume_parsing(c);
+	stats_leave(previous);
+}
 
-	// Body, if available
-	if (req->head.body_length) {
-		req->body = (char*) os_zalloc(req->head.body_length);
-		return _read_request_body(&data[5], length-5, req);
+
+// Leave the rest of a streamed body for a timer run, the input that is
+// left meanwhile is stashed and the connection held.
+static void ICACHE_FLASH_ATTR
+_yield(SPConnection *c) {
+	c->yielding = true;
+	os_timer_disarm(&c->yield_timer);
+	os_timer_setfn(&c->yield_timer, (os_timer_func_t *)_yield_done, c);
+	os_timer_arm(&c->yield_timer, 0, 0);
+}
+
+
+// Consume body bytes of the current request, returns the number used.
+static uint16_t ICACHE_FLASH_ATTR
+_read_request_body(SPConnection *c, const unsigned char *data,
+		uint16_t length) {
+	SPPacket *req = &c->request;
+	uint32_t remaining_bytes = c->wire_length - c->wire_bytes;
+	uint16_t chunk = remaining_bytes < length ? remaining_bytes : length;
+	SPError err = SP_OK;
+
+	if (c->stream != NULL && !req->head.compressed &&
+			chunk > SP_TCPSERVER_STREAM_SLICE) {
+		chunk = SP_TCPSERVER_STREAM_SLICE;
+	}
+	if (req->head.compressed) {
+		chunk = _decode_body(c, data, chunk, &err);
+	}
+	else {
+		err = _store_body(c, data, chunk);
+	}
+	c->wire_bytes += chunk;
+	if (err == SP_OK && c->wire_bytes == c->wire_length &&
+			c->reading_bytes != req->head.body_length) {
+		// Compressed body ended short of the announced length.
+		err = SP_ERR_REQ_LEN;
 	}
 
-	// Process request without body
-	return _process_request(req);
+	if (err != SP_OK) {
+		// Skip the rest of this body before the next request.
+		c->discard_bytes = c->wire_length - c->wire_bytes;
+		c->parse_state = c->discard_bytes ?
+			SP_PARSE_DISCARD : SP_PARSE_HEAD;
+		_reject(c, err);
+		return chunk;
+	}
+
+	if (c->wire_bytes == c->wire_length) {
+		c->parse_state = SP_PARSE_HEAD;
+		_process_request(c);
+	}
+	else if (c->stream != NULL) {
+		_yield(c);
+	}
+	return chunk;
+}
+
+
+// Run the framing state machine over received bytes, dispatching every
+// complete request in order.  Stops early if a request leaves the client
+// busy, returns the number of bytes consumed.
+static uint16_t ICACHE_FLASH_ATTR
+_parse(SPConnection *c, const unsigned char *data, uint16_t length) {
+	uint16_t consumed = 0;
+	uint16_t chunk;
+
+	TRACE_BEGIN(TRACE_PARSE, length);
+	while (consumed < length && c->in_use && !_busy(c)) {
+		switch (c->parse_state) {
+			case SP_PARSE_HEAD:
+				chunk = _head_size(c) - c->head_bytes;
+				if (chunk > length - consumed) {
+					chunk = length - consumed;
+				}
+				os_memcpy(c->head_buffer + c->head_bytes, data + consumed,
+						chunk);
+				c->head_bytes += chunk;
+				consumed += chunk;
+				if (c->head_bytes == _head_size(c)) {
+					c->head_bytes = 0;
+					_begin_request(c);
+				}
+				break;
+
+			case SP_PARSE_BODY:
+				consumed += _read_request_body(c, data + consumed,
+						length - consumed);
+				break;
+
+			case SP_PARSE_DISCARD:
+				chunk = c->discard_bytes < (length - consumed) ?
+					c->discard_bytes : length - consumed;
+				c->discard_bytes -= chunk;
+				consumed += chunk;
+				if (!c->discard_bytes) {
+					c->parse_state = SP_PARSE_HEAD;
+				}
+				break;
+		}
+	}
+	TRACE_END(TRACE_PARSE, consumed);
+	return consumed;
+}
+
+
+// Keep input that cannot be parsed yet, and hold the connection so the
+// stack stops delivering more until it has been consumed.
+static void ICACHE_FLASH_ATTR
+_stash(SPConnection *c, const unsigned char *data, uint16_t length) {
+	if (c->rx_length + length > SP_TCPSERVER_RX_BUFFER) {
+		// Dropping any of it would break the framing, so nothing more is
+		// parsed and the client has to start over.
+		LOG_WARN("SP TCPSERVER: RX buffer full, disconnecting");
+		c->rx_length = 0;
+		c->parse_state = SP_PARSE_DISCARD;
+		c->discard_bytes = 0xFFFFFFFF;
+		espconn_disconnect(c->conn);
+		return;
+	}
+	os_memcpy(c->rx_buffer + c->rx_length, data, length);
+	c->rx_length += length;
+	espconn_recv_hold(c->conn);
+}
+
+
+// Parse the stashed input, once the request in progress is done.
+static void ICACHE_FLASH_ATTR
+_resume_parsing(SPConnection *c) {
+	uint16_t consumed;
+
+	if (!c->in_use || _busy(c)) {
+		return;
+	}
+	if (c->serial) {
+		sp_uart_resume();
+		return;
+	}
+	if (!c->rx_length) {
+		return;
+	}
+	consumed = _parse(c, c->rx_buffer, c->rx_length);
+	if (!c->in_use) {
+		return;
+	}
+	c->rx_length -= consumed;
+	os_memmove(c->rx_buffer, c->rx_buffer + consumed, c->rx_length);
+	if (!c->rx_length) {
+		espconn_recv_unhold(c->conn);
+	}
 }
 
 
+static void ICACHE_FLASH_ATTR
+_reset_connection(SPConnection *c) {
+	_txqueue_clear(c);
+	os_timer_disarm(&c->yield_timer);
+	c->yielding = false;
+	_cleanup_request(c);
+	c->parse_state = SP_PARSE_HEAD;
+	c->head_bytes = 0;
+	c->discard_bytes = 0;
+	c->rx_length = 0;
+}
+
+
+// Find the table entry of a client.  Callbacks may be handed a different
+// espconn than the one accepted, so the remote end is compared as well.
+static SPConnection * ICACHE_FLASH_ATTR
+_find_connection(struct espconn *pesp_conn) {
+	SPConnection *c;
+	uint8_t i;
+	for (i = 0; i < SP_TCPSERVER_MAX_CLIENTS; i++) {
+		c = &sp_connections[i];
+		if (!c->in_use) {
+			continue;
+		}
+		if (c->conn == pesp_conn || (
+				c->conn->proto.tcp->remote_port ==
+					pesp_conn->proto.tcp->remote_port &&
+				os_memcmp(c->conn->proto.tcp->remote_ip,
+					pesp_conn->proto.tcp->remote_ip, 4) == 0)) {
+			return c;
+		}
+	}
+	return NULL;
+}
+
 
 static void ICACHE_FLASH_ATTR
 _receive(void *arg, char *data, uint16_t length) {
-	SPError err = _parse_request((unsigned char*)data, length);
-	if(SP_OK != err) {
-		os_printf("Cannot parse request\r\n");
-		sp_tcpserver_cleanup_request();
-		sp_tcpserver_response(err, NULL, 0);
+	SPConnection *c = _find_connection((struct espconn*) arg);
+	uint16_t consumed = 0;
+	StatsZone previous;
+
+	if (c == NULL) {
+		return;
+	}
+	previous = stats_enter(STATS_ZONE_NETWORK);
+	TRACE_BEGIN(TRACE_RECEIVE, length);
+	stats_count(STATS_BYTES_RECEIVED, length);
+	// Earlier input goes first.
+	if (!c->rx_length) {
+		consumed = _parse(c, (unsigned char*)data, length);
+	}
+	if (c->in_use && consumed < length) {
+		_stash(c, (unsigned char*)data + consumed, length - consumed);
+	}
+	TRACE_END(TRACE_RECEIVE, consumed);
+	stats_leave(previous);
+}
+
+
+// The response at the head of the TX queue went out.
+static void ICACHE_FLASH_ATTR
+_transmitted(SPConnection *c) {
+	SPResumeCallback resume;
+	StatsZone previous;
+	StatsZone zone;
+
+	previous = stats_enter(STATS_ZONE_NETWORK);
+	TRACE_BEGIN(TRACE_SENT, c->txqueue_count);
+	stats_sample_heap();
+	resume = c->resume_callback;
+	if (c->txqueue_count) {
+		pool_free(c->txqueue[c->txqueue_head].buffer);
+		c->txqueue_head = (c->txqueue_head + 1) % SP_TCPSERVER_TXQUEUE_SIZE;
+		c->txqueue_count--;
+	}
+	c->txqueue_sending = false;
+	_txqueue_send_next(c);
+
+	// Wake up a paused producer, now that there is room again.
+	if (resume != NULL) {
+		c->resume_callback = NULL;
+		c->abort_callback = NULL;
+		sp_dispatching = c;
+		zone = stats_enter(STATS_ZONE_PROCESS);
+		resume();
+		stats_leave(zone);
+		sp_dispatching = NULL;
+	}
+
+	// Then carry on with pipelined requests.
+	_resume_parsing(c);
+	TRACE_END(TRACE_SENT, c->txqueue_count);
+	stats_leave(previous);
+}
+
+
+static void ICACHE_FLASH_ATTR
+_sent(void *arg) {
+	SPConnection *c = _find_connection((struct espconn*) arg);
+	if (c != NULL) {
+		_transmitted(c);
+	}
+}
+
+
+// The client went away, stop its paused producer and whatever else runs
+// on its behalf before its state and lease are dropped.
+static void ICACHE_FLASH_ATTR
+_abort_producer(SPConnection *c) {
+	SPAbortCallback abort = c->abort_callback;
+
+	if (sp_gone_callback != NULL) {
+		sp_gone_callback(c);
+	}
+	if (c->resume_callback == NULL) {
 		return;
 	}
+	c->resume_callback = NULL;
+	c->abort_callback = NULL;
+	if (abort != NULL) {
+		abort();
+	}
 }
 
 
@@ -94,12 +766,12 @@ void _client_reconnect(void *arg, sint8 err)
 {
     struct espconn *pesp_conn = (struct espconn*) arg;
 	// TODO: use macro for IPs
-    os_printf("SP TCPSERVER: %d.%d.%d.%d:%d err %d reconnect\n", 
+    LOG_WARN("SP TCPSERVER: %d.%d.%d.%d:%d err %d reconnect",
 			pesp_conn->proto.tcp->remote_ip[0],
     		pesp_conn->proto.tcp->remote_ip[1],
 			pesp_conn->proto.tcp->remote_ip[2],
     		pesp_conn->proto.tcp->remote_ip[3],
-			pesp_conn->proto.tcp->remote_port, 
+			pesp_conn->proto.tcp->remote_port,
 			err
 	);
 }
@@ -109,22 +781,33 @@ static ICACHE_FLASH_ATTR
 void _client_disconnected(void *arg)
 {
     struct espconn *pesp_conn = (struct espconn*) arg;
+	SPConnection *c = _find_connection(pesp_conn);
 
-    os_printf("SP TCPSERVER: %d.%d.%d.%d:%d disconnect\n", 
+    LOG_INFO("SP TCPSERVER: %d.%d.%d.%d:%d disconnect",
 			pesp_conn->proto.tcp->remote_ip[0],
         	pesp_conn->proto.tcp->remote_ip[1],
 			pesp_conn->proto.tcp->remote_ip[2],
         	pesp_conn->proto.tcp->remote_ip[3],
 			pesp_conn->proto.tcp->remote_port
 	);
+	if (c == NULL) {
+		return;
+	}
+	_abort_producer(c);
+	_reset_connection(c);
+	c->in_use = false;
+	c->conn = NULL;
+	_release_lease(c);
 }
 
 
 static ICACHE_FLASH_ATTR
 void _client_connected(void *arg) {
     struct espconn *pesp_conn = arg;
+	SPConnection *c = NULL;
+	uint8_t i;
 
-    os_printf("SP TCPSERVER: %d.%d.%d.%d:%d connected\n", 
+    LOG_INFO("SP TCPSERVER: %d.%d.%d.%d:%d connected",
 			pesp_conn->proto.tcp->remote_ip[0],
         	pesp_conn->proto.tcp->remote_ip[1],
 			pesp_conn->proto.tcp->remote_ip[2],
@@ -132,63 +815,379 @@ void _client_connected(void *arg) {
 			pesp_conn->proto.tcp->remote_port
 	);
 
+	for (i = 0; i < SP_TCPSERVER_MAX_CLIENTS; i++) {
+		if (!sp_connections[i].in_use) {
+			c = &sp_connections[i];
+			break;
+		}
+	}
+	if (c == NULL) {
+		LOG_WARN("SP TCPSERVER: too many clients");
+		espconn_disconnect(pesp_conn);
+		return;
+	}
+
     espconn_regist_recvcb(pesp_conn, _receive);
+    espconn_regist_sentcb(pesp_conn, _sent);
     espconn_regist_reconcb(pesp_conn, _client_reconnect);
     espconn_regist_disconcb(pesp_conn, _client_disconnected);
+	_reset_connection(c);
+	c->conn = pesp_conn;
+	c->in_use = true;
+}
+
+
+// Serve the UART like one more client, until closed.
+void ICACHE_FLASH_ATTR
+sp_tcpserver_serial_open() {
+	_reset_connection(&sp_serial);
+	sp_serial.serial = true;
+	sp_serial.in_use = true;
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_serial_close() {
+	if (!sp_serial.in_use) {
+		return;
+	}
+	_abort_producer(&sp_serial);
+	_reset_connection(&sp_serial);
+	sp_serial.in_use = false;
+	_release_lease(&sp_serial);
+}
+
+
+// Parse bytes received on the UART, returns the number consumed.  The
+// rest stays with the caller until sp_uart_resume() asks for it again.
+uint16_t ICACHE_FLASH_ATTR
+sp_tcpserver_serial_receive(const unsigned char *data, uint16_t length) {
+	uint16_t consumed;
+	StatsZone previous;
+
+	if (!sp_serial.in_use) {
+		return length;
+	}
+	previous = stats_enter(STATS_ZONE_NETWORK);
+	TRACE_BEGIN(TRACE_RECEIVE, length);
+	consumed = _parse(&sp_serial, data, length);
+	stats_count(STATS_BYTES_RECEIVED, consumed);
+	TRACE_END(TRACE_RECEIVE, consumed);
+	stats_leave(previous);
+	return consumed;
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_serial_sent() {
+	if (sp_serial.in_use) {
+		_transmitted(&sp_serial);
+	}
+}
+
+
+// Whether the UART client has nothing to send and no producer waiting.
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_serial_idle() {
+	return !sp_serial.txqueue_count && sp_serial.resume_callback == NULL &&
+		!sp_serial.yielding;
 }
 
 
 void ICACHE_FLASH_ATTR
 sp_tcpserver_cleanup_request() {
-	// Cleaning up
-	if (sp_current_request.body) {
-		os_free(sp_current_request.body);
+	if (sp_dispatching != NULL) {
+		_cleanup_request(sp_dispatching);
+	}
+}
+
+
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_register_stream(uint8_t command, SPChunkCallback consumer) {
+	if (sp_streams_count >= SP_TCPSERVER_MAX_STREAMS) {
+		return false;
+	}
+	sp_streams[sp_streams_count].command = command;
+	sp_streams[sp_streams_count].consumer = consumer;
+	sp_streams_count++;
+	return true;
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_set_lease_callback(SPLeaseCallback callback) {
+	sp_lease_callback = callback;
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_lease_command(uint8_t command) {
+	if (command < 32) {
+		sp_lease_commands |= 1UL << command;
+	}
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_set_gone_callback(SPGoneCallback callback) {
+	sp_gone_callback = callback;
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_share_command(uint8_t command) {
+	if (command < 32) {
+		sp_shared_commands |= 1UL << command;
+	}
+}
+
+
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_txqueue_available() {
+	SPConnection *c = _target();
+	return sp_capture_buffer != NULL || c == NULL || _txqueue_available(c);
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_capture_begin(char *buffer, uint32_t size) {
+	sp_capture_buffer = buffer;
+	sp_capture_size = size;
+	sp_capture_length = 0;
+	sp_capture_overflow = false;
+}
+
+
+// Stop capturing, returns the captured length or -1 if it did not fit.
+int32_t ICACHE_FLASH_ATTR
+sp_tcpserver_capture_end() {
+	sp_capture_buffer = NULL;
+	return sp_capture_overflow ? -1 : sp_capture_length;
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_resume_when_available(SPResumeCallback resume,
+		SPAbortCallback abort) {
+	SPConnection *c = _target();
+	if (c != NULL) {
+		c->resume_callback = resume;
+		c->abort_callback = abort;
+	}
+}
+
+
+// Client the responses go to, the one being served or the lease holder.
+SPConnection * ICACHE_FLASH_ATTR
+sp_tcpserver_client() {
+	return _target();
+}
+
+
+// Serves the given client from now on, e.g. for the frames of a job
+// outside of its request.  Returns the previous one, NULL for the lease
+// holder.
+SPConnection * ICACHE_FLASH_ATTR
+sp_tcpserver_set_client(SPConnection *c) {
+	SPConnection *previous = sp_dispatching;
+	sp_dispatching = c;
+	return previous;
+}
+
+
+// Whether a client, or the programmer itself, holds the programming lease.
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_connected() {
+	return sp_lease != NULL || sp_lease_local;
+}
+
+
+// Take the programming lease for the programmer itself, false if it is
+// held already.  Clients may only run shared commands until released.
+// The lease callback is not called, the services stay up: the local user
+// of the lease is one of them.
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_lease_acquire() {
+	if (sp_tcpserver_connected()) {
+		return false;
 	}
-	os_memset(&sp_current_request, 0, sizeof(SPPacket));
+	LOG_INFO("SP TCPSERVER: programming lease taken locally");
+	sp_lease_local = true;
+	return true;
 }
 
 
 void ICACHE_FLASH_ATTR
+sp_tcpserver_lease_release() {
+	if (!sp_lease_local) {
+		return;
+	}
+	LOG_INFO("SP TCPSERVER: programming lease released locally");
+	sp_lease_local = false;
+}
+
+
+// Address of the client holding the programming lease, false if none
+// does or it is the UART or the programmer itself.
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_lease_remote(uint8_t *ip) {
+	if (sp_lease == NULL || sp_lease->serial) {
+		return false;
+	}
+	os_memcpy(ip, sp_lease->conn->proto.tcp->remote_ip, 4);
+	return true;
+}
+
+
+// Whether the client being served holds the programming lease.
+bool ICACHE_FLASH_ATTR
+sp_tcpserver_holds_lease() {
+	return sp_dispatching != NULL && sp_dispatching == sp_lease;
+}
+
+
+uint8_t ICACHE_FLASH_ATTR
+sp_tcpserver_clients() {
+	uint8_t i, count = 0;
+	for (i = 0; i < SP_TCPSERVER_MAX_CLIENTS; i++) {
+		if (sp_connections[i].in_use) {
+			count++;
+		}
+	}
+	return count + sp_serial.in_use;
+}
+
+
+SPResponseMode ICACHE_FLASH_ATTR
+sp_tcpserver_response_mode() {
+	return sp_response_mode;
+}
+
+
+// Sets the framing of the following responses, returns the previous one.
+SPResponseMode ICACHE_FLASH_ATTR
+sp_tcpserver_set_response_mode(SPResponseMode mode) {
+	SPResponseMode previous = sp_response_mode;
+	sp_response_mode = mode;
+	return previous;
+}
+
+
+bool ICACHE_FLASH_ATTR
 sp_tcpserver_response(int8_t status, const char *buffer, uint32_t length) {
-	
-	uint32_t total_length = 5 + length;
 
-	// Allocate memory for send buffer	
-    unsigned char *tcpbuffer = (unsigned char *)os_zalloc(total_length);
-	
-	// Copy 5 bytes of head 
-	tcpbuffer[0] = status;
-	bigendian_serialize_uint32(tcpbuffer + 1, length);
+	uint8_t head_length = 5;
+	uint32_t total_length;
+	uint32_t wire_length = length;
+	SPConnection *c = _target();
+	SPTxItem *item;
+	unsigned char *extra;
+
+	if (sp_capture_buffer != NULL) {
+		if (sp_capture_length + length > sp_capture_size) {
+			sp_capture_overflow = true;
+			return false;
+		}
+		os_memcpy(sp_capture_buffer + sp_capture_length, buffer, length);
+		sp_capture_length += length;
+		return true;
+	}
+
+	if (c == NULL) {
+		// The client went away meanwhile.
+		return false;
+	}
+	if (!_txqueue_available(c)) {
+		LOG_WARN("SP TCPSERVER: TX queue full, response dropped");
+		return false;
+	}
+
+	if (sp_response_mode.tagged) {
+		head_length += 2;
+	}
+	if (sp_response_mode.compressed) {
+		head_length += 4;
+		wire_length = sp_codec_bound(length);
+	}
+	total_length = head_length + wire_length;
+
+	// Take a send buffer from the pools, the queue owns it until it is sent.
+    unsigned char *tcpbuffer = (unsigned char *)pool_alloc(total_length);
+	if (tcpbuffer == NULL) {
+		return false;
+	}
 
 	// Body, if provided
-    if (length > 0) {
-        os_memcpy(tcpbuffer + 5, buffer, length);
+	if (sp_response_mode.compressed) {
+		wire_length = length ? sp_codec_encode((const unsigned char *)buffer,
+				length, tcpbuffer + head_length) : 0;
+		total_length = head_length + wire_length;
+	}
+	else if (length > 0) {
+        os_memcpy(tcpbuffer + head_length, buffer, length);
     }
 
-	// Finally, send the buffer
-	espconn_sent(esp_conn, tcpbuffer, total_length);
-	
-	// Free allocated memory
-    os_free(tcpbuffer);
+	// Copy 5 bytes of head, then the tag and decoded length if any
+	tcpbuffer[0] = status;
+	bigendian_serialize_uint32(tcpbuffer + 1, wire_length);
+	extra = tcpbuffer + 5;
+	if (sp_response_mode.tagged) {
+		tcpbuffer[0] |= SP_TAG_FLAG;
+		extra = bigendian_serialize_uint16(extra, sp_response_mode.tag);
+	}
+	if (sp_response_mode.compressed) {
+		bigendian_serialize_uint32(extra, length);
+	}
+
+	// Finally, queue the buffer
+	item = &c->txqueue[(c->txqueue_head + c->txqueue_count) %
+		SP_TCPSERVER_TXQUEUE_SIZE];
+	item->buffer = tcpbuffer;
+	item->length = total_length;
+	c->txqueue_count++;
+	_txqueue_send_next(c);
+	stats_milestone(STATS_MILESTONE_FIRST_RESPONSE);
+	return true;
 }
 
 
+// Requests of every transport go to request_callback, the TCP listener is
+// started separately once there is a network.
 ICACHE_FLASH_ATTR
 void sp_tcpserver_initialize(SPRequestCallback request_callback) {
+	sp_request_callback = request_callback;
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_listen() {
+	if (esp_conn != NULL) {
+		return;
+	}
 	esp_conn = (struct espconn*) os_zalloc(sizeof(struct espconn));
     esp_conn->type = ESPCONN_TCP;
     esp_conn->state = ESPCONN_NONE;
     esp_conn->proto.tcp = (esp_tcp*) os_zalloc(sizeof(esp_tcp));
     esp_conn->proto.tcp->local_port = SP_TCPSERVER_PORT;
     espconn_regist_connectcb(esp_conn, _client_connected);
-	sp_request_callback = request_callback;
     espconn_accept(esp_conn);
+	espconn_tcp_set_max_con_allow(esp_conn, SP_TCPSERVER_MAX_CLIENTS);
 }
 
 
+// Drop the TCP clients and stop listening, the UART client stays.
 void ICACHE_FLASH_ATTR
-sp_tcpserver_shutdown() {
-	sp_tcpserver_cleanup_request();
+sp_tcpserver_close() {
+	SPConnection *c;
+	uint8_t i;
+	for (i = 0; i < SP_TCPSERVER_MAX_CLIENTS; i++) {
+		c = &sp_connections[i];
+		_abort_producer(c);
+		_reset_connection(c);
+		c->in_use = false;
+		c->conn = NULL;
+		_release_lease(c);
+	}
 	if (esp_conn) {
 		espconn_abort(esp_conn);
 		espconn_delete(esp_conn);
@@ -197,3 +1196,22 @@ sp_tcpserver_shutdown() {
 		esp_conn = NULL;
 	}
 }
+
+
+void ICACHE_FLASH_ATTR
+sp_tcpserver_shutdown() {
+	sp_tcpserver_close();
+	_abort_producer(&sp_serial);
+	_reset_connection(&sp_serial);
+	sp_serial.in_use = false;
+	if (sp_lease != NULL && sp_lease_callback != NULL) {
+		sp_lease_callback(false);
+	}
+	sp_lease = NULL;
+	sp_lease_callback = NULL;
+	sp_gone_callback = NULL;
+	sp_dispatching = NULL;
+	sp_streams_count = 0;
+	sp_shared_commands = 0;
+	sp_lease_commands = 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * SP over UART0.
+ *
+ * The same framing and dispatcher as over TCP, for a programmer wired to
+ * the host with a USB serial adapter.  The interrupt handler only moves
+ * bytes from the RX FIFO into a ring and posts the task; the task hands
+ * the ring to the TCP server's parser and feeds the TX FIFO from the
+ * response being sent.  Once the ring is full the RX interrupts stay off,
+ * the FIFO fills up and the UART deasserts RTS on GPIO15 until the parser
+ * caught up.  CTS is not available, GPIO13 is the LED.
+ *
+ * There is no connection to lose: after SP_UART_IDLE_TIMEOUT without
+ * input, and nothing in progress, the client is closed and opened again,
+ * which releases the lease and drops a partly received request.
+ */
+
+#include "sp_uart.h"
+#include "sp_tcpserver.h"
+#include "sp_job.h"
+#include "log.h"
+
+#include <c_types.h>
+#include <ets_sys.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <user_interface.h>
+#include <driver/uart.h>
+#include <driver/uart_register.h>
+
+
+#define UART_TX_FIFO_SIZE	128
+
+#define SP_UART_RX_INTS		(UART_RXFIFO_FULL_INT_ENA | \
+		UART_RXFIFO_TOUT_INT_ENA)
+
+
+// Filled by the interrupt handler at head, emptied by the task at tail.
+static unsigned char rx_ring[SP_UART_RX_BUFFER];
+static volatile uint16_t rx_head;
+static volatile uint16_t rx_tail;
+
+// Response going out, owned by the TX queue of the TCP server.
+static const unsigned char *tx_data;
+static uint16_t tx_length;
+static uint16_t tx_sent;
+
+static bool active;
+static os_event_t uart_queue[1];
+static ETSTimer idle_timer;
+
+
+#define _rx_count() ((uint16_t)(rx_head - rx_tail))
+
+
+// Runs from IRAM, it must not touch flash.
+static void
+_isr(void *arg) {
+	uint32_t status = READ_PERI_REG(UART_INT_ST(UART0));
+	uint8_t count;
+
+	if (status & SP_UART_RX_INTS) {
+		count = (READ_PERI_REG(UART_STATUS(UART0)) >> UART_RXFIFO_CNT_S) &
+			UART_RXFIFO_CNT;
+		while (count-- && _rx_count() < SP_UART_RX_BUFFER) {
+			rx_ring[rx_head++ % SP_UART_RX_BUFFER] =
+				READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
+		}
+		if (_rx_count() == SP_UART_RX_BUFFER) {
+			// Leave the rest in the FIFO, RTS holds the sender off.
+			CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), SP_UART_RX_INTS);
+		}
+	}
+	if (status & UART_TXFIFO_EMPTY_INT_ST) {
+		CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
+	}
+	WRITE_PERI_REG(UART_INT_CLR(UART0), status);
+	system_os_post(SP_UART_TASK_PRIO, 0, 0);
+}
+
+
+static void ICACHE_FLASH_ATTR
+_transmit() {
+	uint16_t room;
+
+	if (tx_data == NULL) {
+		return;
+	}
+	room = UART_TX_FIFO_SIZE - ((READ_PERI_REG(UART_STATUS(UART0))
+			>> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT);
+	while (room > 0 && tx_sent < tx_length) {
+		WRITE_PERI_REG(UART_FIFO(UART0), tx_data[tx_sent++]);
+		room--;
+	}
+	if (tx_sent < tx_length) {
+		SET_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
+		return;
+	}
+	// In the FIFO counts as sent, like in the stack's buffers over TCP.
+	tx_data = NULL;
+	sp_tcpserver_serial_sent();
+}
+
+
+// Parse what the ring holds, as far as the client is not busy.
+static void ICACHE_FLASH_ATTR
+_receive() {
+	uint16_t offset;
+	uint16_t chunk;
+	uint16_t consumed;
+	bool received = false;
+
+	while (active && _rx_count()) {
+		offset = rx_tail % SP_UART_RX_BUFFER;
+		chunk = _rx_count();
+		if (chunk > SP_UART_RX_BUFFER - offset) {
+			// Up to the end of the ring, the rest comes next round.
+			chunk = SP_UART_RX_BUFFER - offset;
+		}
+		consumed = sp_tcpserver_serial_receive(rx_ring + offset, chunk);
+		rx_tail += consumed;
+		received |= consumed > 0;
+		if (consumed < chunk) {
+			break;
+		}
+	}
+	if (!active) {
+		return;
+	}
+	if (_rx_count() < SP_UART_RX_BUFFER) {
+		SET_PERI_REG_MASK(UART_INT_ENA(UART0), SP_UART_RX_INTS);
+	}
+	if (received) {
+		os_timer_disarm(&idle_timer);
+		os_timer_arm(&idle_timer, SP_UART_IDLE_TIMEOUT, 0);
+	}
+}
+
+
+static void ICACHE_FLASH_ATTR
+_task(os_event_t *event) {
+	_transmit();
+	_receive();
+}
+
+
+// Start over once the client went quiet.
+static void ICACHE_FLASH_ATTR
+_idle(void *arg) {
+	if (!active) {
+		return;
+	}
+	if (sp_job_running() || tx_data != NULL || _rx_count() ||
+			!sp_tcpserver_serial_idle()) {
+		os_timer_arm(&idle_timer, SP_UART_IDLE_TIMEOUT, 0);
+		return;
+	}
+	sp_tcpserver_serial_close();
+	sp_tcpserver_serial_open();
+}
+
+
+bool ICACHE_FLASH_ATTR
+sp_uart_send(const unsigned char *data, uint16_t length) {
+	if (!active || tx_data != NULL) {
+		return false;
+	}
+	tx_data = data;
+	tx_length = length;
+	tx_sent = 0;
+	system_os_post(SP_UART_TASK_PRIO, 0, 0);
+	return true;
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_uart_resume() {
+	if (active) {
+		system_os_post(SP_UART_TASK_PRIO, 0, 0);
+	}
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_uart_initialize(uint32_t baud) {
+	if (active) {
+		return;
+	}
+	// The UART carries SP from now on, the log stays readable over SP.
+	log_detach_uart();
+	system_set_os_print(0);
+	rx_head = rx_tail = 0;
+	tx_data = NULL;
+	system_os_task(_task, SP_UART_TASK_PRIO, uart_queue, 1);
+	os_timer_disarm(&idle_timer);
+	os_timer_setfn(&idle_timer, (os_timer_func_t *)_idle, NULL);
+
+	ETS_UART_INTR_DISABLE();
+	WRITE_PERI_REG(UART_CLKDIV(UART0),
+			(APB_CLK_FREQ / baud) & UART_CLKDIV_CNT);
+	PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTDO_U, FUNC_U0RTS);
+	SET_PERI_REG_MASK(UART_CONF0(UART0), UART_RXFIFO_RST | UART_TXFIFO_RST);
+	CLEAR_PERI_REG_MASK(UART_CONF0(UART0), UART_RXFIFO_RST | UART_TXFIFO_RST);
+	WRITE_PERI_REG(UART_CONF1(UART0),
+			((SP_UART_RX_THRESHOLD & UART_RXFIFO_FULL_THRHD) <<
+				UART_RXFIFO_FULL_THRHD_S) |
+			((SP_UART_TX_THRESHOLD & UART_TXFIFO_EMPTY_THRHD) <<
+				UART_TXFIFO_EMPTY_THRHD_S) |
+			((SP_UART_RTS_THRESHOLD & UART_RX_FLOW_THRHD) <<
+				UART_RX_FLOW_THRHD_S) | UART_RX_FLOW_EN |
+			((SP_UART_RX_TIMEOUT & UART_RX_TOUT_THRHD) <<
+				UART_RX_TOUT_THRHD_S) | UART_RX_TOUT_EN);
+	WRITE_PERI_REG(UART_INT_CLR(UART0), 0xFFFF);
+	WRITE_PERI_REG(UART_INT_ENA(UART0), SP_UART_RX_INTS);
+	ETS_UART_INTR_ATTACH(_isr, NULL);
+	ETS_UART_INTR_ENABLE();
+
+	active = true;
+	sp_tcpserver_serial_open();
+	LOG_INFO("SP UART: serving at %d baud", baud);
+}
+
+
+void ICACHE_FLASH_ATTR
+sp_uart_shutdown() {
+	if (!active) {
+		return;
+	}
+	ETS_UART_INTR_DISABLE();
+	WRITE_PERI_REG(UART_INT_ENA(UART0), 0);
+	os_timer_disarm(&idle_timer);
+	active = false;
+	tx_data = NULL;
+	sp_tcpserver_serial_close();
+}
@@ -0,0 +1,240 @@
+/* 
+ * Performance counters, accumulated since boot or the last reset.
+ *
+ * Besides plain event counters, the CPU time is split into zones with the
+ * cycle counter: code switches to its zone on entry and back on exit, so
+ * nested zones are accounted exclusively, e.g. ICSP shifting within a
+ * network callback only counts as shifting.  Request latencies go into a
+ * small histogram per command.  Boot milestones are kept apart, a reset
+ * of the counters does not move them.
+ */
+
+#include "stats.h"
+#include "bigendian.h"
+#include "log.h"
+
+#include <c_types.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <user_interface.h>
+
+
+static struct {
+	uint32_t counters[STATS_COUNTER_COUNT];
+	uint64_t cycles[STATS_ZONE_COUNT];
+	uint16_t latency[STATS_COMMANDS][STATS_BUCKETS];
+	uint32_t heapMin;
+	uint32_t since;
+	StatsJobs jobs;
+} stats;
+
+static StatsZone zone = STATS_ZONE_NONE;
+static uint32_t zoneStart;
+
+// Microseconds since boot, extended past the 32-bit clock.
+static uint64_t uptime;
+static uint32_t uptimeLast;
+static ETSTimer uptime_timer;
+
+static uint32_t milestones[STATS_MILESTONE_COUNT];
+static uint8_t milestonesReached;
+static const char *milestone_names[] = {"wifi_ready", "first_response"};
+
+
+ICACHE_FLASH_ATTR
+void stats_count(StatsCounter counter, uint32_t amount) {
+	stats.counters[counter] += amount;
+}
+
+
+ICACHE_FLASH_ATTR
+StatsZone stats_enter(StatsZone next) {
+	uint32_t now = stats_ccount();
+	StatsZone previous = zone;
+	stats.cycles[zone] += now - zoneStart;
+	zone = next;
+	zoneStart = now;
+	return previous;
+}
+
+
+ICACHE_FLASH_ATTR
+void stats_leave(StatsZone previous) {
+	stats_enter(previous);
+}
+
+
+ICACHE_FLASH_ATTR
+void stats_latency(uint8_t command, uint32_t us) {
+	uint32_t limit = STATS_BUCKET_BASE;
+	uint8_t bucket = 0;
+
+	if (command >= STATS_COMMANDS) {
+		return;
+	}
+	while (us >= limit && bucket < STATS_BUCKETS - 1) {
+		limit <<= 2;
+		bucket++;
+	}
+	// Saturate rather than wrap.
+	if (stats.latency[command][bucket] != 0xFFFF) {
+		stats.latency[command][bucket]++;
+	}
+}
+
+
+ICACHE_FLASH_ATTR
+void stats_job(bool ok, uint32_t us) {
+	uint32_t limit = STATS_JOB_BUCKET_BASE;
+	uint32_t ms = us / 1000;
+	uint8_t bucket = 0;
+
+	if (ok) {
+		stats.jobs.completed++;
+	}
+	else {
+		stats.jobs.failed++;
+	}
+	while (ms >= limit && bucket < STATS_JOB_BUCKETS - 1) {
+		limit <<= 1;
+		bucket++;
+	}
+	stats.jobs.durations[bucket]++;
+	stats.jobs.totalMs += ms;
+}
+
+
+ICACHE_FLASH_ATTR
+void stats_sample_heap() {
+	uint32_t free = system_get_free_heap_size();
+	if (free < stats.heapMin) {
+		stats.heapMin = free;
+	}
+}
+
+
+ICACHE_FLASH_ATTR
+uint32_t stats_counter(StatsCounter counter) {
+	return stats.counters[counter];
+}
+
+
+ICACHE_FLASH_ATTR
+uint32_t stats_heap_min() {
+	stats_sample_heap();
+	return stats.heapMin;
+}
+
+
+ICACHE_FLASH_ATTR
+const StatsJobs * stats_jobs() {
+	return &stats.jobs;
+}
+
+
+ICACHE_FLASH_ATTR
+uint32_t stats_uptime() {
+	uint32_t now = system_get_time();
+	uptime += now - uptimeLast;
+	uptimeLast = now;
+	return uptime / 1000000;
+}
+
+
+static ICACHE_FLASH_ATTR
+void _uptime_tick(void *arg) {
+	stats_uptime();
+}
+
+
+ICACHE_FLASH_ATTR
+void stats_milestone(StatsMilestone milestone) {
+	if (stats_milestone_reached(milestone)) {
+		return;
+	}
+	stats_uptime();
+	milestones[milestone] = uptime / 1000;
+	milestonesReached |= 1 << milestone;
+	LOG_INFO("STATS: %s %d ms after boot", milestone_names[milestone],
+			milestones[milestone]);
+}
+
+
+ICACHE_FLASH_ATTR
+bool stats_milestone_reached(StatsMilestone milestone) {
+	return (milestonesReached >> milestone) & 1;
+}
+
+
+ICACHE_FLASH_ATTR
+uint32_t stats_milestone_ms(StatsMilestone milestone) {
+	return milestones[milestone];
+}
+
+
+ICACHE_FLASH_ATTR
+const char * stats_milestone_name(StatsMilestone milestone) {
+	return milestone_names[milestone];
+}
+
+
+/*
+ * Serialize the counters into STATS_SERIALIZED_SIZE bytes: numbers of
+ * counters, zones, commands and buckets (1 byte each), CPU clock in MHz
+ * (1 byte), microseconds since the reset, free heap and lowest free heap
+ * (uint32 each), the counters (uint32 each), cycles per zone (uint64
+ * each) and the latency histograms (uint16 per bucket, by command).
+ */
+ICACHE_FLASH_ATTR
+uint16_t stats_serialize(char *buffer) {
+	char *cursor = buffer;
+	uint8_t i, j;
+
+	stats_sample_heap();
+	// Account the running zone up to now.
+	stats_enter(zone);
+
+	*cursor++ = STATS_COUNTER_COUNT;
+	*cursor++ = STATS_ZONE_COUNT - 1;
+	*cursor++ = STATS_COMMANDS;
+	*cursor++ = STATS_BUCKETS;
+	*cursor++ = system_get_cpu_freq();
+	cursor = bigendian_serialize_uint32(cursor, 
+			system_get_time() - stats.since);
+	cursor = bigendian_serialize_uint32(cursor, system_get_free_heap_size());
+	cursor = bigendian_serialize_uint32(cursor, stats.heapMin);
+	for (i = 0; i < STATS_COUNTER_COUNT; i++) {
+		cursor = bigendian_serialize_uint32(cursor, stats.counters[i]);
+	}
+	for (i = 1; i < STATS_ZONE_COUNT; i++) {
+		cursor = bigendian_serialize_uint32(cursor, stats.cycles[i] >> 32);
+		cursor = bigendian_serialize_uint32(cursor, stats.cycles[i]);
+	}
+	for (i = 0; i < STATS_COMMANDS; i++) {
+		for (j = 0; j < STATS_BUCKETS; j++) {
+			cursor = bigendian_serialize_uint16(cursor, stats.latency[i][j]);
+		}
+	}
+	return cursor - buffer;
+}
+
+
+ICACHE_FLASH_ATTR
+void stats_reset() {
+	os_memset(&stats, 0, sizeof(stats));
+	stats.heapMin = system_get_free_heap_size();
+	stats.since = system_get_time();
+	zoneStart = stats_ccount();
+}
+
+
+ICACHE_FLASH_ATTR
+void stats_initialize() {
+	stats_reset();
+	uptimeLast = 0;
+	stats_uptime();
+	// Keep up with the clock, which wraps about every 71 minutes.
+	os_timer_disarm(&uptime_timer);
+	os_timer_setfn(&uptime_timer, (os_timer_func_t *)_uptime_tick, NULL);
+	os_timer_arm(&uptime_timer, STATS_UPTIME_INTERVAL * 1000, 1);
+}
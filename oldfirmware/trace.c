@@ -0,0 +1,96 @@
+/* 
+ * Begin/end trace points recorded into a RAM ring buffer.
+ *
+ * Each event is stamped with the cycle counter and kept as 8 bytes; the
+ * newest TRACE_EVENTS of them stay in RAM until read out over SP, where
+ * the client turns them into a timeline.  Recording is a mask test and a
+ * few stores, cheap enough for the ICSP and network paths.
+ */
+
+#include "trace.h"
+#include "stats.h"
+#include "bigendian.h"
+
+#include <c_types.h>
+
+
+#if TRACE_EVENTS
+
+typedef struct {
+	uint32_t ccount;
+	uint8_t event;
+	uint8_t phase;
+	uint16_t arg;
+} TraceRecord;
+
+static TraceRecord ring[TRACE_EVENTS];
+
+// Events ever recorded; the ring holds the last TRACE_EVENTS of them.
+static uint32_t recorded;
+
+static uint8_t mask = TRACE_MASK_ALL;
+
+
+ICACHE_FLASH_ATTR
+void trace_record(uint8_t event, uint8_t phase, uint16_t arg) {
+	TraceRecord *record;
+	if (!(mask & (1 << TRACE_CATEGORY(event)))) {
+		return;
+	}
+	record = &ring[recorded++ % TRACE_EVENTS];
+	record->ccount = stats_ccount();
+	record->event = event;
+	record->phase = phase;
+	record->arg = arg;
+}
+
+
+// Events of categories whose bit is clear are not recorded.
+ICACHE_FLASH_ATTR
+void trace_set_mask(uint8_t value) {
+	mask = value;
+}
+
+
+// Serialize up to count events from the given position on, oldest first:
+// cycle counter (uint32), event, phase and argument (uint16) each.  An
+// overwritten position moves up to the oldest event still held.
+ICACHE_FLASH_ATTR
+uint16_t trace_read(uint32_t *position, char *buffer, uint16_t count) {
+	uint32_t oldest = recorded > TRACE_EVENTS ? recorded - TRACE_EVENTS : 0;
+	uint32_t cursor;
+	uint16_t length = 0;
+	TraceRecord *record;
+
+	if (*position < oldest || *position > recorded) {
+		*position = oldest;
+	}
+	for (cursor = *position; cursor != recorded && count; cursor++, count--) {
+		record = &ring[cursor % TRACE_EVENTS];
+		buffer = bigendian_serialize_uint32(buffer, record->ccount);
+		*buffer++ = record->event;
+		*buffer++ = record->phase;
+		buffer = bigendian_serialize_uint16(buffer, record->arg);
+		length++;
+	}
+	return length;
+}
+
+#else
+
+ICACHE_FLASH_ATTR
+void trace_record(uint8_t event, uint8_t phase, uint16_t arg) {
+}
+
+
+ICACHE_FLASH_ATTR
+void trace_set_mask(uint8_t value) {
+}
+
+
+ICACHE_FLASH_ATTR
+uint16_t trace_read(uint32_t *position, char *buffer, uint16_t count) {
+	return 0;
+}
+
+#endif
@@ -4,6 +4,10 @@
 #include "wifi.h"
 #include "user_config.h"
 #include "webadmin.h"
+#include "pool.h"
+#include "log.h"
+#include "stats.h"
+#include "sp.h"
 
 // SDK
 #include <ets_sys.h>
@@ -24,12 +28,12 @@ tick_cb(uint32_t ticks) {
 static void ICACHE_FLASH_ATTR 
 wifi_connect_cb(uint8_t status) {
     if(status == STATION_GOT_IP) {
-		os_printf("Wifi connected\r\n");
+		LOG_INFO("WIFI: up, serving SP");
 		//webadmin_shutdown();
-		sp_initialize();
+		sp_start();
     } else {
-		os_printf("Wifi disconnected\r\n");
-		sp_shutdown();
+		LOG_INFO("WIFI: down, SP over TCP stopped");
+		sp_stop();
     }
 }
 
@@ -37,10 +41,15 @@ wifi_connect_cb(uint8_t status) {
 void ICACHE_FLASH_ATTR 
 user_init(void) {
     uart_init(BIT_RATE_115200, BIT_RATE_115200);
-    os_delay_us(60000);
+	log_initialize();
+	stats_initialize();
+	// Reserve network buffers before anything can fragment the heap.
+	pool_initialize();
+	// The UART does not wait for the network.
+	sp_initialize();
     wifi_initialize(DEVICE_NAME, wifi_connect_cb, tick_cb);
 	webadmin_initialize();
-    os_printf("System started ...\r\n");
+	LOG_INFO("System started");
 }
 
 
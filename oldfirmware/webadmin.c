@@ -1,5 +1,10 @@
 #include "wifi.h"
 #include "webadmin.h"
+#include "pool.h"
+#include "webadmin_metrics.h"
+#include "webadmin_assets.h"
+#include "webadmin_upload.h"
+#include "log.h"
 
 
 #include <user_interface.h>
@@ -11,99 +16,260 @@
 #include <os_type.h>
 
 
-#define FB_RESPONSE_HEADER_FORMAT \
+// Fixed responses live in flash with the pages, see webadmin_assets.h.
+#define WA_TEXT_HEAD \
 	"HTTP/1.0 200 OK\r\n"\
-	"Content-Length: %d\r\n"\
 	"Server: lwIP/1.4.0\r\n"\
-	"Content-type: text/html\r\n"\
-	"Expires: Fri, 10 Apr 2008 14:00:00 GMT\r\n"\
-	"Pragma: no-cache\r\n\r\n"
+	"Content-type: text/plain\r\n"\
+	"Cache-Control: no-store\r\n"\
+	"Connection: close\r\n\r\n"
 
-#define FB_BAD_REQUEST_FORMAT \
+#define WA_BAD_REQUEST_HEAD \
 	"HTTP/1.0 400 BadRequest\r\n"\
-	"Content-Length: 0\r\n"\
-	"Server: lwIP/1.4.0\r\n"
+	"Server: lwIP/1.4.0\r\n"\
+	"Content-type: text/plain\r\n"\
+	"Connection: close\r\n\r\n"
+
+static const char wa_text_head[] ICACHE_RODATA_ATTR STORE_ATTR =
+	WA_TEXT_HEAD;
+
+static const char wa_saved[] ICACHE_RODATA_ATTR STORE_ATTR =
+	WA_TEXT_HEAD "Update Successfull.";
 
-#define HTML_HEADER \
-	"<!DOCTYPE html><html>" \
-	"<head><title>ESP8266 Firstboot config</title></head>" \
-	"<body>\r\n" 
+static const char wa_save_failed[] ICACHE_RODATA_ATTR STORE_ATTR =
+	WA_BAD_REQUEST_HEAD "Error Saving WIFI parameters";
 
-#define HTML_FOOTER "\r\n</body></html>\r\n"
+static const char wa_bad_request[] ICACHE_RODATA_ATTR STORE_ATTR =
+	WA_BAD_REQUEST_HEAD;
 
-#define HTML_FORM \
-	HTML_HEADER \
-	"<form method=\"post\">" \
-	"SSID: <input name=\"ssid\" value=\"%s\"/><br/>" \
-	"PSK: <input name=\"psk\" value=\"%s\"/><br/>" \
-	"<input type=\"submit\" value=\"Connect\" />" \
-	"</form>" \
-	HTML_FOOTER
+static const char wa_programmer_busy[] ICACHE_RODATA_ATTR STORE_ATTR =
+	"HTTP/1.0 409 Conflict\r\n"
+	"Server: lwIP/1.4.0\r\n"
+	"Content-type: text/plain\r\n"
+	"Connection: close\r\n\r\n"
+	"Programmer in use";
+
+static const char wa_metrics_head[] ICACHE_RODATA_ATTR STORE_ATTR =
+	"HTTP/1.0 200 OK\r\n"
+	"Server: lwIP/1.4.0\r\n"
+	"Content-type: text/plain; version=0.0.4\r\n"
+	"Connection: close\r\n\r\n";
 
 
 static struct espconn * esp_conn;
 
 
+// Renders the dynamic part of a response from the position on, returns
+// the length, 0 once done.
+typedef uint16_t (*WARenderCallback)(uint16_t *position, char *buffer,
+		uint16_t size);
+
+// Response being sent, a fixed part out of flash and then a rendered
+// one, a piece per sent callback.  Nothing is held but the position.
+typedef struct {
+	struct espconn *conn;
+	const uint8_t *fixed;
+	uint16_t fixed_length;
+	uint16_t fixed_sent;
+	WARenderCallback render;
+	uint16_t position;
+	ETSTimer retry_timer;
+} WAResponse;
+
+static WAResponse responses[WA_MAX_RESPONSES];
+
+// espconn_sent copies, so one piece is ever needed at a time.
+static char chunk_buffer[WA_CHUNK];
+
+
+// Flash only takes aligned 32-bit reads.
 static void ICACHE_FLASH_ATTR
-webadmin_send_response(bool ok, const char *response_buffer) {
-	uint16_t total_length = 0;
-	uint16_t head_length = 0;
-    char *send_buffer = NULL;
-    char httphead[256];
-    os_memset(httphead, 0, 256);
-	uint16_t response_length = (ok && response_buffer != NULL) ? \
-		os_strlen(response_buffer): 0;
-
-	os_sprintf(
-			httphead, 
-			ok? FB_RESPONSE_HEADER_FORMAT: FB_BAD_REQUEST_FORMAT, 
-			response_length
-		);
-	head_length = os_strlen(httphead);	
-    total_length = head_length + response_length;
-    send_buffer = (char *)os_zalloc(total_length + 1);
-	// Write head
-    os_memcpy(send_buffer, httphead, head_length);
-
-	// Body
-    if (response_length > 0) {
-        os_memcpy(send_buffer+head_length, response_buffer, response_length);
-    }
-
-	espconn_sent(esp_conn, send_buffer, total_length);
-    os_free(send_buffer);
+webadmin_flash_read(char *buffer, const uint8_t *source, uint16_t length) {
+	size_t address = (size_t)source;
+	uint32_t word = 0;
+	uint16_t i;
+
+	for (i = 0; i < length; i++, address++) {
+		if (i == 0 || (address & 3) == 0) {
+			word = *(const uint32_t *)(address & ~3);
+		}
+		buffer[i] = (word >> ((address & 3) * 8)) & 0xFF;
+	}
 }
 
 
+static WAResponse * ICACHE_FLASH_ATTR
+webadmin_find_response(struct espconn *conn) {
+	uint8_t i;
+	for (i = 0; i < WA_MAX_RESPONSES; i++) {
+		if (responses[i].conn == conn) {
+			return &responses[i];
+		}
+	}
+	return NULL;
+}
+
+
+// Send the next piece, or close once the response is complete.
 static void ICACHE_FLASH_ATTR
-webadmin_serve_form() {
-	struct station_config station_conf;
-	char *buffer = (char*) os_zalloc(1024);
-	char *ssid;
-	char *psk;
+webadmin_send_next(WAResponse *r) {
+	uint16_t length = r->fixed_length - r->fixed_sent;
+	uint16_t fixed_sent = r->fixed_sent;
+	uint16_t position = r->position;
+	struct espconn *conn = r->conn;
+	sint8 err;
+
+	if (conn == NULL) {
+		// Gone while waiting for a retry.
+		return;
+	}
+	if (length > WA_CHUNK) {
+		length = WA_CHUNK;
+	}
+	webadmin_flash_read(chunk_buffer, r->fixed + r->fixed_sent, length);
+	r->fixed_sent += length;
+	if (r->render != NULL && length < WA_CHUNK) {
+		length += r->render(&r->position, chunk_buffer + length,
+				WA_CHUNK - length);
+	}
+	if (length == 0) {
+		r->conn = NULL;
+		espconn_disconnect(conn);
+		return;
+	}
+	err = espconn_sent(conn, chunk_buffer, length);
+	if (err == ESPCONN_OK) {
+		return;
+	}
+	if (err == ESPCONN_ARG) {
+		// The connection is gone, free the slot.
+		r->conn = NULL;
+		return;
+	}
 
-	bool ok = wifi_station_get_config(&station_conf);
-	if (ok) {
-		os_sprintf(
-				buffer, 
-				HTML_FORM, 
-				(char *)station_conf.ssid,
-				(char *)station_conf.password
-			);
+	// The stack is busy, e.g. with the buffers of an upload.  The chunk
+	// buffer is shared, so the piece is rendered again next time.
+	r->fixed_sent = fixed_sent;
+	r->position = position;
+	os_timer_disarm(&r->retry_timer);
+	os_timer_setfn(&r->retry_timer, (os_timer_func_t *)webadmin_send_next, r);
+	os_timer_arm(&r->retry_timer, WA_RETRY_INTERVAL, 0);
+}
+
+
+static void ICACHE_FLASH_ATTR
+webadmin_respond(struct espconn *conn, const void *fixed, uint16_t length,
+		WARenderCallback render) {
+	WAResponse *r = webadmin_find_response(conn);
+	if (r == NULL) {
+		r = webadmin_find_response(NULL);
 	}
-	else {
-		os_sprintf(buffer, HTML_FORM, "", "");
+	if (r == NULL) {
+		// All busy, the client may try again.
+		espconn_disconnect(conn);
+		return;
+	}
+	os_timer_disarm(&r->retry_timer);
+	r->conn = conn;
+	r->fixed = fixed;
+	r->fixed_length = length;
+	r->fixed_sent = 0;
+	r->render = render;
+	r->position = 0;
+	webadmin_send_next(r);
+}
+
+
+#define webadmin_respond_fixed(conn, response) \
+	webadmin_respond(conn, response, sizeof(response) - 1, NULL)
+
+
+// Percent-encode a byte of a form value, returns the length written.
+static uint8_t ICACHE_FLASH_ATTR
+webadmin_encode(char *buffer, uint8_t c) {
+	static const char hex[] = "0123456789ABCDEF";
+	if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+			(c >= 'a' && c <= 'z') || c == '-' || c == '_' || c == '.') {
+		buffer[0] = c;
+		return 1;
 	}
+	buffer[0] = '%';
+	buffer[1] = hex[c >> 4];
+	buffer[2] = hex[c & 0xF];
+	return 3;
+}
+
 
-	webadmin_send_response(true, buffer);
-    os_free(buffer);
+/*
+ * The current station settings as a form, ssid=...&psk=..., for the page
+ * to fill in.  The position is the field in the high byte, and in the
+ * low one 0 for its name, then the offset into its value plus one.
+ */
+static uint16_t ICACHE_FLASH_ATTR
+webadmin_render_config(uint16_t *position, char *buffer, uint16_t size) {
+	struct station_config station_conf;
+	const char *names[] = {"ssid=", "&psk="};
+	const uint8_t *values[2];
+	uint8_t sizes[2];
+	uint8_t field, offset;
+	uint16_t length = 0;
+
+	os_memset(&station_conf, 0, sizeof(struct station_config));
+	wifi_station_get_config(&station_conf);
+	values[0] = station_conf.ssid;
+	sizes[0] = sizeof(station_conf.ssid);
+	values[1] = station_conf.password;
+	sizes[1] = sizeof(station_conf.password);
+
+	while ((field = *position >> 8) < 2) {
+		offset = *position & 0xFF;
+		if (offset == 0) {
+			if (length + 5 > size) {
+				break;
+			}
+			os_memcpy(buffer + length, names[field], 5);
+			length += 5;
+			(*position)++;
+			continue;
+		}
+		if (offset > sizes[field] || values[field][offset - 1] == 0) {
+			*position = (field + 1) << 8;
+			continue;
+		}
+		if (length + 3 > size) {
+			break;
+		}
+		length += webadmin_encode(buffer + length, values[field][offset - 1]);
+		(*position)++;
+	}
+	return length;
+}
+
+
+static void ICACHE_FLASH_ATTR
+webadmin_serve_asset(struct espconn *conn, const char *path) {
+	const WAAsset *asset;
+	uint16_t length;
+
+	for (asset = webadmin_assets; asset->path != NULL; asset++) {
+		length = os_strlen(asset->path);
+		if (os_strncmp(path, asset->path, length) == 0 &&
+				(path[length] == ' ' || path[length] == '?')) {
+			break;
+		}
+	}
+	if (asset->path == NULL) {
+		// Anything else is the first page, the form.
+		asset = webadmin_assets;
+	}
+	webadmin_respond(conn, asset->data, asset->length, NULL);
 }
 
 
 static void ICACHE_FLASH_ATTR
 webadmin_update_params_field(struct station_config *wifi_config, 
 		const char *field, const char *value) {
-	os_printf("Updating Field: %s with value: %s\r\n", field, value);
+	LOG_DEBUG("WEBADMIN: updating %s", field);
 	char *target;
 	if (os_strcmp(field, "ssid") == 0) {
 		target = (char*)&wifi_config->ssid;
@@ -138,11 +304,37 @@ webadmin_parse_form(const char *form, struct station_config *wifi_config) {
 }
 
 
+// Value of the Content-Length header among the headers, 0 if missing.
+static uint32_t ICACHE_FLASH_ATTR
+webadmin_content_length(const char *headers, uint16_t length) {
+	static const char name[] = "\ncontent-length:";
+	uint32_t value = 0;
+	uint16_t i, j;
+
+	for (i = 0; i + sizeof(name) - 1 < length; i++) {
+		for (j = 0; j < sizeof(name) - 1; j++) {
+			if ((headers[i + j] | 0x20) != (name[j] | 0x20)) {
+				break;
+			}
+		}
+		if (j < sizeof(name) - 1) {
+			continue;
+		}
+		for (i += j; i < length && headers[i] == ' '; i++);
+		for (; i < length && headers[i] >= '0' && headers[i] <= '9'; i++) {
+			value = value * 10 + headers[i] - '0';
+		}
+		return value;
+	}
+	return 0;
+}
+
+
 static Error ICACHE_FLASH_ATTR
 webadmin_parse_request(char *data, uint16_t length, Request *req) {
-	char *cursor;
 	if (os_strncmp(data, "GET", 3) == 0) {
 		req->verb = GET;
+		req->path = data + 4;
 		req->body_length = 0;
 		req->body =  NULL; 	
 		return OK;
@@ -150,6 +342,7 @@ webadmin_parse_request(char *data, uint16_t length, Request *req) {
 	
 	if (os_strncmp(data, "POST", 4) == 0) {
 		req->verb = POST;
+		req->path = data + 5;
 		req->body = (char*)os_strstr(data, "\r\n\r\n");
 		if (req->body == NULL) {
 			goto error;
@@ -161,39 +354,92 @@ webadmin_parse_request(char *data, uint16_t length, Request *req) {
 
 error:
 	req->body_length = 0;
-	webadmin_send_response(false, NULL);
 	return 1;
 
 }
 
 
+static void ICACHE_FLASH_ATTR
+webadmin_upload_done(struct espconn *conn, bool ok) {
+	if (ok) {
+		webadmin_respond(conn, wa_text_head, sizeof(wa_text_head) - 1,
+				webadmin_upload_render);
+		return;
+	}
+	webadmin_respond(conn, wa_bad_request, sizeof(wa_bad_request) - 1,
+			webadmin_upload_render);
+}
+
+
+// The body follows in segments, each one is programmed before the next.
+static void ICACHE_FLASH_ATTR
+webadmin_start_upload(struct espconn *conn, Request *req, const char *data) {
+	SPError err = webadmin_upload_begin(conn,
+			webadmin_content_length(data, req->body - data),
+			webadmin_upload_done);
+
+	if (err == SP_ERR_BUSY) {
+		webadmin_respond_fixed(conn, wa_programmer_busy);
+		return;
+	}
+	if (err != SP_OK) {
+		webadmin_upload_done(conn, false);
+		return;
+	}
+	webadmin_upload_receive(req->body, req->body_length);
+}
+
+
 static void ICACHE_FLASH_ATTR
 webadmin_webserver_recv(void *arg, char *data, uint16_t length) {
+	struct espconn *conn = arg;
 	Request req;
+
+	if (webadmin_upload_owns(conn)) {
+		webadmin_upload_receive(data, length);
+		return;
+	}
 	if(OK != webadmin_parse_request(data, length, &req)) {
+		webadmin_respond_fixed(conn, wa_bad_request);
+		return;
+	}
+	if (req.verb == POST && os_strncmp(req.path, "/upload ", 8) == 0) {
+		webadmin_start_upload(conn, &req, data);
 		return;
 	}
 
-	os_printf("--> Verb: %s Length: %d Body: %s\r\n", 
-			req.verb == 0 ? "GET" : "POST", 
-			req.body_length, 
-			req.body
-	);
-	if (req.verb == GET) {
-		webadmin_serve_form();
+	LOG_DEBUG("WEBADMIN: %s, %d bytes of body",
+			req.verb == GET ? "GET" : "POST", req.body_length);
+	if (req.verb == GET && os_strncmp(req.path, "/metrics", 8) == 0 &&
+			(req.path[8] == ' ' || req.path[8] == '?')) {
+		webadmin_respond(conn, wa_metrics_head, sizeof(wa_metrics_head) - 1,
+				webadmin_metrics_render);
+	}
+	else if (req.verb == GET && os_strncmp(req.path, "/config", 7) == 0 &&
+			(req.path[7] == ' ' || req.path[7] == '?')) {
+		webadmin_respond(conn, wa_text_head, sizeof(wa_text_head) - 1,
+				webadmin_render_config);
+	}
+	else if (req.verb == GET && os_strncmp(req.path, "/status", 7) == 0 &&
+			(req.path[7] == ' ' || req.path[7] == '?')) {
+		webadmin_respond(conn, wa_text_head, sizeof(wa_text_head) - 1,
+				webadmin_upload_render);
+	}
+	else if (req.verb == GET) {
+		webadmin_serve_asset(conn, req.path);
 	}
 	else {
 		struct station_config station_conf;
 		os_memset(&station_conf, 0, sizeof(struct station_config));
 		webadmin_parse_form(req.body, &station_conf);
 		if(!wifi_station_set_config(&station_conf)) {
-			os_printf("Cannot save WIFI params\r\n");
-			webadmin_send_response(false, "Error Saving WIFI parameters");
+			LOG_WARN("WEBADMIN: cannot save WIFI params");
+			webadmin_respond_fixed(conn, wa_save_failed);
 			return;
 		}
 		
-		os_printf("WIFI params updated sucessfully.\r\n");
-		webadmin_send_response(true, "Update Successfull.");
+		LOG_INFO("WEBADMIN: WIFI params updated");
+		webadmin_respond_fixed(conn, wa_saved);
 		wifi_station_connect();
 		//system_restart();
 	}
@@ -204,8 +450,9 @@ static ICACHE_FLASH_ATTR
 void webadmin_webserver_recon(void *arg, sint8 err)
 {
     struct espconn *pesp_conn = arg;
+	WAResponse *r;
 	// TODO: use macro for IPs
-    os_printf("webserver's %d.%d.%d.%d:%d err %d reconnect\n", 
+    LOG_WARN("WEBADMIN: %d.%d.%d.%d:%d err %d reconnect",
 			pesp_conn->proto.tcp->remote_ip[0],
     		pesp_conn->proto.tcp->remote_ip[1],
 			pesp_conn->proto.tcp->remote_ip[2],
@@ -213,6 +460,22 @@ void webadmin_webserver_recon(void *arg, sint8 err)
 			pesp_conn->proto.tcp->remote_port, 
 			err
 	);
+	// The connection is gone, and with it the response.
+	r = webadmin_find_response(pesp_conn);
+	if (r != NULL) {
+		r->conn = NULL;
+	}
+	webadmin_upload_disconnected(pesp_conn);
+}
+
+
+static ICACHE_FLASH_ATTR
+void webadmin_webserver_sent(void *arg)
+{
+	WAResponse *r = webadmin_find_response(arg);
+	if (r != NULL) {
+		webadmin_send_next(r);
+	}
 }
 
 
@@ -220,8 +483,14 @@ static ICACHE_FLASH_ATTR
 void webadmin_webserver_disconnected(void *arg)
 {
     struct espconn *pesp_conn = arg;
+	WAResponse *r = webadmin_find_response(pesp_conn);
 
-    os_printf("webserver's %d.%d.%d.%d:%d disconnect\n", 
+	if (r != NULL) {
+		r->conn = NULL;
+	}
+	webadmin_upload_disconnected(pesp_conn);
+
+    LOG_DEBUG("WEBADMIN: %d.%d.%d.%d:%d disconnect",
 			pesp_conn->proto.tcp->remote_ip[0],
         	pesp_conn->proto.tcp->remote_ip[1],
 			pesp_conn->proto.tcp->remote_ip[2],
@@ -236,6 +505,7 @@ void webadmin_webserver_listen(void *arg)
 {
     struct espconn *pesp_conn = arg;
     espconn_regist_recvcb(pesp_conn, webadmin_webserver_recv);
+    espconn_regist_sentcb(pesp_conn, webadmin_webserver_sent);
     espconn_regist_reconcb(pesp_conn, webadmin_webserver_recon);
     espconn_regist_disconcb(pesp_conn, webadmin_webserver_disconnected);
 }
@@ -255,6 +525,15 @@ webadmin_initialize() {
 
 void ICACHE_FLASH_ATTR
 webadmin_shutdown() {
+	uint8_t i;
+
+	if (esp_conn == NULL) {
+		return;
+	}
+	for (i = 0; i < WA_MAX_RESPONSES; i++) {
+		os_timer_disarm(&responses[i].retry_timer);
+	}
+	os_memset(responses, 0, sizeof(responses));
 	espconn_abort(esp_conn);
 	espconn_delete(esp_conn);
 	os_free(esp_conn->proto.tcp);
@@ -0,0 +1,91 @@
+"""Gzip the webadmin pages into flash-resident C arrays.
+
+    python3 oldfirmware/webadmin/assets.py
+
+writes oldfirmware/webadmin_assets.c from the files next to this script,
+index.html served as /.  Each asset is the complete HTTP response: the
+head, with the length and Content-Encoding: gzip, then the compressed
+body, so serving it is a plain copy out of flash.  Run it after editing
+a page and commit the result, the firmware build does not need Python.
+"""
+
+import gzip
+import os
+import re
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+OUTPUT = os.path.join(HERE, '..', 'webadmin_assets.c')
+
+TYPES = {
+    '.html': 'text/html; charset=utf-8',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.svg': 'image/svg+xml',
+}
+
+HEAD = (
+    'HTTP/1.0 200 OK\r\n'
+    'Server: lwIP/1.4.0\r\n'
+    'Content-Type: {type}\r\n'
+    'Content-Encoding: gzip\r\n'
+    'Content-Length: {length}\r\n'
+    'Cache-Control: max-age=3600\r\n'
+    'Connection: close\r\n\r\n'
+)
+
+
+def assets():
+    for name in sorted(os.listdir(HERE)):
+        extension = os.path.splitext(name)[1]
+        if extension not in TYPES:
+            continue
+        path = '/' if name == 'index.html' else '/' + name
+        with open(os.path.join(HERE, name), 'rb') as f:
+            # mtime=0 keeps the output the same for the same input.
+            body = gzip.compress(f.read(), compresslevel=9, mtime=0)
+        head = HEAD.format(type=TYPES[extension], length=len(body))
+        yield name, path, head.encode() + body
+
+
+def render(data):
+    lines = []
+    for offset in range(0, len(data), 12):
+        chunk = data[offset:offset + 12]
+        lines.append('\t' + ' '.join(f'0x{b:02X},' for b in chunk))
+    return '\n'.join(lines)
+
+
+def main():
+    out = [
+        '/* Generated by webadmin/assets.py, do not edit */',
+        '',
+        '#include "webadmin_assets.h"',
+        '',
+    ]
+    table = []
+    for name, path, data in assets():
+        symbol = '_' + re.sub(r'\W', '_', name)
+        out += [
+            '',
+            f'// {name}, {len(data)} bytes',
+            f'static const uint8_t {symbol}[] ICACHE_RODATA_ATTR STORE_ATTR = {{',
+            render(data),
+            '};',
+            '',
+        ]
+        table.append(f'\t{{"{path}", {symbol}, sizeof({symbol})}},')
+
+    out += [
+        '',
+        'const WAAsset webadmin_assets[] = {',
+        *table,
+        '\t{NULL, NULL, 0}',
+        '};',
+    ]
+    with open(OUTPUT, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,186 @@
+/* Generated by webadmin/assets.py, do not edit */
+
+#include "webadmin_assets.h"
+
+
+// index.html, 746 bytes
+static const uint8_t _index_html[] ICACHE_RODATA_ATTR STORE_ATTR = {
+	0x48, 0x54, 0x54, 0x50, 0x2F, 0x31, 0x2E, 0x30, 0x20, 0x32, 0x30, 0x30,
+	0x20, 0x4F, 0x4B, 0x0D, 0x0A, 0x53, 0x65, 0x72, 0x76, 0x65, 0x72, 0x3A,
+	0x20, 0x6C, 0x77, 0x49, 0x50, 0x2F, 0x31, 0x2E, 0x34, 0x2E, 0x30, 0x0D,
+	0x0A, 0x43, 0x6F, 0x6E, 0x74, 0x65, 0x6E, 0x74, 0x2D, 0x54, 0x79, 0x70,
+	0x65, 0x3A, 0x20, 0x74, 0x65, 0x78, 0x74, 0x2F, 0x68, 0x74, 0x6D, 0x6C,
+	0x3B, 0x20, 0x63, 0x68, 0x61, 0x72, 0x73, 0x65, 0x74, 0x3D, 0x75, 0x74,
+	0x66, 0x2D, 0x38, 0x0D, 0x0A, 0x43, 0x6F, 0x6E, 0x74, 0x65, 0x6E, 0x74,
+	0x2D, 0x45, 0x6E, 0x63, 0x6F, 0x64, 0x69, 0x6E, 0x67, 0x3A, 0x20, 0x67,
+	0x7A, 0x69, 0x70, 0x0D, 0x0A, 0x43, 0x6F, 0x6E, 0x74, 0x65, 0x6E, 0x74,
+	0x2D, 0x4C, 0x65, 0x6E, 0x67, 0x74, 0x68, 0x3A, 0x20, 0x35, 0x37, 0x34,
+	0x0D, 0x0A, 0x43, 0x61, 0x63, 0x68, 0x65, 0x2D, 0x43, 0x6F, 0x6E, 0x74,
+	0x72, 0x6F, 0x6C, 0x3A, 0x20, 0x6D, 0x61, 0x78, 0x2D, 0x61, 0x67, 0x65,
+	0x3D, 0x33, 0x36, 0x30, 0x30, 0x0D, 0x0A, 0x43, 0x6F, 0x6E, 0x6E, 0x65,
+	0x63, 0x74, 0x69, 0x6F, 0x6E, 0x3A, 0x20, 0x63, 0x6C, 0x6F, 0x73, 0x65,
+	0x0D, 0x0A, 0x0D, 0x0A, 0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x02, 0x03, 0x6D, 0x53, 0x5D, 0x8B, 0xDB, 0x30, 0x10, 0x7C, 0xF7, 0xAF,
+	0xD8, 0x1A, 0xCA, 0x39, 0x70, 0xB6, 0x13, 0x4A, 0xA1, 0x24, 0xB6, 0x1F,
+	0x7A, 0x77, 0x85, 0xA3, 0x2D, 0x0D, 0xCD, 0x95, 0xD2, 0x47, 0x45, 0x5A,
+	0xC7, 0x22, 0x96, 0x65, 0xA4, 0x75, 0x3E, 0x7A, 0xDC, 0x7F, 0xEF, 0x2A,
+	0x76, 0xB8, 0x16, 0xFA, 0x60, 0x76, 0xBD, 0x9A, 0x5D, 0xCD, 0x8E, 0xC7,
+	0xC5, 0x9B, 0xFB, 0x6F, 0x77, 0x4F, 0xBF, 0xD6, 0x0F, 0xD0, 0x90, 0x69,
+	0xAB, 0xA8, 0xB8, 0x06, 0x14, 0x8A, 0x83, 0x41, 0x12, 0x20, 0x1B, 0xE1,
+	0x3C, 0x52, 0x19, 0x0F, 0x54, 0xA7, 0x1F, 0xE2, 0x6B, 0xB9, 0x13, 0x06,
+	0xCB, 0xF8, 0xA0, 0xF1, 0xD8, 0x5B, 0x47, 0x31, 0x48, 0xDB, 0x11, 0x76,
+	0x0C, 0x3B, 0x6A, 0x45, 0x4D, 0xA9, 0xF0, 0xA0, 0x25, 0xA6, 0x97, 0x97,
+	0x5B, 0xD0, 0x9D, 0x26, 0x2D, 0xDA, 0xD4, 0x4B, 0xD1, 0x62, 0xB9, 0x08,
+	0x43, 0x48, 0x53, 0x8B, 0xD5, 0x4F, 0xFD, 0x49, 0xC3, 0xFA, 0xF1, 0x0E,
+	0xD6, 0xCE, 0xEE, 0x9C, 0x30, 0x06, 0x5D, 0x91, 0x8F, 0x47, 0x51, 0xE1,
+	0xE9, 0x1C, 0xE2, 0xD6, 0xAA, 0x33, 0x3C, 0x43, 0xCD, 0x17, 0xA4, 0xB5,
+	0x30, 0xBA, 0x3D, 0x2F, 0xC1, 0x8B, 0xCE, 0xA7, 0x1E, 0x9D, 0xAE, 0x57,
+	0x60, 0xC4, 0x69, 0xBC, 0x67, 0x09, 0xEF, 0xE6, 0x68, 0x42, 0xC1, 0xED,
+	0x74, 0xB7, 0x84, 0x05, 0x1A, 0x10, 0x03, 0xD9, 0x15, 0xF4, 0x42, 0x29,
+	0xDD, 0xED, 0x96, 0x30, 0x0F, 0xC5, 0x15, 0xBC, 0x44, 0xAD, 0xD8, 0x62,
+	0xCB, 0x53, 0x95, 0xF6, 0x7D, 0x2B, 0x78, 0xE2, 0xB6, 0xB5, 0x72, 0xFF,
+	0xDA, 0x9B, 0xBD, 0xE7, 0xE6, 0x79, 0x40, 0xEA, 0xAE, 0x1F, 0x88, 0x91,
+	0xD3, 0x15, 0x8B, 0xF9, 0xFC, 0xED, 0x0A, 0xB6, 0xF6, 0x94, 0x7A, 0xFD,
+	0xFB, 0x32, 0x73, 0x6B, 0x9D, 0x42, 0x97, 0x72, 0x29, 0xC0, 0x8B, 0x7C,
+	0xA2, 0x5D, 0xE4, 0x93, 0x8A, 0x81, 0x7F, 0xD0, 0x74, 0xF1, 0xFF, 0x6D,
+	0xB9, 0x1E, 0x15, 0xB5, 0x75, 0x06, 0x58, 0xD7, 0xC6, 0xAA, 0x32, 0xEE,
+	0xAD, 0x67, 0x41, 0x85, 0x24, 0x6D, 0xBB, 0x32, 0xCE, 0x83, 0x5A, 0x17,
+	0xBA, 0xD5, 0x66, 0xF3, 0x78, 0x0F, 0xC5, 0x48, 0x68, 0xD4, 0xDF, 0x7B,
+	0xAD, 0x62, 0xD0, 0x6A, 0xCA, 0xAA, 0x22, 0x1F, 0x91, 0xD7, 0x8E, 0xF5,
+	0xE6, 0xF3, 0xBF, 0x0D, 0xBD, 0xDF, 0x8F, 0xF8, 0x90, 0xFC, 0x05, 0x1F,
+	0x31, 0x74, 0xEE, 0xC3, 0xD0, 0x61, 0x6B, 0x34, 0x33, 0x38, 0x88, 0x76,
+	0xE0, 0xD7, 0x3B, 0xDB, 0x75, 0x28, 0x29, 0xD0, 0xC8, 0x03, 0x4F, 0x8E,
+	0x7D, 0x55, 0x08, 0x68, 0x1C, 0xD6, 0x4C, 0x6F, 0xE8, 0x5B, 0x2B, 0x54,
+	0x16, 0x9C, 0x13, 0x57, 0xD3, 0x62, 0x45, 0x2E, 0x2A, 0x78, 0x85, 0xF0,
+	0x62, 0x4E, 0x4B, 0x1F, 0x57, 0x5F, 0xC7, 0x24, 0x1C, 0x17, 0x79, 0x1F,
+	0x3E, 0xB1, 0x74, 0xBA, 0xA7, 0x2A, 0xCA, 0x73, 0x78, 0x6A, 0x10, 0xE4,
+	0xE0, 0x1C, 0x9B, 0x08, 0xD8, 0x6F, 0xC4, 0xDA, 0x7A, 0x76, 0x95, 0x41,
+	0xA8, 0x9D, 0x35, 0x90, 0xB3, 0xC1, 0x6A, 0xBD, 0xBB, 0x05, 0x62, 0x5C,
+	0x2F, 0x76, 0x08, 0x9A, 0x3C, 0xB6, 0x35, 0x68, 0x0F, 0x9E, 0x04, 0x69,
+	0x99, 0x45, 0x35, 0x92, 0x6C, 0x92, 0x9B, 0x09, 0x7A, 0x33, 0xCB, 0x18,
+	0xDB, 0x25, 0x0E, 0xCA, 0x0A, 0x5C, 0x46, 0x78, 0xA2, 0x64, 0x36, 0xD5,
+	0x28, 0xD4, 0x9E, 0x23, 0x80, 0x0E, 0x8F, 0xF0, 0xE3, 0xFB, 0x97, 0x0D,
+	0x0A, 0x27, 0x9B, 0xB5, 0x60, 0xEE, 0x3E, 0xA1, 0x59, 0xC6, 0x7B, 0x3E,
+	0x08, 0x9E, 0x95, 0x1C, 0x6E, 0x61, 0x3F, 0xBB, 0x82, 0x21, 0xB8, 0xDC,
+	0x13, 0x8C, 0x62, 0x95, 0xA0, 0xAC, 0x1C, 0x0C, 0xF3, 0xCD, 0x76, 0x48,
+	0x0F, 0x2D, 0x86, 0xF4, 0xE3, 0xF9, 0x51, 0x25, 0xFB, 0xD9, 0xEA, 0x82,
+	0xD6, 0x35, 0x24, 0x17, 0xEC, 0x6C, 0x6C, 0xC9, 0x2E, 0x8A, 0x72, 0xE3,
+	0x21, 0x9C, 0xBF, 0x30, 0x2A, 0x3C, 0xEC, 0x98, 0x49, 0x85, 0x22, 0x9F,
+	0xBC, 0x92, 0x8F, 0xFF, 0xE1, 0x1F, 0xD0, 0xDF, 0x14, 0xF4, 0x9F, 0x03,
+	0x00, 0x00,
+};
+
+
+// upload.html, 1227 bytes
+static const uint8_t _upload_html[] ICACHE_RODATA_ATTR STORE_ATTR = {
+	0x48, 0x54, 0x54, 0x50, 0x2F, 0x31, 0x2E, 0x30, 0x20, 0x32, 0x30, 0x30,
+	0x20, 0x4F, 0x4B, 0x0D, 0x0A, 0x53, 0x65, 0x72, 0x76, 0x65, 0x72, 0x3A,
+	0x20, 0x6C, 0x77, 0x49, 0x50, 0x2F, 0x31, 0x2E, 0x34, 0x2E, 0x30, 0x0D,
+	0x0A, 0x43, 0x6F, 0x6E, 0x74, 0x65, 0x6E, 0x74, 0x2D, 0x54, 0x79, 0x70,
+	0x65, 0x3A, 0x20, 0x74, 0x65, 0x78, 0x74, 0x2F, 0x68, 0x74, 0x6D, 0x6C,
+	0x3B, 0x20, 0x63, 0x68, 0x61, 0x72, 0x73, 0x65, 0x74, 0x3D, 0x75, 0x74,
+	0x66, 0x2D, 0x38, 0x0D, 0x0A, 0x43, 0x6F, 0x6E, 0x74, 0x65, 0x6E, 0x74,
+	0x2D, 0x45, 0x6E, 0x63, 0x6F, 0x64, 0x69, 0x6E, 0x67, 0x3A, 0x20, 0x67,
+	0x7A, 0x69, 0x70, 0x0D, 0x0A, 0x43, 0x6F, 0x6E, 0x74, 0x65, 0x6E, 0x74,
+	0x2D, 0x4C, 0x65, 0x6E, 0x67, 0x74, 0x68, 0x3A, 0x20, 0x31, 0x30, 0x35,
+	0x34, 0x0D, 0x0A, 0x43, 0x61, 0x63, 0x68, 0x65, 0x2D, 0x43, 0x6F, 0x6E,
+	0x74, 0x72, 0x6F, 0x6C, 0x3A, 0x20, 0x6D, 0x61, 0x78, 0x2D, 0x61, 0x67,
+	0x65, 0x3D, 0x33, 0x36, 0x30, 0x30, 0x0D, 0x0A, 0x43, 0x6F, 0x6E, 0x6E,
+	0x65, 0x63, 0x74, 0x69, 0x6F, 0x6E, 0x3A, 0x20, 0x63, 0x6C, 0x6F, 0x73,
+	0x65, 0x0D, 0x0A, 0x0D, 0x0A, 0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x02, 0x03, 0x95, 0x56, 0x6D, 0x4F, 0xE3, 0x46, 0x10, 0xFE, 0xCE,
+	0xAF, 0x98, 0x8B, 0x54, 0xC5, 0x16, 0x49, 0x9C, 0x1C, 0xA5, 0x3D, 0x25,
+	0x71, 0x4E, 0x2A, 0xE5, 0x54, 0xA4, 0xAA, 0x87, 0x0A, 0x15, 0xAD, 0x4E,
+	0xF7, 0x61, 0x63, 0x8F, 0xF1, 0x0A, 0xDB, 0x6B, 0xED, 0xAE, 0x09, 0x29,
+	0xC7, 0x7F, 0xEF, 0xB3, 0xBB, 0x76, 0xA0, 0x27, 0x71, 0x6A, 0x85, 0x60,
+	0xED, 0x79, 0x7D, 0xE6, 0x99, 0x99, 0x35, 0xEB, 0x37, 0x3F, 0x7F, 0x3C,
+	0xBB, 0xFE, 0xEB, 0xF2, 0x9C, 0x4A, 0x5B, 0x57, 0x9B, 0xA3, 0xF5, 0x70,
+	0xB0, 0xC8, 0x71, 0xD4, 0x6C, 0x05, 0x65, 0xA5, 0xD0, 0x86, 0x6D, 0x3A,
+	0xEA, 0x6C, 0x31, 0x7D, 0x37, 0x1A, 0xC4, 0x8D, 0xA8, 0x39, 0x1D, 0xDD,
+	0x4B, 0xDE, 0xB5, 0x4A, 0xDB, 0x11, 0x65, 0xAA, 0xB1, 0xDC, 0xC0, 0x6C,
+	0x27, 0x73, 0x5B, 0xA6, 0x39, 0xDF, 0xCB, 0x8C, 0xA7, 0xFE, 0x65, 0x42,
+	0xB2, 0x91, 0x56, 0x8A, 0x6A, 0x6A, 0x32, 0x51, 0x71, 0xBA, 0x70, 0x41,
+	0xAC, 0xB4, 0x15, 0x6F, 0x2E, 0xB5, 0xBA, 0xD5, 0xA2, 0xA6, 0x29, 0xDD,
+	0xC8, 0x0F, 0x92, 0x2E, 0x2F, 0xCE, 0xA8, 0x17, 0xD5, 0xAC, 0xD7, 0x49,
+	0x30, 0x3A, 0x5A, 0x1B, 0xBB, 0x77, 0xE7, 0x56, 0xE5, 0x7B, 0x7A, 0xA4,
+	0x02, 0xA9, 0xA6, 0x85, 0xA8, 0x65, 0xB5, 0x5F, 0x92, 0x11, 0x8D, 0x99,
+	0x1A, 0xD6, 0xB2, 0x58, 0x51, 0x2D, 0x1E, 0x42, 0xC6, 0x25, 0x9D, 0xCC,
+	0xB9, 0x76, 0x02, 0x7D, 0x2B, 0x9B, 0x25, 0x2D, 0xB8, 0x26, 0xD1, 0x59,
+	0xB5, 0xA2, 0x56, 0xE4, 0xB9, 0x6C, 0x6E, 0x97, 0x34, 0x77, 0xC2, 0x15,
+	0x3D, 0x1D, 0xC9, 0xA6, 0xED, 0xEC, 0x84, 0x5A, 0x97, 0x96, 0x8D, 0x41,
+	0xFC, 0x3E, 0xC4, 0x62, 0x3E, 0xFF, 0x6E, 0x45, 0x5B, 0xF5, 0x30, 0x35,
+	0xF2, 0x6F, 0xEF, 0xB3, 0x55, 0x3A, 0x67, 0x3D, 0x85, 0xE8, 0x39, 0xF4,
+	0xEC, 0x14, 0xB1, 0xE7, 0x2E, 0xD0, 0x3A, 0xE9, 0x61, 0xAE, 0x93, 0x9E,
+	0x3F, 0x87, 0xD7, 0xB1, 0xB9, 0x18, 0xEA, 0x84, 0x66, 0x01, 0x41, 0xBB,
+	0xB9, 0x00, 0x59, 0x15, 0xFD, 0x72, 0xFE, 0x27, 0x29, 0x4D, 0x5A, 0xEC,
+	0x68, 0x2B, 0x1B, 0xA1, 0xF7, 0x13, 0xB2, 0x25, 0x53, 0xE0, 0x8E, 0xEA,
+	0xCE, 0x58, 0xDA, 0x32, 0x6D, 0x2B, 0xD1, 0xDC, 0xCD, 0xD6, 0x49, 0x0B,
+	0x4F, 0x0F, 0x96, 0xEC, 0xBE, 0x05, 0xF7, 0x85, 0xAC, 0x78, 0x44, 0x32,
+	0x1F, 0x9E, 0x44, 0x96, 0x71, 0x8B, 0x06, 0xCC, 0x4A, 0x7E, 0x98, 0xCC,
+	0x10, 0x70, 0xF4, 0x95, 0xC3, 0xB6, 0xB3, 0x56, 0x35, 0xC1, 0xA5, 0x0D,
+	0x80, 0x46, 0x74, 0x2F, 0xAA, 0x0E, 0xBA, 0x1E, 0xA0, 0x73, 0x39, 0x30,
+	0x71, 0xB0, 0xC3, 0xCB, 0xC1, 0x70, 0x3E, 0x72, 0x34, 0xA7, 0x23, 0x34,
+	0x11, 0x90, 0x7A, 0xAD, 0xF3, 0xF2, 0xE6, 0xC6, 0x0A, 0xDB, 0x19, 0xAF,
+	0xF2, 0x75, 0xAE, 0x05, 0x95, 0x9A, 0x8B, 0x74, 0x94, 0x8C, 0x36, 0x57,
+	0x6C, 0x2D, 0x68, 0x34, 0xEB, 0x44, 0xF4, 0x7A, 0x93, 0x69, 0xD9, 0xDA,
+	0xCD, 0x11, 0x66, 0x07, 0xA5, 0xB2, 0xD6, 0x4A, 0x1B, 0x4A, 0xE9, 0xF1,
+	0x88, 0xE8, 0xED, 0x92, 0xC6, 0x5C, 0xB7, 0x76, 0x4F, 0xAE, 0xB8, 0xF1,
+	0x84, 0x4E, 0x20, 0x68, 0xD4, 0xC0, 0x8D, 0x6C, 0x3C, 0x53, 0x46, 0x65,
+	0x77, 0x6C, 0xA1, 0xFD, 0x1E, 0x5A, 0x74, 0xD6, 0xC3, 0x56, 0x28, 0x58,
+	0x15, 0x60, 0xB5, 0xB9, 0x85, 0x23, 0x62, 0x9D, 0x42, 0xB9, 0xD3, 0xD2,
+	0x32, 0x15, 0x02, 0xC1, 0x72, 0xD8, 0xFF, 0x08, 0x51, 0x7B, 0x18, 0x34,
+	0xDA, 0x76, 0x66, 0x0F, 0xE9, 0x3B, 0x48, 0x33, 0xD1, 0x64, 0x5C, 0x79,
+	0x2B, 0xB8, 0x9E, 0xBC, 0xF5, 0x69, 0x2D, 0x09, 0xDF, 0xAC, 0x01, 0x8B,
+	0x03, 0x93, 0x95, 0x9C, 0xDD, 0x99, 0xAE, 0xA6, 0x5A, 0x9A, 0x5A, 0xD8,
+	0xAC, 0x74, 0x0A, 0x87, 0x63, 0x30, 0x24, 0xAB, 0xBB, 0x26, 0x13, 0x16,
+	0xA1, 0x8E, 0x9E, 0x56, 0x7D, 0x91, 0xA6, 0x54, 0x3B, 0x94, 0x88, 0x32,
+	0x37, 0xBE, 0xCE, 0x5C, 0x65, 0x5D, 0x8D, 0xBD, 0x99, 0xDD, 0xB2, 0x3D,
+	0xAF, 0xD8, 0x3D, 0xFE, 0xB4, 0xBF, 0xC8, 0xA3, 0xF1, 0x40, 0xED, 0x38,
+	0x9E, 0x81, 0x6F, 0xE7, 0xE2, 0x4C, 0xA2, 0xB1, 0x55, 0x56, 0x54, 0xE3,
+	0x98, 0xBE, 0x7C, 0xA1, 0xC5, 0xEA, 0x3F, 0x06, 0xF0, 0xAD, 0x7B, 0x0E,
+	0xA1, 0x39, 0x63, 0x79, 0x0F, 0x58, 0x3E, 0xCA, 0xDC, 0x45, 0xA9, 0x18,
+	0x43, 0xC2, 0x0F, 0xF6, 0xD9, 0xC8, 0x75, 0x92, 0x61, 0x71, 0x4C, 0x63,
+	0xFC, 0x1C, 0x53, 0xD4, 0xCB, 0x43, 0x03, 0x82, 0xEB, 0x38, 0xE8, 0x27,
+	0xCE, 0x00, 0x41, 0x68, 0xF0, 0xDD, 0x61, 0x4F, 0x4C, 0xEF, 0x1B, 0x9E,
+	0x5D, 0x0E, 0x59, 0x1C, 0x82, 0x0C, 0xC1, 0xD3, 0x94, 0xC6, 0x7D, 0x4F,
+	0x62, 0x4F, 0x07, 0x51, 0x92, 0xD0, 0x0D, 0x5C, 0x68, 0xE8, 0x66, 0x81,
+	0x05, 0x19, 0x3A, 0x85, 0xE9, 0xE9, 0xA7, 0x64, 0x12, 0x18, 0x56, 0x45,
+	0x81, 0xAB, 0xC9, 0xDB, 0xE0, 0x17, 0x5D, 0x20, 0xD5, 0xB0, 0x99, 0xF9,
+	0x40, 0x2F, 0x86, 0x0A, 0x55, 0xFD, 0xD6, 0xD5, 0x5B, 0xD6, 0x43, 0x7E,
+	0x2F, 0x1D, 0xC7, 0xF1, 0xE4, 0x90, 0xE6, 0x6B, 0x8B, 0x5E, 0x0E, 0x9B,
+	0x95, 0x8F, 0xE6, 0xC9, 0x39, 0x06, 0xDC, 0x65, 0x60, 0x23, 0xC0, 0xF8,
+	0xE4, 0x8F, 0xCF, 0x9E, 0x8B, 0x90, 0xC9, 0x29, 0xFD, 0x53, 0x7C, 0xB0,
+	0xA2, 0x4D, 0x8A, 0x39, 0xA2, 0xF7, 0x3E, 0x0E, 0xC1, 0x02, 0x30, 0xB7,
+	0x7B, 0x4C, 0xA3, 0xB3, 0x1D, 0xF2, 0x2F, 0x83, 0x7C, 0xFE, 0xF0, 0x42,
+	0x38, 0xB3, 0xEA, 0xCA, 0x6A, 0x14, 0x1D, 0x2D, 0x7E, 0x08, 0x38, 0x9E,
+	0xBE, 0xD5, 0xF0, 0xB0, 0x7B, 0x68, 0xB7, 0xC3, 0x7A, 0x16, 0xAE, 0x63,
+	0xD4, 0xE5, 0xDE, 0x56, 0x6E, 0x00, 0xC1, 0xEC, 0x35, 0x76, 0xA6, 0x6B,
+	0x2B, 0x25, 0x72, 0x10, 0x55, 0xED, 0x09, 0x77, 0xE7, 0x8E, 0xB1, 0x73,
+	0x0A, 0x33, 0x7F, 0x60, 0x99, 0xF3, 0x17, 0xB7, 0x61, 0xA6, 0x6A, 0x46,
+	0x13, 0xB4, 0xAA, 0x29, 0x09, 0x09, 0x66, 0xFD, 0x24, 0xB7, 0xAA, 0xAA,
+	0x10, 0x3E, 0x8A, 0xDD, 0x28, 0x17, 0x8C, 0x05, 0x88, 0xC6, 0xC9, 0x33,
+	0x86, 0x92, 0x9B, 0x48, 0x3B, 0x95, 0xF6, 0x78, 0xA2, 0x38, 0x06, 0xF6,
+	0x20, 0xB6, 0x4E, 0xDC, 0xF0, 0x8E, 0xFE, 0xF8, 0xFD, 0xD7, 0x2B, 0x16,
+	0x3A, 0x2B, 0x2F, 0x05, 0x12, 0x9B, 0xC8, 0xC6, 0xBD, 0xE3, 0x61, 0x3D,
+	0xC8, 0x2F, 0x4C, 0x64, 0xFA, 0x2E, 0xBC, 0x32, 0x42, 0x2F, 0xE6, 0x03,
+	0x12, 0x4C, 0xC4, 0xB5, 0xAC, 0x19, 0xD7, 0x40, 0xE4, 0x30, 0x4E, 0xE8,
+	0x74, 0x3E, 0x0F, 0xEC, 0xE1, 0xEF, 0xB7, 0xD7, 0x45, 0xD4, 0x80, 0x0E,
+	0x32, 0x2A, 0x99, 0xDD, 0x1D, 0x6A, 0x73, 0x38, 0x42, 0xC9, 0x7E, 0xE6,
+	0xD2, 0xD7, 0x3B, 0xE0, 0xAF, 0x87, 0x78, 0xE6, 0x0E, 0xF3, 0x69, 0xFE,
+	0x79, 0x18, 0xFA, 0x37, 0x4E, 0x10, 0x93, 0x66, 0xDB, 0xE9, 0xC6, 0x09,
+	0x07, 0xB6, 0x42, 0x2B, 0xB0, 0x3F, 0x8F, 0xF8, 0xA4, 0x96, 0x2A, 0xC7,
+	0x10, 0x5C, 0x7E, 0xBC, 0xBA, 0x86, 0xC0, 0x7D, 0x39, 0x96, 0x3E, 0xDF,
+	0xD3, 0x6B, 0x5C, 0xFE, 0x8B, 0x4D, 0x3B, 0x03, 0x1F, 0xDA, 0x9A, 0x1B,
+	0x69, 0xCB, 0x9E, 0x9B, 0x14, 0x54, 0xBC, 0x0F, 0xF4, 0xBD, 0xC2, 0x35,
+	0x2D, 0xFB, 0x91, 0xFC, 0xDF, 0x23, 0xE5, 0xE9, 0x7C, 0x85, 0x67, 0x4C,
+	0x9A, 0x7B, 0x8D, 0xF0, 0x88, 0x2F, 0x62, 0x7F, 0xC3, 0xAF, 0x93, 0xFE,
+	0x5B, 0x98, 0x84, 0xFF, 0x30, 0xFE, 0x01, 0xBE, 0x5E, 0x0F, 0xE7, 0x79,
+	0x08, 0x00, 0x00,
+};
+
+
+const WAAsset webadmin_assets[] = {
+	{"/", _index_html, sizeof(_index_html)},
+	{"/upload.html", _upload_html, sizeof(_upload_html)},
+	{NULL, NULL, 0}
+};
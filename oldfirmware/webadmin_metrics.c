@@ -0,0 +1,237 @@
+/* 
+ * Prometheus text exposition of the programmer's metrics.
+ *
+ * The page is produced line by line from the live counters, so it can be
+ * sent in small pieces without ever holding the whole of it.  A position
+ * names the next line: the metric family in the high byte and the line
+ * within the family in the low one.
+ */
+
+#include "webadmin_metrics.h"
+#include "stats.h"
+#include "pic.h"
+
+#include <c_types.h>
+#include <osapi.h>
+#include <user_interface.h>
+
+
+#define _family(position)	((position) >> 8)
+#define _line(position)		((position) & 0xFF)
+
+
+// Render a line of the job duration histogram; the buckets, then sum and
+// count.  Returns 0 past the end.
+static ICACHE_FLASH_ATTR
+int _job_duration(uint8_t line, char *out) {
+	const StatsJobs *jobs = stats_jobs();
+	uint32_t count = jobs->completed + jobs->failed;
+	uint32_t cumulative = 0;
+	uint32_t le = STATS_JOB_BUCKET_BASE << line;
+	uint8_t i;
+
+	if (line < STATS_JOB_BUCKETS - 1) {
+		for (i = 0; i <= line; i++) {
+			cumulative += jobs->durations[i];
+		}
+		return os_sprintf(out, 
+				"wpp_job_duration_seconds_bucket{le=\"%d.%03d\"} %d\n",
+				le / 1000, le % 1000, cumulative);
+	}
+	switch (line - (STATS_JOB_BUCKETS - 1)) {
+		case 0:
+			return os_sprintf(out, 
+					"wpp_job_duration_seconds_bucket{le=\"+Inf\"} %d\n", count);
+		case 1:
+			return os_sprintf(out, "wpp_job_duration_seconds_sum %d.%03d\n",
+					(uint32_t)(jobs->totalMs / 1000), 
+					(uint32_t)(jobs->totalMs % 1000));
+		case 2:
+			return os_sprintf(out, "wpp_job_duration_seconds_count %d\n", 
+					count);
+	}
+	return 0;
+}
+
+
+// Render the line-th of the milestones reached so far, the others have
+// no sample.  Returns 0 past the end.
+static ICACHE_FLASH_ATTR
+int _milestone(uint8_t line, char *out) {
+	StatsMilestone m;
+
+	for (m = 0; m < STATS_MILESTONE_COUNT; m++) {
+		if (!stats_milestone_reached(m)) {
+			continue;
+		}
+		if (line--) {
+			continue;
+		}
+		return os_sprintf(out,
+				"wpp_boot_milestone_seconds{milestone=\"%s\"} %d.%03d\n",
+				stats_milestone_name(m), stats_milestone_ms(m) / 1000,
+				stats_milestone_ms(m) % 1000);
+	}
+	return 0;
+}
+
+
+// Render the samples of a family, line 0 being its first sample.  Returns
+// 0 past the end of the family.
+static ICACHE_FLASH_ATTR
+int _samples(uint8_t family, uint8_t line, char *out) {
+	const char *name;
+	uint32_t id;
+
+	switch (family) {
+		case 0:
+			return line ? 0 : os_sprintf(out, "wpp_uptime_seconds %d\n", 
+					stats_uptime());
+		case 1:
+			return line ? 0 : os_sprintf(out, "wpp_heap_free_bytes %d\n", 
+					system_get_free_heap_size());
+		case 2:
+			return line ? 0 : os_sprintf(out, "wpp_heap_min_free_bytes %d\n",
+					stats_heap_min());
+		case 3:
+			if (line || wifi_station_get_connect_status() != STATION_GOT_IP) {
+				return 0;
+			}
+			return os_sprintf(out, "wpp_wifi_rssi_dbm %d\n", 
+					wifi_station_get_rssi());
+		case 4:
+			if (line > 1) {
+				return 0;
+			}
+			return os_sprintf(out, "wpp_jobs_total{result=\"%s\"} %d\n",
+					line ? "failed" : "ok", line ? 
+					stats_jobs()->failed : stats_jobs()->completed);
+		case 5:
+			return _job_duration(line, out);
+		case 6:
+			return line ? 0 : os_sprintf(out, 
+					"wpp_words_programmed_total %d\n", 
+					stats_counter(STATS_WORDS_WRITTEN));
+		case 7:
+			return line ? 0 : os_sprintf(out, 
+					"wpp_words_verified_total %d\n", 
+					stats_counter(STATS_WORDS_VERIFIED));
+		case 8:
+			return line ? 0 : os_sprintf(out, "wpp_words_read_total %d\n", 
+					stats_counter(STATS_WORDS_READ));
+		case 9:
+			return line ? 0 : os_sprintf(out, 
+					"wpp_tcp_send_retries_total %d\n", 
+					stats_counter(STATS_SEND_RETRIES));
+		case 10:
+			name = pic_detected_device(&id);
+			if (line || name == NULL) {
+				return 0;
+			}
+			return os_sprintf(out, 
+					"wpp_device_info{name=\"%s\",id=\"0x%04X\"} 1\n", name, id);
+		case 11:
+			return _milestone(line, out);
+	}
+	return -1;
+}
+
+
+// Render the HELP and TYPE lines of a family, then its samples.  Returns
+// 0 past the end of the family, -1 past the last family.
+static ICACHE_FLASH_ATTR
+int _render_line(uint8_t family, uint8_t line, char *out) {
+	if (line >= 2) {
+		return _samples(family, line - 2, out);
+	}
+
+	switch (family) {
+		case 0:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_uptime_seconds gauge\n" : 
+					"# HELP wpp_uptime_seconds Seconds since boot.\n");
+		case 1:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_heap_free_bytes gauge\n" : 
+					"# HELP wpp_heap_free_bytes Free heap.\n");
+		case 2:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_heap_min_free_bytes gauge\n" : 
+					"# HELP wpp_heap_min_free_bytes Lowest free heap seen.\n");
+		case 3:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_wifi_rssi_dbm gauge\n" : 
+					"# HELP wpp_wifi_rssi_dbm Signal of the station.\n");
+		case 4:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_jobs_total counter\n" : 
+					"# HELP wpp_jobs_total Programming runs and background "
+					"jobs by outcome.\n");
+		case 5:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_job_duration_seconds histogram\n" : 
+					"# HELP wpp_job_duration_seconds Programming run and job "
+					"time.\n");
+		case 6:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_words_programmed_total counter\n" : 
+					"# HELP wpp_words_programmed_total Program cycles run.\n");
+		case 7:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_words_verified_total counter\n" : 
+					"# HELP wpp_words_verified_total Words that read back "
+					"right.\n");
+		case 8:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_words_read_total counter\n" : 
+					"# HELP wpp_words_read_total Words read from targets.\n");
+		case 9:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_tcp_send_retries_total counter\n" : 
+					"# HELP wpp_tcp_send_retries_total Sends refused by the "
+					"busy TCP stack.\n");
+		case 10:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_device_info gauge\n" : 
+					"# HELP wpp_device_info Last detected device.\n");
+		case 11:
+			return os_sprintf(out, line ? 
+					"# TYPE wpp_boot_milestone_seconds gauge\n" : 
+					"# HELP wpp_boot_milestone_seconds Time from boot to "
+					"being ready.\n");
+	}
+	return -1;
+}
+
+
+/*
+ * Render whole lines from the position on into the buffer, as many as
+ * fit, and advance the position past them.  Returns the length, 0 once
+ * the page is complete.
+ */
+ICACHE_FLASH_ATTR
+uint16_t webadmin_metrics_render(uint16_t *position, char *buffer, 
+		uint16_t size) {
+	char line[WA_METRICS_LINE];
+	uint16_t length = 0;
+	int n;
+
+	for (;;) {
+		n = _render_line(_family(*position), _line(*position), line);
+		if (n < 0) {
+			break;
+		}
+		if (n == 0) {
+			// Next family.
+			*position = (_family(*position) + 1) << 8;
+			continue;
+		}
+		if (length + n > size) {
+			break;
+		}
+		os_memcpy(buffer + length, line, n);
+		length += n;
+		(*position)++;
+	}
+	return length;
+}
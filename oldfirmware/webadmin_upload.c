@@ -0,0 +1,417 @@
+/*
+ * Program upload through webadmin.
+ *
+ * The body of POST /upload is an Intel HEX file, recognized by its
+ * leading colon, or a raw binary of little-endian words from address 0.
+ * It is parsed as segments arrive and every word goes straight to the
+ * ICSP write path.  A segment is kept until programmed, a slice of words
+ * per timer run, and the connection is held meanwhile; TCP flow control
+ * then slows the browser down to programming speed, so the image is never
+ * in RAM as a whole.  HEX addresses are bytes, two per word, as written
+ * by the PIC toolchains.
+ */
+
+#include "webadmin_upload.h"
+#include "pic.h"
+#include "sp_tcpserver.h"
+#include "log.h"
+#include "stats.h"
+
+#include <c_types.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <user_interface.h>
+
+
+// Length, address, type and checksum around at most 255 data bytes.
+#define WA_UPLOAD_RECORD		260
+
+#define HEX_DATA				0x00
+#define HEX_EOF					0x01
+#define HEX_EXTENDED_SEGMENT	0x02
+#define HEX_EXTENDED_LINEAR		0x04
+
+
+typedef enum {
+	WA_UPLOAD_IDLE,
+	WA_UPLOAD_PROGRAMMING,
+	WA_UPLOAD_DONE,
+	WA_UPLOAD_FAILED
+} WAUploadState;
+
+static const char *state_names[] = {"idle", "programming", "done", "failed"};
+
+
+static struct {
+	struct espconn *conn;
+	WAUploadCallback done;
+	WAUploadState state;
+	bool hex;
+	uint32_t total;
+	uint32_t received;
+	uint32_t words;
+	uint32_t started;
+	uint8_t error;
+	uint32_t error_address;
+	char device[24];
+
+	// Body not yet parsed, from consumed to length.
+	uint16_t length;
+	uint16_t consumed;
+
+	// HEX record being read, then the data bytes of a complete one until
+	// they are programmed.
+	bool in_record;
+	bool low_nibble;
+	uint16_t record_bytes;
+	uint16_t record_cursor;
+	uint16_t record_length;
+	uint32_t record_address;
+	uint32_t base;
+	bool eof;
+
+	// Low byte of a word waiting for its high byte.
+	bool pending;
+	uint8_t pending_low;
+	uint32_t pending_address;
+} upload;
+
+static char upload_buffer[WA_UPLOAD_BUFFER];
+static uint8_t record[WA_UPLOAD_RECORD];
+static ETSTimer upload_timer;
+
+
+// Offset into the body of the next byte to parse.
+#define _offset() (upload.received - (upload.length - upload.consumed))
+
+
+static void ICACHE_FLASH_ATTR
+_fail(uint8_t error, uint32_t address) {
+	if (upload.state != WA_UPLOAD_PROGRAMMING) {
+		return;
+	}
+	upload.state = WA_UPLOAD_FAILED;
+	upload.error = error;
+	upload.error_address = address;
+	LOG_WARN("WEBADMIN: upload failed: %d at 0x%04X", error, address);
+}
+
+
+static void ICACHE_FLASH_ATTR
+_write(uint32_t address, uint16_t word) {
+	SPError err = pic_write_word(address, word);
+	if (err != SP_OK) {
+		_fail(err, address);
+		return;
+	}
+	upload.words++;
+}
+
+
+// Pair bytes into words, low byte first.  A low byte alone, as for the
+// data memory in some HEX files, is written with a zero high byte.
+static void ICACHE_FLASH_ATTR
+_put_byte(uint32_t address, uint8_t value) {
+	if (upload.pending && address != upload.pending_address + 1) {
+		upload.pending = false;
+		_write(upload.pending_address >> 1, upload.pending_low);
+	}
+	if ((address & 1) == 0) {
+		upload.pending = true;
+		upload.pending_low = value;
+		upload.pending_address = address;
+		return;
+	}
+	if (!upload.pending) {
+		_fail(WA_UPLOAD_ERR_SYNTAX, _offset() - 1);
+		return;
+	}
+	upload.pending = false;
+	_write(address >> 1, (value << 8) | upload.pending_low);
+}
+
+
+static void ICACHE_FLASH_ATTR
+_record_complete() {
+	uint8_t sum = 0;
+	uint16_t i;
+
+	for (i = 0; i < upload.record_bytes; i++) {
+		sum += record[i];
+	}
+	if (sum != 0) {
+		_fail(WA_UPLOAD_ERR_CHECKSUM, _offset() - 1);
+		return;
+	}
+	switch (record[3]) {
+		case HEX_DATA:
+			upload.record_address = upload.base +
+				((record[1] << 8) | record[2]);
+			upload.record_length = record[0];
+			upload.record_cursor = 0;
+			break;
+
+		case HEX_EOF:
+			upload.eof = true;
+			break;
+
+		case HEX_EXTENDED_SEGMENT:
+			upload.base = ((record[4] << 8) | record[5]) << 4;
+			break;
+
+		case HEX_EXTENDED_LINEAR:
+			upload.base = ((record[4] << 8) | record[5]) << 16;
+			break;
+	}
+}
+
+
+static uint8_t ICACHE_FLASH_ATTR
+_nibble(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return 0xFF;
+}
+
+
+// One character of a HEX file, records are taken once complete.
+static void ICACHE_FLASH_ATTR
+_hex_char(char c) {
+	uint8_t nibble;
+
+	if (upload.eof) {
+		return;
+	}
+	if (!upload.in_record) {
+		if (c == ':') {
+			upload.in_record = true;
+			upload.low_nibble = false;
+			upload.record_bytes = 0;
+		}
+		else if (c != '\r' && c != '\n' && c != ' ' && c != '\t') {
+			_fail(WA_UPLOAD_ERR_SYNTAX, _offset() - 1);
+		}
+		return;
+	}
+	nibble = _nibble(c);
+	if (nibble == 0xFF) {
+		_fail(WA_UPLOAD_ERR_SYNTAX, _offset() - 1);
+		return;
+	}
+	if (!upload.low_nibble) {
+		record[upload.record_bytes] = nibble << 4;
+		upload.low_nibble = true;
+		return;
+	}
+	record[upload.record_bytes++] |= nibble;
+	upload.low_nibble = false;
+	if (upload.record_bytes == 5 + record[0]) {
+		upload.in_record = false;
+		_record_complete();
+	}
+}
+
+
+static void ICACHE_FLASH_ATTR
+_finish() {
+	WAUploadCallback done = upload.done;
+
+	os_timer_disarm(&upload_timer);
+	if (upload.state == WA_UPLOAD_PROGRAMMING && upload.pending) {
+		upload.pending = false;
+		_write(upload.pending_address >> 1, upload.pending_low);
+	}
+	if (upload.hex && !upload.eof) {
+		_fail(WA_UPLOAD_ERR_TRUNCATED, upload.received);
+	}
+	pic_write_end();
+	sp_tcpserver_lease_release();
+	if (upload.conn != NULL) {
+		// The rest of a failed body is read and dropped.
+		espconn_recv_unhold(upload.conn);
+	}
+	if (upload.state == WA_UPLOAD_PROGRAMMING) {
+		upload.state = WA_UPLOAD_DONE;
+		LOG_INFO("WEBADMIN: %d words programmed", upload.words);
+	}
+	stats_job(upload.state == WA_UPLOAD_DONE,
+			system_get_time() - upload.started);
+	upload.done = NULL;
+	if (done != NULL && upload.conn != NULL) {
+		done(upload.conn, upload.state == WA_UPLOAD_DONE);
+	}
+}
+
+
+// Program a slice of the received body, then wait for the next segment
+// or come back for more.
+static void ICACHE_FLASH_ATTR
+_run(void *arg) {
+	uint32_t words = upload.words;
+	char c;
+
+	while (upload.state == WA_UPLOAD_PROGRAMMING &&
+			upload.words - words < WA_UPLOAD_SLICE) {
+		if (upload.record_cursor < upload.record_length) {
+			_put_byte(upload.record_address + upload.record_cursor,
+					record[4 + upload.record_cursor]);
+			upload.record_cursor++;
+			continue;
+		}
+		if (upload.consumed == upload.length) {
+			break;
+		}
+		c = upload_buffer[upload.consumed++];
+		if (upload.hex) {
+			_hex_char(c);
+		}
+		else {
+			_put_byte(_offset() - 1, c);
+		}
+	}
+	system_soft_wdt_feed();
+
+	if (upload.state != WA_UPLOAD_PROGRAMMING ||
+			(upload.received == upload.total &&
+			 upload.consumed == upload.length &&
+			 upload.record_cursor == upload.record_length)) {
+		_finish();
+		return;
+	}
+	if (upload.consumed < upload.length ||
+			upload.record_cursor < upload.record_length) {
+		os_timer_arm(&upload_timer, WA_UPLOAD_INTERVAL, 0);
+		return;
+	}
+	// All programmed, let the browser send more.
+	espconn_recv_unhold(upload.conn);
+}
+
+
+/*
+ * Take the programming lease and detect the target, before the body of
+ * the given length arrives.  SP_ERR_BUSY while an upload runs or a client
+ * holds the lease, any other error is reported by the status as well.
+ */
+SPError ICACHE_FLASH_ATTR
+webadmin_upload_begin(struct espconn *conn, uint32_t length,
+		WAUploadCallback done) {
+	SPError err;
+
+	if (upload.state == WA_UPLOAD_PROGRAMMING ||
+			!sp_tcpserver_lease_acquire()) {
+		return SP_ERR_BUSY;
+	}
+	os_memset(&upload, 0, sizeof(upload));
+	upload.conn = conn;
+	upload.total = length;
+	upload.state = WA_UPLOAD_PROGRAMMING;
+	upload.started = system_get_time();
+	os_timer_disarm(&upload_timer);
+	os_timer_setfn(&upload_timer, (os_timer_func_t *)_run, NULL);
+
+	if (!length) {
+		err = SP_ERR_REQ_LEN;
+	}
+	else {
+		// Sets up the regions of the device in the socket, the name it
+		// would answer with goes to the status.
+		sp_tcpserver_capture_begin(upload.device, sizeof(upload.device) - 1);
+		err = pic_command_detect_device(NULL);
+		sp_tcpserver_capture_end();
+	}
+	if (err != SP_OK) {
+		_fail(err, 0);
+		sp_tcpserver_lease_release();
+		return err;
+	}
+	upload.done = done;
+	return SP_OK;
+}
+
+
+void ICACHE_FLASH_ATTR
+webadmin_upload_receive(const char *data, uint16_t length) {
+	if (upload.state != WA_UPLOAD_PROGRAMMING || !length) {
+		return;
+	}
+	if (!upload.received) {
+		upload.hex = data[0] == ':';
+	}
+	if (length > upload.total - upload.received) {
+		length = upload.total - upload.received;
+	}
+	// Keep what is left, the connection is held until it is programmed.
+	os_memmove(upload_buffer, upload_buffer + upload.consumed,
+			upload.length - upload.consumed);
+	upload.length -= upload.consumed;
+	upload.consumed = 0;
+	if (upload.length + length > WA_UPLOAD_BUFFER) {
+		_fail(SP_ERR_REQ_LEN, upload.received);
+		_finish();
+		return;
+	}
+	os_memcpy(upload_buffer + upload.length, data, length);
+	upload.length += length;
+	upload.received += length;
+	espconn_recv_hold(upload.conn);
+	os_timer_disarm(&upload_timer);
+	os_timer_arm(&upload_timer, WA_UPLOAD_INTERVAL, 0);
+}
+
+
+bool ICACHE_FLASH_ATTR
+webadmin_upload_owns(struct espconn *conn) {
+	return conn != NULL && conn == upload.conn;
+}
+
+
+void ICACHE_FLASH_ATTR
+webadmin_upload_disconnected(struct espconn *conn) {
+	if (!webadmin_upload_owns(conn)) {
+		return;
+	}
+	upload.conn = NULL;
+	if (upload.state == WA_UPLOAD_PROGRAMMING) {
+		_fail(SP_ERR_CANCELLED, upload.received);
+		_finish();
+	}
+}
+
+
+/*
+ * state=...&device=...&format=...&received=...&total=...&words=..., then
+ * error and address once failed: the word address for SP errors, the
+ * offset into the file for WA_UPLOAD_ERR_*.  Rendered whole, so it waits
+ * for a buffer with room.
+ */
+uint16_t ICACHE_FLASH_ATTR
+webadmin_upload_render(uint16_t *position, char *buffer, uint16_t size) {
+	char line[160];
+	uint16_t length;
+
+	if (*position) {
+		return 0;
+	}
+	length = os_sprintf(line, "state=%s&device=%s&format=%s&received=%d"
+			"&total=%d&words=%d", state_names[upload.state], upload.device,
+			upload.hex ? "hex" : "bin", upload.received, upload.total,
+			upload.words);
+	if (upload.state == WA_UPLOAD_FAILED) {
+		length += os_sprintf(line + length, "&error=%d&address=%d",
+				upload.error, upload.error_address);
+	}
+	if (length > size) {
+		return 0;
+	}
+	os_memcpy(buffer, line, length);
+	*position = 1;
+	return length;
+}
@@ -1,5 +1,7 @@
 #include "wifi.h"
 #include "user_config.h"
+#include "stats.h"
+#include "log.h"
 
 #include <user_interface.h>
 #include <osapi.h>
@@ -11,54 +13,185 @@
 
 
 static ETSTimer wifi_timer;
+static ETSTimer fallback_timer;
 static uint8_t wifiStatus = STATION_IDLE;
-static uint8_t lastWifiStatus = STATION_IDLE;
 WifiCallback wifi_cb = NULL;
 TickCallback tick_cb = NULL;
 static uint32_t ticks = 0;
 
+// Connecting with the cache: pinned to its AP, with its lease.
+static bool fast = false;
+static struct dhcp_client_info cache;
+
+
+static void ICACHE_FLASH_ATTR
+wifi_set_status(uint8_t status) {
+	if (status == wifiStatus) {
+		return;
+	}
+	wifiStatus = status;
+	if (wifi_cb) 
+		wifi_cb(wifiStatus);
+}
+
 
 static void ICACHE_FLASH_ATTR 
-wifi_check_ip(void *arg) {
-	struct ip_info ipConfig;
+wifi_tick(void *arg) {
+	if (tick_cb) 
+		tick_cb(ticks++);
+}
 
-	os_timer_disarm(&wifi_timer);
-	wifi_get_ip_info(STATION_IF, &ipConfig);
-	wifiStatus = wifi_station_get_connect_status();
-	if (wifiStatus == STATION_GOT_IP && ipConfig.ip.addr != 0) {
-		if (tick_cb) 
-			tick_cb(ticks++);
-
-		os_timer_setfn(&wifi_timer, (os_timer_func_t *)wifi_check_ip, NULL);
-		os_timer_arm(&wifi_timer, 2000, 0);
+
+// FNV-1a of the SSID and password, the cache is for these only.
+static uint32_t ICACHE_FLASH_ATTR
+wifi_config_hash(const struct station_config *config) {
+	uint32_t hash = 2166136261UL;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(config->ssid); i++) {
+		hash = (hash ^ config->ssid[i]) * 16777619UL;
 	}
-	else {
-		if(wifi_station_get_connect_status() == STATION_WRONG_PASSWORD) {
-			os_printf("STATION_WRONG_PASSWORD\r\n");
-			wifi_station_connect();
-		}
-		else if(wifi_station_get_connect_status() == STATION_NO_AP_FOUND) {
-			os_printf("STATION_NO_AP_FOUND\r\n");
-			wifi_station_connect();
-		}
-		else if(wifi_station_get_connect_status() == STATION_CONNECT_FAIL) {
-			os_printf("STATION_CONNECT_FAIL\r\n");
-			wifi_station_connect();
+	for (i = 0; i < sizeof(config->password); i++) {
+		hash = (hash ^ config->password[i]) * 16777619UL;
+	}
+	return hash;
+}
+
+
+/*
+ * Connect straight to the AP of the last connection, on its channel, and
+ * take up its lease again: no scan, no DHCP.  Returns false without a
+ * cache for the current station config.
+ */
+static bool ICACHE_FLASH_ATTR
+wifi_fast_connect() {
+	struct station_config station;
+	struct ip_info info;
+
+	system_rtc_mem_read(WIFI_RTC_BLOCK, &cache, sizeof(cache));
+	os_memset(&station, 0, sizeof(station));
+	wifi_station_get_config(&station);
+	if (cache.flag != WIFI_CACHE_VALID || cache.config != 
+			wifi_config_hash(&station)) {
+		return false;
+	}
+	if (wifi_station_dhcpc_status() == DHCP_STARTED) {
+		wifi_station_dhcpc_stop();
+	}
+	info.ip = cache.ip_addr;
+	info.netmask = cache.netmask;
+	info.gw = cache.gw;
+	if (!wifi_set_ip_info(STATION_IF, &info)) {
+		LOG_WARN("WIFI: cannot set the cached address");
+		wifi_station_dhcpc_start();
+		return false;
+	}
+	station.bssid_set = 1;
+	os_memcpy(station.bssid, cache.bssid, sizeof(station.bssid));
+	wifi_station_set_config_current(&station);
+	wifi_set_channel(cache.channel);
+	LOG_INFO("WIFI: fast connect to " MACSTR " on channel %d, " IPSTR, 
+			MAC2STR(cache.bssid), cache.channel, IP2STR(&cache.ip_addr));
+	return true;
+}
+
+
+// Back to scanning and DHCP, out of the event handler.
+static void ICACHE_FLASH_ATTR
+wifi_fallback(void *arg) {
+	struct station_config station;
+
+	os_memset(&station, 0, sizeof(station));
+	wifi_station_get_config_default(&station);
+	station.bssid_set = 0;
+	wifi_station_set_config_current(&station);
+	wifi_station_dhcpc_start();
+	wifi_station_connect();
+}
+
+
+static void ICACHE_FLASH_ATTR
+wifi_got_ip(const Event_StaMode_Got_IP_t *got_ip) {
+	struct station_config station;
+
+	stats_milestone(STATS_MILESTONE_WIFI_READY);
+	// The AP came with the CONNECTED event, the lease is this one.
+	os_memset(&station, 0, sizeof(station));
+	wifi_station_get_config(&station);
+	cache.ip_addr = got_ip->ip;
+	cache.netmask = got_ip->mask;
+	cache.gw = got_ip->gw;
+	cache.flag = WIFI_CACHE_VALID;
+	cache.config = wifi_config_hash(&station);
+	system_rtc_mem_write(WIFI_RTC_BLOCK, &cache, sizeof(cache));
+
+	os_timer_disarm(&wifi_timer);
+	os_timer_arm(&wifi_timer, WIFI_TICK_INTERVAL, 1);
+	wifi_set_status(STATION_GOT_IP);
+}
+
+
+static void ICACHE_FLASH_ATTR
+wifi_disconnected(uint8_t reason) {
+	os_timer_disarm(&wifi_timer);
+	if (fast) {
+		// The cached AP or lease did not do, or the link dropped: the next
+		// connection may well be to another AP.
+		if (wifiStatus != STATION_GOT_IP) {
+			LOG_WARN("WIFI: fast connect failed: %d", reason);
+			os_memset(&cache, 0, sizeof(cache));
+			system_rtc_mem_write(WIFI_RTC_BLOCK, &cache, sizeof(cache));
 		}
-		else {
+		fast = false;
+		os_timer_disarm(&fallback_timer);
+		os_timer_arm(&fallback_timer, 0, 0);
+	}
+
+	// The SDK reconnects by itself, see wifi_station_set_reconnect_policy().
+	switch (reason) {
+		case REASON_NO_AP_FOUND:
+			LOG_WARN("WIFI: no AP found");
+			wifi_set_status(STATION_NO_AP_FOUND);
+			break;
+
+		case REASON_AUTH_FAIL:
+		case REASON_4WAY_HANDSHAKE_TIMEOUT:
+		case REASON_HANDSHAKE_TIMEOUT:
+			LOG_WARN("WIFI: wrong password");
+			wifi_set_status(STATION_WRONG_PASSWORD);
+			break;
+
+		default:
+			LOG_WARN("WIFI: connect failed: %d", reason);
+			wifi_set_status(STATION_CONNECT_FAIL);
+			break;
+	}
+}
+
+
+static void ICACHE_FLASH_ATTR
+wifi_event(System_Event_t *event) {
+	switch (event->event) {
+		case EVENT_STAMODE_CONNECTED:
+			os_memcpy(cache.bssid, event->event_info.connected.bssid, 
+					sizeof(cache.bssid));
+			cache.channel = event->event_info.connected.channel;
 #if WIFI_VERBOSE
-			os_printf("STATION_IDLE\r\n");
+			LOG_INFO("WIFI: connected");
 #endif
-		}
+			break;
 
-		os_timer_setfn(&wifi_timer, (os_timer_func_t *)wifi_check_ip, NULL);
-		os_timer_arm(&wifi_timer, 1000, 0);
-	}
+		case EVENT_STAMODE_GOT_IP:
+			wifi_got_ip(&event->event_info.got_ip);
+			break;
+
+		case EVENT_STAMODE_DISCONNECTED:
+			wifi_disconnected(event->event_info.disconnected.reason);
+			break;
 
-	if(wifiStatus != lastWifiStatus){
-		lastWifiStatus = wifiStatus;
-		if(wifi_cb)
-			wifi_cb(wifiStatus);
+		case EVENT_STAMODE_DHCP_TIMEOUT:
+			LOG_WARN("WIFI: DHCP timeout");
+			break;
 	}
 }
 
@@ -67,29 +200,10 @@ static void ICACHE_FLASH_ATTR
 wifi_init_softap(const char *device_name) {
 	uint8_t mac[6];
 
-	/***add by tzx for saving ip_info to avoid dhcp_client start****/
-    struct dhcp_client_info dhcp_info;
-    struct ip_info sta_info;
-    system_rtc_mem_read(64, &dhcp_info, sizeof(struct dhcp_client_info));
-	if(dhcp_info.flag == 0x01 ) {
-		if (true == wifi_station_dhcpc_status()) {
-			wifi_station_dhcpc_stop();
-		}
-		sta_info.ip = dhcp_info.ip_addr;
-		sta_info.gw = dhcp_info.gw;
-		sta_info.netmask = dhcp_info.netmask;
-		if ( true != wifi_set_ip_info(STATION_IF, &sta_info)) {
-			os_printf("set default ip wrong\n");
-		}
-	}
-    os_memset(&dhcp_info, 0, sizeof(struct dhcp_client_info));
-    system_rtc_mem_write(64, &dhcp_info, sizeof(struct rst_info));
-
-
 	// Get the device mac address
 	bool ok = wifi_get_macaddr(SOFTAP_IF, &mac[0]);
 	if (!ok) {
-		os_printf("Cannot get softap macaddr\r\n");
+		LOG_WARN("WIFI: cannot get the soft-AP MAC address");
 	}
 
 	// initialization
@@ -104,7 +218,7 @@ wifi_init_softap(const char *device_name) {
 	os_sprintf(config->ssid, "%s_%02x%02x%02x%02x%02x%02x", 
 			device_name,
 			MAC2STR(mac));
-	os_printf("SSID: %s\r\n", config->ssid);
+	LOG_INFO("WIFI: soft-AP %s", config->ssid);
     config->ssid_len = 0; 
     os_sprintf(config->password, WIFI_SOFTAP_PSK);
     config->authmode = AUTH_WPA_WPA2_PSK;
@@ -116,14 +230,14 @@ wifi_init_softap(const char *device_name) {
     ok = wifi_softap_set_config(config); 
     os_free(config);
 	if (!ok) {
-		os_printf("Cannot set softap config\r\n");
+		LOG_WARN("WIFI: cannot set the soft-AP config");
 		return;
 	}
 
     struct station_info * station = wifi_softap_get_station_info();
     while (station) {
-        os_printf("bssid : MACSTR, ip : IPSTR/n", MAC2STR(station->bssid), 
-				IP2STR(&station->ip));
+        LOG_DEBUG("WIFI: soft-AP station " MACSTR ", " IPSTR,
+				MAC2STR(station->bssid), IP2STR(&station->ip));
         station = STAILQ_NEXT(station, next);
     }
 
@@ -159,8 +273,14 @@ wifi_initialize(const char *device_name, WifiCallback cb, TickCallback tcb) {
 	//wifi_station_set_config_current(&stationConf);
 
 	os_timer_disarm(&wifi_timer);
-	os_timer_setfn(&wifi_timer, (os_timer_func_t *)wifi_check_ip, NULL);
-	os_timer_arm(&wifi_timer, 1000, 0);
+	os_timer_setfn(&wifi_timer, (os_timer_func_t *)wifi_tick, NULL);
+	os_timer_disarm(&fallback_timer);
+	os_timer_setfn(&fallback_timer, (os_timer_func_t *)wifi_fallback, NULL);
+
+	// Events tell the state as it changes, nothing is polled.
+	wifi_set_event_handler_cb(wifi_event);
+	wifi_station_set_reconnect_policy(true);
+	fast = wifi_fast_connect();
 	wifi_station_set_auto_connect(true);
 	wifi_station_connect();
 }
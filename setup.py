@@ -30,6 +30,7 @@ setup(
     long_description=open('README.md').read(),
     long_description_content_type='text/markdown',  # This is important!
     install_requires=dependencies,
+    extras_require={'serial': ['pyserial']},
     packages=find_packages(),
     entry_points={
         'console_scripts': [
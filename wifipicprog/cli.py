@@ -1,7 +1,9 @@
 import sys
+import time
 
 from easycli import SubCommand, Argument, Root
 
+from . import protocol, trace, uart, vcd
 from .protocol import WifiProgrammer
 from .hosts import Hosts
 
@@ -22,9 +24,18 @@ class ProgrammerBaseCommand(SubCommand):
             return h[args.host]
 
     def connect(self, args):
+        if args.serial:
+            print(f'Connecting to {args.serial} at {args.baudrate} baud')
+            return WifiProgrammer(
+                serial=args.serial,
+                baudrate=args.baudrate,
+                rtscts=args.rtscts,
+                compress=args.compress
+            )
+
         host, port = self.get_wifi_module_address(args)
         print(f'Connecting to {host}:{port}')
-        return WifiProgrammer(host, port)
+        return WifiProgrammer(host, port, compress=args.compress)
 
 
 class Detect(ProgrammerBaseCommand):
@@ -36,6 +47,257 @@ class Detect(ProgrammerBaseCommand):
             print(f'Device: {p.get_device_info()}')
 
 
+class Log(ProgrammerBaseCommand):
+    __command__ = 'log'
+
+    def __call__(self, args):
+        with self.connect(args) as p:
+            position = 0
+            while True:
+                position, dropped, text = p.log(position)
+                if not text:
+                    break
+                print(text.decode(errors='replace'), end='')
+                position += len(text)
+
+
+def _bucket_labels(count):
+    labels = []
+    limit = protocol.STATS_BUCKET_BASE
+    for i in range(count - 1):
+        labels.append(f'<{limit / 1000:g}ms')
+        limit *= 4
+    labels.append(f'>={limit // 4 / 1000:g}ms')
+    return labels
+
+
+def _stats_diff(before, after):
+    return {
+        'elapsed_us': after['elapsed_us'] - before['elapsed_us'],
+        'heap_free': after['heap_free'],
+        'heap_min': after['heap_min'],
+        'counters': {
+            k: v - before['counters'][k]
+            for k, v in after['counters'].items()
+        },
+        'zones_us': {
+            k: v - before['zones_us'][k]
+            for k, v in after['zones_us'].items()
+        },
+        'latency': {
+            command: tuple(
+                a - b for a, b in zip(
+                    counts, before['latency'].get(command, (0,) * len(counts))
+                )
+            )
+            for command, counts in after['latency'].items()
+        },
+    }
+
+
+def _print_stats(stats):
+    names = {
+        v: k[len('SP_CMD_'):].lower()
+        for k, v in vars(protocol).items() if k.startswith('SP_CMD_')
+    }
+    elapsed = stats['elapsed_us'] or 1
+
+    print(f'Elapsed: {stats["elapsed_us"] / 1e6:.3f}s')
+    print(f'Heap: {stats["heap_free"]} free, {stats["heap_min"]} lowest')
+    for name, value in stats['counters'].items():
+        print(f'{name:>16}: {value}')
+
+    for name, us in stats['zones_us'].items():
+        print(f'{name:>16}: {us / 1e3:10.1f}ms {100 * us / elapsed:5.1f}%')
+    zones = stats['zones_us']
+    icsp = zones['shift'] + zones['wait']
+    if icsp or zones['network']:
+        bound = 'ICSP' if icsp >= zones['network'] else 'WiFi'
+        print(f'{bound}-bound')
+
+    latency = {c: n for c, n in stats['latency'].items() if any(n)}
+    if latency:
+        labels = _bucket_labels(len(next(iter(latency.values()))))
+        print(' ' * 16 + ''.join(f'{label:>9}' for label in labels))
+        for command, counts in sorted(latency.items()):
+            name = names.get(command, str(command))
+            print(f'{name:>16}' + ''.join(f'{n:>9}' for n in counts))
+
+
+class Stats(ProgrammerBaseCommand):
+    __command__ = 'stats'
+    __arguments__ = [
+        Argument(
+            '-i', '--interval',
+            type=float,
+            help='Print the difference over this many seconds instead of '
+                 'the totals'
+        ),
+        Argument(
+            '-r', '--reset',
+            action='store_true',
+            help='Reset the counters once reported'
+        ),
+    ]
+
+    def __call__(self, args):
+        with self.connect(args) as p:
+            if args.interval is None:
+                _print_stats(p.stats(reset=args.reset))
+                return
+
+            before = p.stats()
+            time.sleep(args.interval)
+            _print_stats(_stats_diff(before, p.stats(reset=args.reset)))
+
+
+class Trace(ProgrammerBaseCommand):
+    __command__ = 'trace'
+    __arguments__ = [
+        Argument(
+            '-o', '--output',
+            default='trace.json',
+            help='Chrome trace JSON file to write, default: trace.json'
+        ),
+        Argument(
+            '-c', '--categories',
+            help='Comma separated categories to record from now on, out of: '
+                 + ', '.join(trace.MASK)
+        ),
+    ]
+
+    def __call__(self, args):
+        with self.connect(args) as p:
+            mask = None
+            if args.categories:
+                mask = 0
+                for name in args.categories.split(','):
+                    mask |= trace.MASK[name.strip()]
+
+            events = []
+            position = 0
+            position, mhz, chunk = p.trace(position, mask)
+            while chunk:
+                events.extend(chunk)
+                position += len(chunk)
+                position, mhz, chunk = p.trace(position)
+
+        with open(args.output, 'w') as f:
+            trace.dump(events, mhz, f)
+        print(f'{len(events)} events written to {args.output}')
+
+
+class Vcd(SubCommand):
+    __command__ = 'vcd'
+    __arguments__ = [
+        Argument(
+            'filename',
+            help='VCD capture of the clock, data, mclr and vdd signals'
+        ),
+        Argument(
+            '--mclr-active-high',
+            action='store_true',
+            help='VPP is applied while mclr is high, e.g. a capture taken '
+                 'on the VPP line itself'
+        ),
+    ]
+
+    def __call__(self, args):
+        with open(args.filename) as f:
+            changes = vcd.parse(f)
+
+        result = vcd.analyze(changes, args.mclr_active_high)
+        for line in vcd.report(result):
+            print(line)
+
+        if any(result['violations'].values()):
+            return 1
+
+
+class Emulate(SubCommand):
+    __command__ = 'emulate'
+    __arguments__ = [
+        Argument(
+            '-d', '--device',
+            default='pic16f628a',
+            help='Part in the emulated socket, default: pic16f628a'
+        ),
+        Argument(
+            '-n', '--count',
+            type=int,
+            default=1,
+            help='Emulators to run, on consecutive ports from --port'
+        ),
+        Argument(
+            '-b', '--bind',
+            default='0.0.0.0',
+            help='Address to listen on, default: 0.0.0.0'
+        ),
+        Argument(
+            '--rtt',
+            type=float,
+            default=0,
+            help='Round trip time to add, in milliseconds'
+        ),
+        Argument(
+            '--jitter',
+            type=float,
+            default=0,
+            help='Extra delay of up to this many milliseconds per segment'
+        ),
+        Argument(
+            '--bandwidth',
+            type=float,
+            default=0,
+            help='Link bandwidth in kbit/s, default: unlimited'
+        ),
+        Argument(
+            '--segment',
+            type=int,
+            default=1460,
+            help='Largest TCP segment in bytes, default: 1460'
+        ),
+        Argument(
+            '--icsp-speed',
+            type=float,
+            default=1,
+            help='Scale of the ICSP time per word, 1 is as slow as the '
+                 'hardware, 0 is instant'
+        ),
+        Argument(
+            '--no-advertise',
+            action='store_true',
+            help='Do not announce the emulators over mDNS'
+        ),
+        Argument(
+            '-v', '--verbose',
+            action='store_true',
+            help='Print the emulators\' log'
+        ),
+    ]
+
+    def __call__(self, args):
+        from . import emulator
+
+        shaping = {
+            'rtt': args.rtt / 1000,
+            'jitter': args.jitter / 1000,
+            'bandwidth': args.bandwidth * 1000 / 8,
+            'segment': args.segment,
+        }
+        emulators = [
+            emulator.Emulator(
+                args.device, args.port + i if args.port else 0, args.bind,
+                f'WPP-{i}' if i else 'WPP', args.icsp_speed, shaping,
+                seed=i, verbose=args.verbose,
+            )
+            for i in range(args.count)
+        ]
+        print(f'Emulating {args.count} x {args.device} from port '
+              f'{args.port}')
+        emulator.serve(emulators, not args.no_advertise)
+
+
 class WifiPicProgrammer(Root):
     __help__ = 'WIFI PIC Programmer'
     __completion__ = True
@@ -64,8 +326,35 @@ class WifiPicProgrammer(Root):
             action='store_true',
             help='Force to do a mDNS query, and do not use hosts cache'
         ),
+        Argument(
+            '-z', '--compress',
+            action='store_true',
+            help='Compress request and response bodies on the air'
+        ),
+        Argument(
+            '-s', '--serial',
+            help='Serial port of a programmer wired to UART0, e.g. '
+                 '/dev/ttyUSB0, instead of TCP'
+        ),
+        Argument(
+            '--baudrate',
+            type=int,
+            default=uart.DEFAULT_BAUDRATE,
+            help=f'Serial baud rate, default: {uart.DEFAULT_BAUDRATE}'
+        ),
+        Argument(
+            '--rtscts',
+            action='store_true',
+            help='The programmer\'s RTS (GPIO15) is wired to the adapter\'s '
+                 'CTS, so long writes need not be split'
+        ),
 
         Detect,
+        Log,
+        Stats,
+        Trace,
+        Vcd,
+        Emulate,
     ]
 
     def __call__(self, args):
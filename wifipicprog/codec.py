@@ -0,0 +1,85 @@
+"""Compressed transfer encoding, see oldfirmware/include/sp_codec.h.
+
+A small LZ77 variant with a 256 byte window:
+
+    0nnnnnnn                 literal run, n + 1 bytes follow
+    1nnnnnnn dddddddd        copy n + 3 bytes from d + 1 bytes back
+"""
+
+WINDOW = 256
+MAX_LITERAL = 128
+MIN_MATCH = 3
+MAX_MATCH = 130
+
+
+def _match_length(data, source, position, limit):
+    length = 0
+    while length < limit and data[source + length] == data[position + length]:
+        length += 1
+
+    return length
+
+
+def encode(data):
+    data = bytes(data)
+    out = bytearray()
+    last = {}
+    literal = position = 0
+
+    def flush(end):
+        start = literal
+        while start < end:
+            run = min(end - start, MAX_LITERAL)
+            out.append(run - 1)
+            out.extend(data[start:start + run])
+            start += run
+
+    while position < len(data):
+        limit = min(MAX_MATCH, len(data) - position)
+        best = distance = 0
+        if limit >= MIN_MATCH:
+            key = data[position:position + MIN_MATCH]
+            candidates = [position - d for d in (1, 2, 4) if d <= position]
+            previous = last.get(key)
+            if previous is not None and position - previous <= WINDOW:
+                candidates.append(previous)
+            last[key] = position
+            for source in candidates:
+                length = _match_length(data, source, position, limit)
+                if length > best:
+                    best, distance = length, position - source
+
+        if best < MIN_MATCH:
+            position += 1
+            continue
+
+        flush(position)
+        out.append(0x80 | (best - MIN_MATCH))
+        out.append(distance - 1)
+        position += best
+        literal = position
+
+    flush(len(data))
+    return bytes(out)
+
+
+def decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        control = data[i]
+        i += 1
+        if control & 0x80:
+            length = (control & 0x7F) + MIN_MATCH
+            distance = data[i] + 1
+            i += 1
+            if distance > len(out):
+                raise ValueError('Copy before the start of the data')
+            for _ in range(length):
+                out.append(out[-distance])
+        else:
+            length = control + 1
+            out.extend(data[i:i + length])
+            i += length
+
+    return bytes(out)
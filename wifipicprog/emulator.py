@@ -0,0 +1,673 @@
+"""A programmer stand-in speaking SP over TCP, without an ESP.
+
+Implements the protocol of oldfirmware/include/sp.h against an in-memory
+PIC: the programming lease, tagged and cancellable READs, BATCH, compressed
+framing and the diagnostic commands.  Each ICSP word costs about what it
+costs the firmware, and every connection is shaped like a WiFi link (round
+trip time, bandwidth, segmentation and jitter, see shaping.Shaper).
+
+Emulators are asyncio servers, so any number of them share one process and
+one event loop; serve() runs a list of them and optionally advertises each
+over zeroconf like the firmware does.
+"""
+
+import asyncio
+import random
+import socket
+import struct
+import time
+
+from . import codec
+from .protocol import (
+    Packet,
+    SP_CMD_ECHO, SP_CMD_PROGRAMMER_VERSION, SP_CMD_DEVICE, SP_CMD_READ,
+    SP_CMD_WRITEBIN, SP_CMD_PWROFF, SP_CMD_WRITE_DATA, SP_CMD_BATCH,
+    SP_CMD_CANCEL, SP_CMD_STATUS, SP_CMD_POOLS, SP_CMD_LOG, SP_CMD_STATS,
+    SP_CMD_TRACE,
+    SP_STATUS_READ_MORE, SP_STATUS_READ_DONE, SP_STATUS_ACCEPTED,
+    SP_STATUS_PROGRESS, SP_TAG_FLAG, SP_COMPRESS_FLAG,
+    SP_OK, SP_ERR_INVALID_COMMAND, SP_ERR_REQ_LEN,
+    SP_ERR_ADDRESS_RANGE, SP_ERR_WRITE_FAILED, SP_ERR_BATCH_OVERFLOW,
+    SP_ERR_BUSY, SP_ERR_CANCELLED, SP_ERR_NO_SUCH_JOB, SP_ERR_LEASED,
+)
+from .shaping import Shaper, SEGMENT_SIZE
+
+
+SP_VERSION = '0.1.0'
+SERVICE_TYPE = '_WPPS._tcp.local.'
+
+# Same limits as the firmware, see sp.h, sp_job.h and pic.c
+READ_CHUNK_WORDS = 256
+JOB_SLICE = 32
+JOB_PROGRESS_INTERVAL = 512
+BATCH_RESULT_SIZE = 2048
+LOG_CHUNK = 512
+LOG_SIZE = 4096
+
+SHARED_COMMANDS = {
+    SP_CMD_ECHO, SP_CMD_PROGRAMMER_VERSION, SP_CMD_STATUS, SP_CMD_POOLS,
+    SP_CMD_LOG, SP_CMD_STATS, SP_CMD_TRACE,
+}
+# Commands that leave the target alone, allowed next to a running job
+JOB_COMMANDS = SHARED_COMMANDS | {SP_CMD_CANCEL}
+
+# ICSP cost of a word in microseconds: shifting a command and 16 data
+# bits, and the program cycles of each flash type, see pic_io.h
+SHIFT_US = 55
+PROGRAM_US = {'flash': 4000 + 6000, 'flash4': 4000, 'flash5': 1000}
+DATA_PROGRAM_US = 6000
+
+# STATS layout, see oldfirmware/include/stats.h
+STATS_COUNTERS = 9
+STATS_ZONES = 4
+STATS_COMMANDS = 24
+STATS_BUCKETS = 8
+STATS_BUCKET_BASE = 250
+CPU_MHZ = 80
+HEAP = 40000
+POOLS = ((64, 12), (1088, 4), (2112, 1))
+
+(WORDS_READ, WORDS_WRITTEN, WORDS_SKIPPED, ICSP_RESETS, INCREMENTS,
+ BYTES_SENT, BYTES_RECEIVED, SEND_RETRIES, WORDS_VERIFIED) = range(9)
+ZONE_SHIFT, ZONE_WAIT, ZONE_NETWORK, ZONE_PROCESS = range(4)
+
+CONFIG_START = 0x2000
+DATA_START = 0x2100
+DEV_ID = 6
+
+
+class Device:
+    def __init__(self, name, id, program_size, config_size, data_size,
+                 flash):
+        self.name = name
+        self.id = id
+        self.program_size = program_size
+        self.config_size = config_size
+        self.data_size = data_size
+        self.flash = flash
+
+
+# The devices[] table of oldfirmware/include/pic_devices.h
+DEVICES = {d.name: d for d in (
+    Device('pic12f629', 0x0F80, 1024, 8, 128, 'flash4'),
+    Device('pic12f675', 0x0FC0, 1024, 8, 128, 'flash4'),
+    Device('pic16f630', 0x10C0, 1024, 8, 128, 'flash4'),
+    Device('pic16f676', 0x10E0, 1024, 8, 128, 'flash4'),
+    Device('pic16f84a', 0x0560, 1024, 8, 64, 'flash'),
+    Device('pic16f87', 0x0720, 4096, 9, 256, 'flash5'),
+    Device('pic16f88', 0x0760, 4096, 9, 256, 'flash5'),
+    Device('pic16f627', 0x07A0, 1024, 8, 128, 'flash'),
+    Device('pic16f627a', 0x1040, 1024, 8, 128, 'flash4'),
+    Device('pic16f628', 0x07C0, 2048, 8, 128, 'flash'),
+    Device('pic16f628a', 0x1060, 2048, 8, 128, 'flash4'),
+    Device('pic16f648a', 0x1100, 4096, 8, 256, 'flash4'),
+    Device('pic16f882', 0x2000, 2048, 9, 128, 'flash4'),
+    Device('pic16f883', 0x2020, 4096, 9, 256, 'flash4'),
+    Device('pic16f884', 0x2040, 4096, 9, 256, 'flash4'),
+    Device('pic16f886', 0x2060, 8192, 9, 256, 'flash4'),
+    Device('pic16f887', 0x2080, 8192, 9, 256, 'flash4'),
+)}
+
+
+class Pic:
+    """Memories of a blank part; program-only flash can only clear bits."""
+
+    def __init__(self, device):
+        self.device = device
+        self.program = [0x3FFF] * device.program_size
+        self.config = [0x3FFF] * device.config_size
+        self.config[DEV_ID] = device.id
+        self.data = bytearray(b'\xff' * device.data_size)
+
+    def region(self, address):
+        """Memory list and offset of an address, None if unmapped."""
+        if address < len(self.program):
+            return self.program, address
+        if CONFIG_START <= address < CONFIG_START + len(self.config):
+            return self.config, address - CONFIG_START
+        if DATA_START <= address < DATA_START + len(self.data):
+            return self.data, address - DATA_START
+        return None, None
+
+    def read(self, address):
+        memory, offset = self.region(address)
+        return 0x3FFF if memory is None else memory[offset]
+
+    def write(self, address, word):
+        """Program a word, returns what reads back."""
+        memory, offset = self.region(address)
+        if memory is self.data:
+            memory[offset] = word & 0xFF
+        elif memory is self.config and offset == DEV_ID:
+            pass
+        elif self.device.flash == 'flash5':
+            memory[offset] &= word & 0x3FFF
+        else:
+            memory[offset] = word & 0x3FFF
+        return memory[offset]
+
+
+class _Stats:
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.since = time.monotonic()
+        self.counters = [0] * STATS_COUNTERS
+        self.zones = [0.0] * STATS_ZONES
+        self.latency = [[0] * STATS_BUCKETS for _ in range(STATS_COMMANDS)]
+
+    def command(self, command, seconds):
+        if command >= STATS_COMMANDS:
+            return
+        limit = STATS_BUCKET_BASE
+        bucket = 0
+        while bucket < STATS_BUCKETS - 1 and seconds * 1e6 >= limit:
+            limit *= 4
+            bucket += 1
+        self.latency[command][bucket] = min(
+            self.latency[command][bucket] + 1, 0xFFFF)
+
+    def serialize(self):
+        body = bytes([STATS_COUNTERS, STATS_ZONES, STATS_COMMANDS,
+                      STATS_BUCKETS, CPU_MHZ])
+        body += struct.pack(
+            '!III', int((time.monotonic() - self.since) * 1e6) & 0xFFFFFFFF,
+            HEAP, HEAP)
+        body += struct.pack(f'!{STATS_COUNTERS}I',
+                            *(c & 0xFFFFFFFF for c in self.counters))
+        body += struct.pack(f'!{STATS_ZONES}Q',
+                            *(int(z * 1e6 * CPU_MHZ) for z in self.zones))
+        for counts in self.latency:
+            body += struct.pack(f'!{STATS_BUCKETS}H', *counts)
+        return body
+
+
+class _Job:
+    def __init__(self, connection, tag, mode):
+        self.connection = connection
+        self.tag = tag
+        self.mode = mode
+        self.cancelled = False
+        self.task = None
+
+
+class _Connection:
+    """One client: parses requests, runs them in order, shapes both ways."""
+
+    def __init__(self, emulator, reader, writer):
+        self.emulator = emulator
+        self.reader = reader
+        self.writer = writer
+        self.peer = '%s:%d' % writer.get_extra_info('peername')[:2]
+        rng = random.Random(emulator.rng.random())
+        self.uplink = Shaper(rng=rng, **emulator.shaping)
+        self.downlink = Shaper(rng=rng, **emulator.shaping)
+        self.requests = asyncio.Queue()
+        self.outgoing = asyncio.Queue()
+        self.buffer = bytearray()
+        sock = writer.get_extra_info('socket')
+        if sock is not None:
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def send(self, status, body=b'', tag=None, compressed=False):
+        """Queue a response, delivered as the link allows.
+
+        Responses are framed like their request, but unlike it carry no
+        compression flag, which would read as SP_STATUS_ACCEPTED.
+        """
+        body = body or b''
+        wire = codec.encode(body) if compressed and body else body
+        data = struct.pack(Packet.header_format,
+                           status | (SP_TAG_FLAG if tag is not None else 0),
+                           len(wire))
+        if tag is not None:
+            data += struct.pack(Packet.tag_format, tag)
+        if compressed:
+            data += struct.pack('!I', len(body))
+        data += wire
+        self.emulator.stats.counters[BYTES_SENT] += len(data)
+        loop = asyncio.get_running_loop()
+        for due, chunk in self.downlink.segments(data, loop.time()):
+            self.outgoing.put_nowait((due, chunk))
+
+    async def _write(self):
+        loop = asyncio.get_running_loop()
+        while True:
+            due, chunk = await self.outgoing.get()
+            if chunk is None:
+                return
+            if due > loop.time():
+                await asyncio.sleep(due - loop.time())
+            self.writer.write(chunk)
+            await self.writer.drain()
+
+    async def _read(self):
+        loop = asyncio.get_running_loop()
+        while True:
+            data = await self.reader.read(SEGMENT_SIZE)
+            if not data:
+                break
+            self.emulator.stats.counters[BYTES_RECEIVED] += len(data)
+            for due, chunk in self.uplink.segments(data, loop.time()):
+                if due > loop.time():
+                    await asyncio.sleep(due - loop.time())
+                self.buffer += chunk
+                self._parse()
+        self.requests.put_nowait(None)
+
+    def _parse(self):
+        while len(self.buffer) >= 5:
+            flags = self.buffer[0]
+            size = 5 + (2 if flags & SP_TAG_FLAG else 0) + \
+                (4 if flags & SP_COMPRESS_FLAG else 0)
+            if len(self.buffer) < size:
+                return
+            length, = struct.unpack_from('!I', self.buffer, 1)
+            if len(self.buffer) < size + length:
+                return
+            tag = None
+            offset = 5
+            if flags & SP_TAG_FLAG:
+                tag, = struct.unpack_from('!H', self.buffer, offset)
+                offset += 2
+            body = bytes(self.buffer[size:size + length])
+            compressed = bool(flags & SP_COMPRESS_FLAG)
+            if compressed:
+                decoded, = struct.unpack_from('!I', self.buffer, offset)
+                body = codec.decode(body) if body else b''
+                if len(body) != decoded:
+                    body = None
+            del self.buffer[:size + length]
+            command = flags & ~(SP_TAG_FLAG | SP_COMPRESS_FLAG)
+            self.requests.put_nowait((command, body, tag, compressed))
+
+    async def run(self):
+        emulator = self.emulator
+        emulator.log(f'I SP TCPSERVER: {self.peer} connected')
+        emulator.clients += 1
+        writer = asyncio.ensure_future(self._write())
+        reader = asyncio.ensure_future(self._read())
+        try:
+            while True:
+                request = await self.requests.get()
+                if request is None:
+                    break
+                await emulator.process(self, *request)
+        finally:
+            reader.cancel()
+            emulator.disconnected(self)
+            self.outgoing.put_nowait((0, None))
+            try:
+                await writer
+                self.writer.close()
+            except (ConnectionError, asyncio.CancelledError):
+                pass
+            emulator.log(f'I SP TCPSERVER: {self.peer} disconnect')
+
+
+class Emulator:
+    """One programmer with a part in its socket, serving on port.
+
+    shaping takes the arguments of shaping.Shaper.  icsp_speed scales the
+    cost of ICSP words: 1 is as slow as the firmware, 0 is instant.
+    """
+
+    def __init__(self, device='pic16f628a', port=8585, host='0.0.0.0',
+                 name='WPP', icsp_speed=1, shaping=None, seed=None,
+                 verbose=False):
+        self.device = DEVICES[device]
+        self.port = port
+        self.host = host
+        self.name = name
+        self.icsp_speed = icsp_speed
+        self.shaping = shaping or {}
+        self.rng = random.Random(seed)
+        self.verbose = verbose
+        self.pic = Pic(self.device)
+        self.detected = False
+        self.lease = None
+        self.job = None
+        self.clients = 0
+        self.debt = 0
+        self.log_text = bytearray()
+        self.log_start = 0
+        self.stats = _Stats()
+        self.server = None
+
+    def log(self, line):
+        data = (line + '\n').encode()
+        self.log_text += data
+        excess = len(self.log_text) - LOG_SIZE
+        if excess > 0:
+            del self.log_text[:excess]
+            self.log_start += excess
+        if self.verbose:
+            print(f'{self.name}:{self.port} {line}')
+
+    async def start(self):
+        self.server = await asyncio.start_server(
+            self._accept, self.host, self.port)
+        self.port = self.server.sockets[0].getsockname()[1]
+        self.log(f'Serving {self.device.name} on {self.host}:{self.port}')
+
+    async def _accept(self, reader, writer):
+        await _Connection(self, reader, writer).run()
+
+    def disconnected(self, connection):
+        self.clients -= 1
+        if self.job and self.job.connection is connection:
+            self.job.cancelled = True
+        if self.lease is connection:
+            self.log('I SP TCPSERVER: programming lease released')
+            self.lease = None
+
+    async def icsp(self, words, program_us=0):
+        """Spend the ICSP time of words, sleeping it off a millisecond at a
+        time so other emulators run meanwhile."""
+        seconds = (words * SHIFT_US + program_us) * 1e-6 * self.icsp_speed
+        self.stats.zones[ZONE_SHIFT] += words * SHIFT_US * 1e-6
+        self.stats.zones[ZONE_WAIT] += program_us * 1e-6
+        self.debt += seconds
+        if self.debt >= 0.001:
+            start = time.monotonic()
+            await asyncio.sleep(self.debt)
+            self.debt -= time.monotonic() - start
+
+    async def process(self, connection, command, body, tag, compressed):
+        started = time.monotonic()
+
+        def respond(status, data=b''):
+            connection.send(status, data, tag, compressed)
+
+        if body is None:
+            err = SP_ERR_REQ_LEN
+        elif connection is not self.lease and \
+                command not in SHARED_COMMANDS and self.lease is not None:
+            err = SP_ERR_LEASED
+        else:
+            if connection is not self.lease and \
+                    command not in SHARED_COMMANDS:
+                self.log('I SP TCPSERVER: programming lease taken')
+                self.lease = connection
+            err = await self.dispatch(connection, command, body, tag,
+                                      compressed, respond)
+        if err != SP_OK:
+            self.log(f'W Cannot process request: {err}')
+            respond(err)
+        self.stats.command(command, time.monotonic() - started)
+
+    async def dispatch(self, connection, command, body, tag, compressed,
+                       respond):
+        if self.job and command not in JOB_COMMANDS:
+            return SP_ERR_BUSY
+        handler = self.COMMANDS.get(command)
+        if handler is None:
+            return SP_ERR_INVALID_COMMAND
+        return await handler(self, connection, body, tag, compressed,
+                             respond)
+
+    async def _echo(self, connection, body, tag, compressed, respond):
+        respond(SP_OK, body)
+        return SP_OK
+
+    async def _version(self, connection, body, tag, compressed, respond):
+        respond(SP_OK, SP_VERSION.encode())
+        return SP_OK
+
+    async def _detect(self, connection, body, tag, compressed, respond):
+        await self.icsp(8)
+        self.stats.counters[ICSP_RESETS] += 1
+        self.log(f'I DeviceID: {self.device.id:02X}')
+        self.detected = True
+        respond(SP_OK, self.device.name.encode())
+        return SP_OK
+
+    async def _read_words(self, start, count):
+        words = [self.pic.read(a) for a in range(start, start + count)]
+        self.stats.counters[WORDS_READ] += count
+        await self.icsp(count)
+        return struct.pack(f'!{count}I', *words)
+
+    async def _read(self, connection, body, tag, compressed, respond):
+        if len(body) < 12:
+            return SP_ERR_REQ_LEN
+        start, _, end = struct.unpack('!III', body[:12])
+        if tag is None:
+            while start <= end:
+                count = min(READ_CHUNK_WORDS, end - start + 1)
+                respond(SP_STATUS_READ_MORE,
+                        await self._read_words(start, count))
+                start += count
+            respond(SP_STATUS_READ_DONE)
+            return SP_OK
+
+        if end < start:
+            return SP_ERR_ADDRESS_RANGE
+        job = _Job(connection, tag, compressed)
+        total = end - start + 1
+
+        def frame(status, done):
+            connection.send(status, struct.pack('!II', done, total), tag,
+                            compressed)
+
+        async def run():
+            done = reported = 0
+            try:
+                while done < total:
+                    await asyncio.sleep(0)
+                    if job.cancelled:
+                        frame(SP_ERR_CANCELLED, done)
+                        return
+                    count = min(JOB_SLICE, total - done)
+                    data = await self._read_words(start + done, count)
+                    connection.send(SP_STATUS_READ_MORE, data, tag,
+                                    compressed)
+                    done += count
+                    if done - reported >= JOB_PROGRESS_INTERVAL:
+                        reported = done
+                        frame(SP_STATUS_PROGRESS, done)
+                frame(SP_OK, done)
+            finally:
+                self.job = None
+
+        self.job = job
+        frame(SP_STATUS_ACCEPTED, 0)
+        job.task = asyncio.ensure_future(run())
+        return SP_OK
+
+    async def _write_binary(self, connection, body, tag, compressed,
+                            respond):
+        if len(body) < 4 or len(body) & 1:
+            return SP_ERR_REQ_LEN
+        address, = struct.unpack('!I', body[:4])
+        words = struct.unpack(f'!{(len(body) - 4) // 2}H', body[4:])
+        memory, _ = self.pic.region(address)
+        if memory is None:
+            return SP_ERR_ADDRESS_RANGE
+        program_us = DATA_PROGRAM_US if memory is self.pic.data else \
+            PROGRAM_US[self.device.flash]
+        for count, word in enumerate(words):
+            if self.pic.region(address + count)[0] is not memory:
+                return SP_ERR_ADDRESS_RANGE
+            word &= 0xFF if memory is self.pic.data else 0x3FFF
+            # Load, program cycle and read back.
+            await self.icsp(2, program_us)
+            self.stats.counters[WORDS_WRITTEN] += 1
+            if self.pic.write(address + count, word) != word:
+                return SP_ERR_WRITE_FAILED
+            self.stats.counters[WORDS_VERIFIED] += 1
+        respond(SP_OK, struct.pack('!I', len(words)))
+        return SP_OK
+
+    async def _write_data(self, connection, body, tag, compressed, respond):
+        if len(body) < 4:
+            return SP_ERR_REQ_LEN
+        address, = struct.unpack('!I', body[:4])
+        data = body[4:]
+        if address < DATA_START or \
+                address + len(data) > DATA_START + len(self.pic.data):
+            return SP_ERR_ADDRESS_RANGE
+        written = skipped = 0
+        for i, value in enumerate(data):
+            await self.icsp(1)
+            if self.pic.read(address + i) == value:
+                skipped += 1
+                self.stats.counters[WORDS_SKIPPED] += 1
+                continue
+            await self.icsp(2, DATA_PROGRAM_US)
+            self.pic.write(address + i, value)
+            written += 1
+            self.stats.counters[WORDS_WRITTEN] += 1
+        respond(SP_OK, struct.pack('!II', written, skipped))
+        return SP_OK
+
+    async def _power_off(self, connection, body, tag, compressed, respond):
+        self.detected = False
+        respond(SP_OK)
+        return SP_OK
+
+    async def _batch(self, connection, body, tag, compressed, respond):
+        result = b''
+        offset = 0
+        err = SP_OK
+        while offset < len(body):
+            if len(body) - offset < 5:
+                err = SP_ERR_REQ_LEN
+                break
+            command, length = struct.unpack_from('!BI', body, offset)
+            offset += 5
+            if length > len(body) - offset:
+                err = SP_ERR_REQ_LEN
+                break
+            step = body[offset:offset + length]
+            offset += length
+            if len(result) + 6 > BATCH_RESULT_SIZE:
+                err = SP_ERR_BATCH_OVERFLOW
+                break
+
+            captured = []
+            if command == SP_CMD_BATCH:
+                err = SP_ERR_INVALID_COMMAND
+            else:
+                err = await self.dispatch(
+                    connection, command, step, None, False,
+                    lambda status, data=b'': captured.append(data or b''))
+            captured = b''.join(captured)
+            if len(result) + 6 + len(captured) > BATCH_RESULT_SIZE:
+                captured = b''
+                if err == SP_OK:
+                    err = SP_ERR_BATCH_OVERFLOW
+            result += struct.pack('!BBI', command, err, len(captured))
+            result += captured
+            if err != SP_OK:
+                break
+        respond(err, result)
+        return SP_OK
+
+    async def _cancel(self, connection, body, tag, compressed, respond):
+        if len(body) < 2:
+            return SP_ERR_REQ_LEN
+        job_tag, = struct.unpack('!H', body[:2])
+        if self.job is None or self.job.tag != job_tag:
+            return SP_ERR_NO_SUCH_JOB
+        self.job.cancelled = True
+        respond(SP_OK)
+        return SP_OK
+
+    async def _status(self, connection, body, tag, compressed, respond):
+        flags = (1 if self.job else 0) | (2 if self.lease else 0) | \
+            (4 if self.lease is connection else 0)
+        device_id = self.device.id if self.detected else 0
+        name = self.device.name.encode() if self.detected else b''
+        respond(SP_OK, struct.pack('!BBI', flags, self.clients, device_id)
+                + name)
+        return SP_OK
+
+    async def _pools(self, connection, body, tag, compressed, respond):
+        respond(SP_OK, b''.join(
+            struct.pack('!5H', size, blocks, 0, 0, 0)
+            for size, blocks in POOLS))
+        return SP_OK
+
+    async def _log(self, connection, body, tag, compressed, respond):
+        position = struct.unpack('!I', body[:4])[0] if len(body) >= 4 else 0
+        position = max(position, self.log_start)
+        start = position - self.log_start
+        text = bytes(self.log_text[start:start + LOG_CHUNK])
+        respond(SP_OK, struct.pack('!II', position, 0) + text)
+        return SP_OK
+
+    async def _stats(self, connection, body, tag, compressed, respond):
+        respond(SP_OK, self.stats.serialize())
+        if body[:1] and body[0] & 1:
+            self.stats.reset()
+        return SP_OK
+
+    async def _trace(self, connection, body, tag, compressed, respond):
+        position = struct.unpack('!I', body[:4])[0] if len(body) >= 4 else 0
+        ccount = int(time.monotonic() * 1e6 * CPU_MHZ) & 0xFFFFFFFF
+        respond(SP_OK, struct.pack('!IIB', position, ccount, CPU_MHZ))
+        return SP_OK
+
+    COMMANDS = {
+        SP_CMD_ECHO: _echo,
+        SP_CMD_PROGRAMMER_VERSION: _version,
+        SP_CMD_DEVICE: _detect,
+        SP_CMD_READ: _read,
+        SP_CMD_WRITEBIN: _write_binary,
+        SP_CMD_PWROFF: _power_off,
+        SP_CMD_WRITE_DATA: _write_data,
+        SP_CMD_BATCH: _batch,
+        SP_CMD_CANCEL: _cancel,
+        SP_CMD_STATUS: _status,
+        SP_CMD_POOLS: _pools,
+        SP_CMD_LOG: _log,
+        SP_CMD_STATS: _stats,
+        SP_CMD_TRACE: _trace,
+    }
+
+
+def _local_address():
+    """Address other hosts reach this one on, as mDNS would announce."""
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        try:
+            s.connect(('10.255.255.255', 1))
+            return s.getsockname()[0]
+        except OSError:
+            return '127.0.0.1'
+
+
+def _advertise(emulators):
+    from zeroconf import ServiceInfo, Zeroconf
+
+    zeroconf = Zeroconf()
+    address = socket.inet_aton(_local_address())
+    for e in emulators:
+        info = ServiceInfo(
+            SERVICE_TYPE, f'{e.name}.{SERVICE_TYPE}',
+            addresses=[address], port=e.port,
+            properties={'version': SP_VERSION, 'device': e.device.name},
+        )
+        zeroconf.register_service(info)
+    return zeroconf
+
+
+async def _serve(emulators, advertise):
+    for e in emulators:
+        await e.start()
+    zeroconf = _advertise(emulators) if advertise else None
+    try:
+        await asyncio.gather(*(e.server.serve_forever() for e in emulators))
+    finally:
+        if zeroconf is not None:
+            zeroconf.unregister_all_services()
+            zeroconf.close()
+
+
+def serve(emulators, advertise=True):
+    """Run emulators until interrupted."""
+    try:
+        asyncio.run(_serve(emulators, advertise))
+    except KeyboardInterrupt:
+        pass
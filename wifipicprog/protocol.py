@@ -1,64 +1,148 @@
-import time
 import struct
 import socket
 
-from .exceptions import ProgrammerNotDetectedError
+from . import codec, uart
+from .exceptions import ProgrammerError, ProgrammerNotDetectedError
 
 
 SP_CMD_ECHO = 1
 SP_CMD_PROGRAMMER_VERSION = 2
 SP_CMD_DEVICE = 3
+SP_CMD_READ = 4
+SP_CMD_WRITEBIN = 7
+SP_CMD_PWROFF = 11
+SP_CMD_WRITE_DATA = 12
+SP_CMD_BATCH = 13
+SP_CMD_CANCEL = 14
+SP_CMD_STATUS = 15
+SP_CMD_POOLS = 16
+SP_CMD_LOG = 17
+SP_CMD_STATS = 18
+SP_CMD_TRACE = 19
+
+# Response statuses
+SP_STATUS_READ_MORE = 1
+SP_STATUS_READ_DONE = 2
+SP_STATUS_ACCEPTED = 0x40
+SP_STATUS_PROGRESS = 0x41
+
+# Set in the command/status byte when a 16-bit tag follows the length
+SP_TAG_FLAG = 0x80
+
+# Set in the command byte of a compressed request; it and all responses
+# to it carry the decoded length after the length and tag
+SP_COMPRESS_FLAG = 0x40
 
 # Protocol Errors
 SP_OK = 0
 SP_ERR_INVALID_COMMAND = 1
 SP_ERR_REQ_LEN = 2
 SP_ERR_DEVICE_NOT_DETECTED = 3
+SP_ERR_ADDRESS_RANGE = 4
+SP_ERR_WRITE_FAILED = 5
+SP_ERR_BATCH_OVERFLOW = 6
+SP_ERR_BUSY = 7
+SP_ERR_CANCELLED = 8
+SP_ERR_NO_SUCH_JOB = 9
+SP_ERR_LEASED = 10
+
+# Performance counters and CPU time zones, in the order the programmer
+# reports them
+STATS_COUNTERS = (
+    'words_read', 'words_written', 'words_skipped', 'icsp_resets',
+    'increments', 'bytes_sent', 'bytes_received', 'send_retries',
+    'words_verified',
+)
+STATS_ZONES = ('shift', 'wait', 'network', 'process')
+
+# Upper bound of the first latency bucket in microseconds, each following
+# bucket is 4 times as wide and the last one is open
+STATS_BUCKET_BASE = 250
 
 
 class Packet:
     header_format = '!BI'
+    tag_format = '!H'
 
-    def __init__(self, status, body=None):
+    def __init__(self, status, body=None, tag=None, compressed=False):
         self.status = status
         self.body = body
+        self.tag = tag
+        self.compressed = compressed
 
     @property
     def length(self):
         return len(self.body) if self.body else 0
 
     def dump(self):
-        data = struct.pack(self.header_format, self.status, self.length)
-        if self.body:
-            data += body
+        status = self.status
+        body = self.body or b''
+        if self.tag is not None:
+            status |= SP_TAG_FLAG
+        if self.compressed:
+            status |= SP_COMPRESS_FLAG
+            body = codec.encode(body)
 
-        return data
+        data = struct.pack(self.header_format, status, len(body))
+        if self.tag is not None:
+            data += struct.pack(self.tag_format, self.tag)
+        if self.compressed:
+            data += struct.pack('!I', self.length)
+
+        return data + body
 
     def send(self, s):
-        s.send(self.dump())
-        time.sleep(.2)
-        return self.receive(s)
+        self.send_only(s)
+        return self.receive(s, self.compressed)
+
+    def send_only(self, s):
+        s.sendall(self.dump())
 
     @classmethod
-    def receive(cls, s):
-        head = s.recv(5)
-        if len(head) < 5:
-            raise InvalidHeaderLengthError()
+    def send_many(cls, s, packets):
+        """Pipeline requests, the programmer answers them in order."""
+        s.sendall(b''.join(p.dump() for p in packets))
+        return [cls.receive(s, p.compressed) for p in packets]
+
+    @staticmethod
+    def _receive_exactly(s, length):
+        data = b''
+        while len(data) < length:
+            chunk = s.recv(length - len(data))
+            if not chunk:
+                raise ConnectionError('Connection closed by programmer')
+            data += chunk
+
+        return data
 
+    @classmethod
+    def receive(cls, s, compressed=False):
+        """Receive a response, compressed if its request was."""
+        head = cls._receive_exactly(s, 5)
         status, length = struct.unpack(cls.header_format, head)
+        tag = None
+        if status & SP_TAG_FLAG:
+            status &= ~SP_TAG_FLAG
+            tag, = struct.unpack(cls.tag_format, cls._receive_exactly(s, 2))
+        if compressed:
+            decoded_length, = struct.unpack('!I', cls._receive_exactly(s, 4))
         if length:
-            body = s.recv(length)
+            body = cls._receive_exactly(s, length)
+            if compressed:
+                body = codec.decode(body)
+                if len(body) != decoded_length:
+                    raise ProgrammerError('Corrupt compressed response')
         else:
             body = None
 
-        return cls(status, body)
+        return cls(status, body, tag)
 
     @property
     def ok(self):
         return self.status == SP_OK
 
     def __str__(self):
-        text = self.body.decode()
+        text = self.body.decode() if self.body else f'status {self.status}'
 
         if self.status != SP_OK:
             return f'Programmer Error: {text}'
@@ -71,15 +155,25 @@ class Packet:
 
 class WifiProgrammer:
     version = None
-    def __init__(self, host, port):
+    def __init__(self, host=None, port=None, compress=False, serial=None,
+                 baudrate=uart.DEFAULT_BAUDRATE, rtscts=False):
+        """Over TCP to host:port, or over the serial port if given."""
         self.host = host
         self.port = port
-        self._socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.compress = compress
+        if serial:
+            self._socket = uart.UartSocket(serial, baudrate, rtscts)
+        else:
+            self._socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+
+    def _packet(self, command, body=None, tag=None):
+        """A request, compressed if this programmer was asked to."""
+        return Packet(command, body, tag, self.compress)
 
     def __enter__(self):
         self._socket.__enter__()
         self._socket.connect((self.host, self.port))
-        version_request = Packet(SP_CMD_PROGRAMMER_VERSION)
+        version_request = self._packet(SP_CMD_PROGRAMMER_VERSION)
         response = version_request.send(self._socket)
         if response.status != 0:
             raise ProgrammerNotDetectedError(response)
@@ -91,7 +185,206 @@ class WifiProgrammer:
         return self._socket.__exit__()
 
     def get_device_info(self):
-        info = Packet(SP_CMD_DEVICE)
+        info = self._packet(SP_CMD_DEVICE)
         response = info.send(self._socket)
         return response
 
+    def status(self):
+        """Programmer state, available without the programming lease.
+
+        Returns a dict with the job and lease flags, the number of clients
+        and the last detected device.
+        """
+        response = self._packet(SP_CMD_STATUS).send(self._socket)
+        if not response.ok:
+            raise ProgrammerError(response)
+
+        flags, clients, device_id = struct.unpack('!BBI', response.body[:6])
+        return {
+            'job_running': bool(flags & 1),
+            'leased': bool(flags & 2),
+            'lease_holder': bool(flags & 4),
+            'clients': clients,
+            'device_id': device_id,
+            'device': response.body[6:].decode() or None,
+        }
+
+    def pools(self):
+        """Usage of the programmer's buffer pools, one dict per pool."""
+        response = self._packet(SP_CMD_POOLS).send(self._socket)
+        if not response.ok:
+            raise ProgrammerError(response)
+
+        fields = ('block_size', 'blocks', 'used', 'high_water', 'failures')
+        return [
+            dict(zip(fields, struct.unpack('!5H', response.body[i:i + 10])))
+            for i in range(0, len(response.body), 10)
+        ]
+
+    def log(self, position=0):
+        """Log text kept by the programmer, from the given position on.
+
+        Returns the position of the returned text, the number of bytes
+        dropped before reaching the UART and the text as bytes; read on from
+        position + len(text) to follow the log.
+        """
+        response = self._packet(
+            SP_CMD_LOG, struct.pack('!I', position)).send(self._socket)
+        if not response.ok:
+            raise ProgrammerError(response)
+
+        position, dropped = struct.unpack('!II', response.body[:8])
+        return position, dropped, response.body[8:]
+
+    def stats(self, reset=False):
+        """Performance counters since boot or the last reset.
+
+        Returns a dict with the elapsed time, heap usage, the event
+        counters, the CPU time per zone in microseconds and the latency
+        histogram of each command that ran.  With reset, the programmer
+        starts counting anew after reporting.
+        """
+        response = self._packet(
+            SP_CMD_STATS, bytes([1 if reset else 0])).send(self._socket)
+        if not response.ok:
+            raise ProgrammerError(response)
+
+        body = response.body
+        counters, zones, commands, buckets, mhz = body[:5]
+        elapsed, heap_free, heap_min = struct.unpack('!III', body[5:17])
+        offset = 17
+        values = struct.unpack_from(f'!{counters}I', body, offset)
+        offset += counters * 4
+        cycles = struct.unpack_from(f'!{zones}Q', body, offset)
+        offset += zones * 8
+        histograms = {}
+        for command in range(commands):
+            counts = struct.unpack_from(f'!{buckets}H', body, offset)
+            offset += buckets * 2
+            if any(counts):
+                histograms[command] = counts
+
+        return {
+            'elapsed_us': elapsed,
+            'heap_free': heap_free,
+            'heap_min': heap_min,
+            'counters': dict(zip(STATS_COUNTERS, values)),
+            'zones_us': {
+                name: c // mhz for name, c in zip(STATS_ZONES, cycles)
+            },
+            'latency': histograms,
+        }
+
+    def trace(self, position=0, mask=None):
+        """Trace events recorded by the programmer, from the given position.
+
+        Returns the position of the first returned event, the CPU clock in
+        MHz and a list of (ccount, event, phase, arg) tuples; read on from
+        position + len(events) to follow the trace.  With a mask, only the
+        selected categories are recorded from now on.
+        """
+        body = struct.pack('!I', position)
+        if mask is not None:
+            body += bytes([mask])
+        response = self._packet(SP_CMD_TRACE, body).send(self._socket)
+        if not response.ok:
+            raise ProgrammerError(response)
+
+        position, _, mhz = struct.unpack('!IIB', response.body[:9])
+        events = [
+            struct.unpack_from('!IBBH', response.body, offset)
+            for offset in range(9, len(response.body), 8)
+        ]
+        return position, mhz, events
+
+    def write_binary(self, address, words):
+        """Write 14-bit words from address on, returns the number written."""
+        # A link without flow control takes one receive buffer at a time.
+        max_body = getattr(self._socket, 'max_body', None)
+        step = (max_body - 4) // 2 if max_body else len(words) or 1
+        written = 0
+        for offset in range(0, max(len(words), 1), step):
+            chunk = words[offset:offset + step]
+            body = struct.pack(
+                f'!I{len(chunk)}H', address + offset, *chunk)
+            response = self._packet(SP_CMD_WRITEBIN, body).send(self._socket)
+            if not response.ok:
+                raise ProgrammerError(response)
+
+            written += struct.unpack('!I', response.body)[0]
+
+        return written
+
+    def power_off(self):
+        """Leave programming mode and power the target down."""
+        response = self._packet(SP_CMD_PWROFF).send(self._socket)
+        if not response.ok:
+            raise ProgrammerError(response)
+
+    def write_data(self, address, data):
+        """Write EEPROM bytes, returns a (written, skipped) tuple."""
+        request = self._packet(
+            SP_CMD_WRITE_DATA, struct.pack('!I', address) + data)
+        response = request.send(self._socket)
+        if not response.ok:
+            raise ProgrammerError(response)
+
+        return struct.unpack('!II', response.body)
+
+    def batch(self, steps):
+        """Run (command, body) steps in one round trip.
+
+        Returns the overall status and a list of (command, status, body)
+        tuples, one for each step that was executed.
+        """
+        body = b''.join(
+            struct.pack(Packet.header_format, c, len(b or b'')) + (b or b'')
+            for c, b in steps
+        )
+        response = self._packet(SP_CMD_BATCH, body).send(self._socket)
+        results = []
+        data = response.body or b''
+        while data:
+            command, status, length = struct.unpack('!BBI', data[:6])
+            results.append((command, status, data[6:6 + length]))
+            data = data[6 + length:]
+
+        return response.status, results
+
+    def read(self, start, end, tag=None, progress=None):
+        """Read the words from start to end, inclusive.
+
+        With a tag, the programmer runs the read in the background; it can
+        be cancelled with cancel(tag), e.g. from the progress callback,
+        which is called with (done, total) words.
+        """
+        body = struct.pack('!III', start, 0, end)
+        self._packet(SP_CMD_READ, body, tag).send_only(self._socket)
+        data = b''
+        while True:
+            response = Packet.receive(self._socket, self.compress)
+            if response.tag != tag:
+                # Answer to a request sent meanwhile, e.g. CANCEL.
+                continue
+            if response.status == SP_STATUS_READ_MORE and response.body:
+                data += response.body
+            elif response.status == SP_STATUS_PROGRESS and progress:
+                progress(*struct.unpack('!II', response.body))
+            elif response.status == SP_STATUS_ACCEPTED:
+                continue
+            elif response.status == SP_STATUS_READ_DONE and tag is None:
+                break
+            elif response.status == SP_OK and tag is not None:
+                break
+            elif response.status not in (SP_STATUS_PROGRESS,):
+                raise ProgrammerError(response)
+
+        return list(struct.unpack(f'!{len(data) // 4}I', data))
+
+    def cancel(self, tag):
+        """Ask the programmer to stop the operation with the given tag.
+
+        The answer is consumed by the call waiting for that operation.
+        """
+        self._packet(SP_CMD_CANCEL, struct.pack('!H', tag)).send_only(
+            self._socket)
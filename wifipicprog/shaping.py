@@ -0,0 +1,150 @@
+"""Make loopback behave like a WiFi link.
+
+Each direction is cut into segments, serialized at the given bandwidth and
+delayed by half the round trip time plus some jitter, so a programmer
+stand-in on localhost answers with the latency and throughput of the real
+thing.  Shaper does the arithmetic; ShapedLink applies it to a TCP relay
+and the emulator to its own sockets.
+"""
+
+import heapq
+import random
+import socket
+import threading
+import time
+
+
+SEGMENT_SIZE = 1460
+
+
+class Shaper:
+    """Delivery times for one direction of a connection.
+
+    rtt and jitter are in seconds, bandwidth in bytes per second, 0 for
+    unlimited.  Segments never overtake each other, as on TCP.
+    """
+
+    def __init__(self, rtt=0, bandwidth=0, jitter=0, segment=SEGMENT_SIZE,
+                 rng=None):
+        self.delay = rtt / 2
+        self.bandwidth = bandwidth
+        self.jitter = jitter
+        self.segment = segment or SEGMENT_SIZE
+        self.rng = rng or random.Random()
+        self.busy_until = 0
+        self.last_due = 0
+
+    def segments(self, data, now):
+        """Split data sent at now, returns (due, segment) pairs."""
+        result = []
+        for offset in range(0, len(data), self.segment):
+            chunk = data[offset:offset + self.segment]
+            sent = max(now, self.busy_until)
+            if self.bandwidth:
+                sent += len(chunk) / self.bandwidth
+            self.busy_until = sent
+            due = sent + self.delay
+            if self.jitter:
+                due += self.rng.uniform(0, self.jitter)
+            self.last_due = due = max(due, self.last_due)
+            result.append((due, chunk))
+        return result
+
+
+class _Direction(threading.Thread):
+    """Moves one direction of a connection, shaping it on the way."""
+
+    def __init__(self, source, target, shaper):
+        super().__init__(daemon=True)
+        self.source = source
+        self.target = target
+        self.shaper = shaper
+        self.queue = []
+        self.sequence = 0
+        self.condition = threading.Condition()
+        self.closed = False
+        self.writer = threading.Thread(target=self._write, daemon=True)
+
+    def run(self):
+        self.writer.start()
+        while True:
+            try:
+                data = self.source.recv(SEGMENT_SIZE)
+            except OSError:
+                data = b''
+
+            now = time.monotonic()
+            with self.condition:
+                for due, chunk in self.shaper.segments(data, now):
+                    heapq.heappush(self.queue, (due, self.sequence, chunk))
+                    self.sequence += 1
+                if not data:
+                    self.closed = True
+                self.condition.notify()
+
+            if not data:
+                return
+
+    def _write(self):
+        while True:
+            with self.condition:
+                while not self.queue and not self.closed:
+                    self.condition.wait()
+                if not self.queue:
+                    break
+                due, _, data = self.queue[0]
+                wait = due - time.monotonic()
+                if wait > 0:
+                    self.condition.wait(wait)
+                    continue
+                heapq.heappop(self.queue)
+
+            try:
+                self.target.sendall(data)
+            except OSError:
+                break
+
+        try:
+            self.target.shutdown(socket.SHUT_WR)
+        except OSError:
+            pass
+
+
+class ShapedLink:
+    """Listens on a local port and relays every connection to target.
+
+    The shaping parameters are those of Shaper.  Use as a context
+    manager; port is the one to connect to.
+    """
+
+    def __init__(self, target, rtt=0, bandwidth=0, jitter=0,
+                 segment=SEGMENT_SIZE):
+        self.target = target
+        self.shaping = dict(rtt=rtt, bandwidth=bandwidth, jitter=jitter,
+                            segment=segment)
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(('127.0.0.1', 0))
+        self.port = self.listener.getsockname()[1]
+        self.accepter = threading.Thread(target=self._accept, daemon=True)
+
+    def __enter__(self):
+        self.listener.listen(4)
+        self.accepter.start()
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.listener.close()
+
+    def _accept(self):
+        while True:
+            try:
+                client, _ = self.listener.accept()
+            except OSError:
+                return
+
+            upstream = socket.create_connection(self.target)
+            for s in (client, upstream):
+                s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            _Direction(client, upstream, Shaper(**self.shaping)).start()
+            _Direction(upstream, client, Shaper(**self.shaping)).start()
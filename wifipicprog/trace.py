@@ -0,0 +1,74 @@
+"""Trace events of the programmer as Chrome trace JSON.
+
+The programmer records begin/end events stamped with its cycle counter,
+see oldfirmware/include/trace.h.  The JSON opens in Perfetto or
+chrome://tracing, with one track per event category.
+"""
+
+import json
+
+
+EVENTS = {
+    0x10: 'receive',
+    0x11: 'parse',
+    0x12: 'send',
+    0x13: 'sent',
+    0x20: 'dispatch',
+    0x21: 'job step',
+    0x30: 'hvp',
+    0x31: 'wait',
+    0x40: 'write',
+    0x41: 'read',
+}
+
+CATEGORIES = {
+    1: 'network',
+    2: 'sp',
+    3: 'icsp',
+    4: 'word',
+}
+
+PHASES = ('B', 'E', 'i')
+
+# Category bits for the TRACE mask, bit n records events 0xn0 - 0xnF
+MASK = {name: 1 << category for category, name in CATEGORIES.items()}
+
+
+def to_chrome(events, mhz):
+    """Convert (ccount, event, phase, arg) tuples, oldest first.
+
+    The 32-bit cycle counter wraps every few tens of seconds; consecutive
+    events are assumed to be closer than that.
+    """
+    trace = []
+    cycles = 0
+    previous = None
+    for ccount, event, phase, arg in events:
+        if previous is not None:
+            cycles += (ccount - previous) & 0xFFFFFFFF
+        previous = ccount
+        category = event >> 4
+        record = {
+            'name': EVENTS.get(event, hex(event)),
+            'cat': CATEGORIES.get(category, str(category)),
+            'ph': PHASES[phase],
+            'ts': cycles / mhz,
+            'pid': 1,
+            'tid': category,
+            'args': {'arg': arg},
+        }
+        if phase == 2:
+            record['s'] = 't'
+        trace.append(record)
+
+    for category, name in CATEGORIES.items():
+        trace.append({
+            'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': category,
+            'args': {'name': name},
+        })
+
+    return {'traceEvents': trace, 'displayTimeUnit': 'ns'}
+
+
+def dump(events, mhz, f):
+    json.dump(to_chrome(events, mhz), f)
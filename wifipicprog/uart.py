@@ -0,0 +1,48 @@
+"""SP over a serial port, for a programmer wired to a USB UART adapter.
+
+The programmer speaks the same protocol on UART0 as over TCP.  UartSocket
+gives a serial port the few socket methods Packet and WifiProgrammer use,
+so the rest of the client does not know the difference.
+"""
+
+
+DEFAULT_BAUDRATE = 921600
+
+# Longest request body that fits the programmer's receive ring, see
+# SP_UART_RX_BUFFER.  Only needed without RTS/CTS, which stops the
+# adapter before the ring overflows.
+MAX_BODY = 1024
+
+
+class UartSocket:
+    def __init__(self, port, baudrate=DEFAULT_BAUDRATE, rtscts=False):
+        # Optional dependency, only needed for serial links.
+        import serial
+
+        self.serial = serial.Serial(port, baudrate, rtscts=rtscts)
+        self.serial.reset_input_buffer()
+        self.max_body = None if rtscts else MAX_BODY
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def connect(self, address=None):
+        """Nothing to connect, the port is open already."""
+
+    def sendall(self, data):
+        self.serial.write(data)
+        self.serial.flush()
+
+    def recv(self, size):
+        """Wait for at least one byte, then take what arrived meanwhile."""
+        data = self.serial.read(1)
+        waiting = min(self.serial.in_waiting, size - len(data))
+        if waiting > 0:
+            data += self.serial.read(waiting)
+        return data
+
+    def close(self):
+        self.serial.close()
@@ -0,0 +1,259 @@
+"""ICSP timing conformance of a VCD capture.
+
+Reads the CLOCK, DATA, MCLR and VDD waveform recorded by the host build
+(``wpp-host -c``, ``wpp-sim -c``) or exported from a logic analyzer, decodes
+the ICSP transactions and measures every interval the datasheet bounds.
+The report shows the tightest setup, hold and gap times against their
+limits, the effective bit rate, and how the session time splits into
+shifting, program cycles and idle slack.
+"""
+
+import re
+
+
+# Datasheet minimums in nanoseconds, as checked by oldfirmware/host/pic_sim.h
+LIMITS = {
+    'TSET1': 100,   # DATA setup before CLOCK falls
+    'THLD1': 100,   # DATA hold after CLOCK falls
+    'TDLY2': 1000,  # Between a command and its data, or the next command
+    'TPPDP': 5000,  # VPP before VDD
+    'THLD0': 5000,  # VDD before the first CLOCK
+}
+
+# Commands followed by a 16 bit data word, see oldfirmware/include/pic_io.h
+DATA_COMMANDS = {0x00, 0x02, 0x03, 0x04, 0x05}
+PROGRAM_COMMANDS = {0x08, 0x09, 0x0B, 0x18}
+
+SIGNALS = ('clock', 'data', 'mclr', 'vdd')
+
+_UNITS = {'s': 10 ** 9, 'ms': 10 ** 6, 'us': 10 ** 3, 'ns': 1, 'ps': 10 ** -3,
+          'fs': 10 ** -6}
+
+
+def parse(f):
+    """Read a VCD file, returns (time_ns, signal, value) changes in order.
+
+    Signals are matched by name, case-insensitively and ignoring scopes, so
+    captures from other tools work as long as the channels are named after
+    the ICSP pins.
+    """
+    ids = {}
+    scale = 1
+    changes = []
+    now = 0
+    text = f.read()
+    header, _, body = text.partition('$enddefinitions')
+
+    match = re.search(r'\$timescale\s+(\d+)\s*(\w+)\s+\$end', header)
+    if match:
+        scale = int(match.group(1)) * _UNITS[match.group(2)]
+
+    for match in re.finditer(r'\$var\s+\S+\s+1\s+(\S+)\s+(\S+)', header):
+        name = match.group(2).split('.')[-1].lower()
+        if name in SIGNALS:
+            ids[match.group(1)] = name
+
+    for token in body.split():
+        if token.startswith('#'):
+            now = int(token[1:]) * scale
+        elif token[0] in '01xXzZ' and token[1:] in ids:
+            changes.append((now, ids[token[1:]], token[0].lower()))
+
+    return changes
+
+
+class _Interval:
+    def __init__(self):
+        self.count = 0
+        self.min = None
+        self.total = 0
+
+    def add(self, value):
+        self.count += 1
+        self.total += value
+        if self.min is None or value < self.min:
+            self.min = value
+
+
+def analyze(changes, mclr_active_high=False):
+    """Decode the ICSP transactions and measure their timing.
+
+    VPP is applied while MCLR is low, as the programmer drives it; pass
+    ``mclr_active_high`` for captures taken on the VPP line itself.
+    """
+    vpp_level = '1' if mclr_active_high else '0'
+    level = dict.fromkeys(SIGNALS, 'x')
+    intervals = {name: _Interval() for name in LIMITS}
+    violations = dict.fromkeys(LIMITS, 0)
+
+    session_start = None
+    session_time = 0
+    sessions = 0
+    vpp_at = None
+    first_clock = False
+
+    bits = 0
+    shift_time = 0
+    program_time = 0
+    transactions = 0
+    command = 0
+    count = 0
+    data_phase = False
+    transaction_start = None
+    shift_end = None
+    program_pending = False
+    data_at = 0
+    rise_at = 0
+    fall_at = None
+    hold_pending = False
+
+    def check(name, value):
+        intervals[name].add(value)
+        if value < LIMITS[name]:
+            violations[name] += 1
+
+    for now, signal, value in changes:
+        if level[signal] == value:
+            continue
+        previous = level[signal]
+        level[signal] = value
+        powered = level['vdd'] == '1' and level['mclr'] == vpp_level
+
+        if signal in ('vdd', 'mclr'):
+            if signal == 'mclr' and value == vpp_level:
+                vpp_at = now
+            if signal == 'vdd' and value == '1' and vpp_at is not None and \
+                    level['mclr'] == vpp_level:
+                check('TPPDP', now - vpp_at)
+            if powered and session_start is None:
+                session_start = now
+                sessions += 1
+                first_clock = True
+                count = 0
+                data_phase = False
+                shift_end = None
+                program_pending = False
+            elif not powered and session_start is not None:
+                session_time += now - session_start
+                session_start = None
+            continue
+
+        if signal == 'data':
+            if value in '01' and previous in '01':
+                if hold_pending and session_start is not None:
+                    check('THLD1', now - fall_at)
+                hold_pending = False
+            data_at = now
+            continue
+
+        if session_start is None:
+            continue
+
+        if value == '1':
+            # Rising CLOCK, ends the hold of the bit before within a shift,
+            # or starts a shift after any wait.
+            rise_at = now
+            if hold_pending and count:
+                check('THLD1', now - fall_at)
+            hold_pending = False
+            if first_clock:
+                check('THLD0', now - session_start)
+                first_clock = False
+            if count == 0:
+                if program_pending:
+                    program_time += now - shift_end
+                    program_pending = False
+                elif shift_end is not None:
+                    check('TDLY2', now - shift_end)
+                if not data_phase:
+                    transaction_start = now
+            continue
+
+        # Falling CLOCK latches a bit.
+        bits += 1
+        fall_at = now
+        if not data_phase or command not in (0x04, 0x05):
+            check('TSET1', now - max(data_at, rise_at))
+            hold_pending = True
+        if not data_phase:
+            if count == 0:
+                command = 0
+            command |= (level['data'] == '1') << count
+            count += 1
+            if count < 6:
+                continue
+            count = 0
+            shift_end = now
+            if command in DATA_COMMANDS:
+                data_phase = True
+                continue
+            program_pending = command in PROGRAM_COMMANDS
+        else:
+            count += 1
+            if count < 16:
+                continue
+            count = 0
+            data_phase = False
+            shift_end = now
+        transactions += 1
+        shift_time += now - transaction_start
+
+    if session_start is not None and changes:
+        session_time += changes[-1][0] - session_start
+
+    return {
+        'sessions': sessions,
+        'session_ns': session_time,
+        'transactions': transactions,
+        'bits': bits,
+        'shift_ns': shift_time,
+        'program_ns': program_time,
+        'idle_ns': max(session_time - shift_time - program_time, 0),
+        'intervals': {
+            name: {'count': i.count, 'min_ns': i.min, 'total_ns': i.total}
+            for name, i in intervals.items()
+        },
+        'violations': violations,
+    }
+
+
+def report(result):
+    """Format an analyze() result as text lines."""
+    session = result['session_ns']
+    lines = [
+        f'{result["sessions"]} sessions, {session / 1e6:.3f} ms powered, '
+        f'{result["transactions"]} transactions, {result["bits"]} bits',
+    ]
+    if session:
+        lines.append(
+            f'effective bit rate: {result["bits"] / session * 1e6:.1f} kbit/s'
+            f', while shifting: '
+            f'{result["bits"] / max(result["shift_ns"], 1) * 1e6:.1f} kbit/s'
+        )
+        for name in ('shift', 'program', 'idle'):
+            lines.append(
+                f'  {name:<8} {result[name + "_ns"] / 1e6:12.3f} ms '
+                f'{100 * result[name + "_ns"] / session:5.1f}%'
+            )
+
+    lines.append(f'  {"":<8} {"min":>12} {"limit":>10} {"slack":>12}')
+    wasted = 0
+    for name, interval in result['intervals'].items():
+        if not interval['count']:
+            continue
+        limit = LIMITS[name]
+        slack = interval['total_ns'] - limit * interval['count']
+        if name in ('TSET1', 'THLD1', 'TDLY2'):
+            wasted += slack
+        flag = f'  {result["violations"][name]} violations' \
+            if result['violations'][name] else ''
+        lines.append(
+            f'  {name:<8} {interval["min_ns"] / 1000:9.3f} us '
+            f'{limit / 1000:7.3f} us {slack / 1e6:9.3f} ms{flag}'
+        )
+    if result['shift_ns']:
+        lines.append(
+            f'slack beyond the limits: {wasted / 1e6:.3f} ms, '
+            f'{100 * wasted / result["shift_ns"]:.1f}% of the shifting time'
+        )
+    return lines